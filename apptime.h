@@ -2,25 +2,154 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <time.h>
 #include <sys/time.h>
+#include <atomic>
+#include <algorithm>
 #include <optional>
 
 #ifndef MICROS_PER_SECOND
     #define MICROS_PER_SECOND 1000000
 #endif
 
+#ifndef NANOS_PER_SECOND
+    #define NANOS_PER_SECOND 1000000000LL
+#endif
+
+#ifndef NANOS_PER_MICRO
+    #define NANOS_PER_MICRO 1000LL
+#endif
+
+// Server epoch discipline
+
+constexpr int64_t kClockStepThresholdNanos = NANOS_PER_SECOND / 2;    // Bigger errors are stepped, not slewed
+constexpr int64_t kClockMaxSlewPPM         = 500;                     // Fastest we'll drift the offset
+constexpr int64_t kClockSmoothing          = 8;                       // EWMA divisor for offset samples
+constexpr int64_t kClockDisciplineInterval = NANOS_PER_SECOND / 10;   // How often the offset is resampled
+
 // AppTime
 //
-// Helper class for getting the current time in seconds since the epoch
+// Helper class for getting the current time.  Everything is measured on CLOCK_MONOTONIC, in integer
+// nanoseconds, so nothing that runs locally - frame intervals, idle timeouts - ever sees the wall clock
+// jump.  Frame timestamps, though, are in the server's epoch, which is wall-clock time since 1970, so we
+// keep a separate offset from the monotonic clock to that epoch.
+//
+// The offset follows CLOCK_REALTIME, which ntpd, chrony or ptp4l keep disciplined to the same reference
+// the server and the other nodes use.  Rather than copying wall time directly, Discipline() smooths the
+// samples and slews the offset by no more than kClockMaxSlewPPM, so an adjustment moves presentation
+// gradually, the same way on every node, instead of lurching frames forward or back mid-stream.  Only a
+// gross error, like the clock being set at boot, is stepped.
 
 class CAppTime
 {
+    static int64_t ClockNanos(clockid_t clock)
+    {
+        timespec ts;
+        clock_gettime(clock, &ts);
+        return (int64_t)ts.tv_sec * NANOS_PER_SECOND + ts.tv_nsec;
+    }
+
+    // SampleOffset
+    //
+    // Measures CLOCK_REALTIME minus CLOCK_MONOTONIC, bracketing the realtime read between two monotonic
+    // reads so the error in the sample is at most half the time the three calls took
+
+    static int64_t SampleOffset()
+    {
+        const int64_t before   = ClockNanos(CLOCK_MONOTONIC);
+        const int64_t realtime = ClockNanos(CLOCK_REALTIME);
+        const int64_t after    = ClockNanos(CLOCK_MONOTONIC);
+        return realtime - (before + (after - before) / 2);
+    }
+
+    inline static std::atomic<int64_t> _serverOffsetNanos   { SampleOffset() };     // Server epoch minus monotonic
+    inline static int64_t              _targetOffsetNanos   = 0;                    // Smoothed samples, Discipline() only
+    inline static int64_t              _lastDisciplineNanos = 0;
+
   public:
 
+    // MonotonicNanos
+    //
+    // Local time that only ever moves forward at a steady rate; for measuring intervals
+
+    static int64_t MonotonicNanos()
+    {
+        return ClockNanos(CLOCK_MONOTONIC);
+    }
+
+    // SleepUntil
+    //
+    // Sleeps until a MonotonicNanos() time, or returns straight away if it has already passed
+
+    static void SleepUntil(int64_t monotonicNanos)
+    {
+        timespec ts;
+        ts.tv_sec  = monotonicNanos / NANOS_PER_SECOND;
+        ts.tv_nsec = monotonicNanos % NANOS_PER_SECOND;
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr))
+            ;
+    }
+
+    // ServerNanos
+    //
+    // Our best estimate of the server's clock, in nanoseconds since the epoch
+
+    static int64_t ServerNanos()
+    {
+        return MonotonicNanos() + _serverOffsetNanos.load(std::memory_order_relaxed);
+    }
+
+    // ServerOffsetNanos
+    //
+    // What to add to a MonotonicNanos() value to get server time
+
+    static int64_t ServerOffsetNanos()
+    {
+        return _serverOffsetNanos.load(std::memory_order_relaxed);
+    }
+
+    // CurrentTime
+    //
+    // Server time in seconds, as a double, for the places that report it rather than compute with it
+
     static double CurrentTime()
     {
-        timeval tv;
-        gettimeofday(&tv, nullptr);
-        return (double)tv.tv_sec + (tv.tv_usec/(double)MICROS_PER_SECOND);
+        return ServerNanos() / (double)NANOS_PER_SECOND;
+    }
+
+    // Discipline
+    //
+    // Brings the server offset toward what the system clock says it should be.  Call it as often as is
+    // convenient, but from one thread only; it does nothing until kClockDisciplineInterval has passed.
+    // Until the first call, the offset is whatever the system clock said at startup.
+
+    static void Discipline()
+    {
+        const int64_t now = MonotonicNanos();
+        if (_lastDisciplineNanos != 0 && now - _lastDisciplineNanos < kClockDisciplineInterval)
+            return;
+
+        const int64_t measured = SampleOffset();
+
+        if (_lastDisciplineNanos == 0 || std::abs(measured - _serverOffsetNanos.load(std::memory_order_relaxed)) > kClockStepThresholdNanos)
+        {
+            if (_lastDisciplineNanos != 0)
+                printf("System clock moved by %.3f seconds, stepping to match\n",
+                       (measured - _serverOffsetNanos.load(std::memory_order_relaxed)) / (double)NANOS_PER_SECOND);
+            _targetOffsetNanos   = measured;
+            _lastDisciplineNanos = now;
+            _serverOffsetNanos.store(measured, std::memory_order_relaxed);
+            return;
+        }
+
+        _targetOffsetNanos += (measured - _targetOffsetNanos) / kClockSmoothing;
+
+        const int64_t maxSlew = (now - _lastDisciplineNanos) * kClockMaxSlewPPM / 1000000;
+        const int64_t current = _serverOffsetNanos.load(std::memory_order_relaxed);
+        _serverOffsetNanos.store(current + std::clamp(_targetOffsetNanos - current, -maxSlew, maxSlew), std::memory_order_relaxed);
+        _lastDisciplineNanos = now;
     }
-};
\ No newline at end of file
+};
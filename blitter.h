@@ -0,0 +1,202 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Blitter.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Copies a frame's color data onto a canvas through a PixelMap, splitting
+//    the work across a small pool of persistent worker threads.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "led-matrix.h"     // Raspberry Pi LED Matrix library
+#include <vector>
+#include <thread>
+#include <barrier>
+#include <algorithm>
+
+#include "pixeltypes.h"
+#include "pixelmap.h"
+#include "colorlut.h"
+
+using rgb_matrix::Canvas;
+
+// Blitter
+//
+// The matrix library packs each pixel into GPIO words that are shared by the upper and lower halves of a
+// panel and by the parallel chains, so two threads writing different rows can clobber each other.  Every
+// GPIO word does belong to exactly one column, though, so we split the frame into column bands aligned to
+// panel boundaries and give each band to one thread.  Within a band we walk row by row through the
+// PixelMap.  If the library has its own pixel mapper installed, columns no longer map one to one onto
+// GPIO words, and the caller should ask for a single band.
+//
+// The calling thread always draws the first band itself, so a Blitter with one band has no workers at all.
+//
+// Color correction is done in the same loop, one table lookup per channel as each pixel is copied, so it
+// costs no pass of its own.  An identity table isn't looked up at all.
+
+class Blitter
+{
+    struct Job
+    {
+        const CRGB *     pSource  = nullptr;
+        size_t           cSource  = 0;
+        const PixelMap * pMap     = nullptr;
+        Canvas *         pCanvas  = nullptr;
+        size_t           y0       = 0;                  // Rows [y0, y1) are drawn
+        size_t           y1       = 0;
+        size_t           yOffset  = 0;                  // Canvas row that map row 0 lands on
+    };
+
+    const ColorLut *         _pLut;                     // Color correction, or nullptr for none
+    std::vector<size_t>      _bandStarts;               // First column of each band, plus the width at the end
+    std::vector<std::thread> _workers;
+    std::barrier<>           _startBarrier;
+    std::barrier<>           _doneBarrier;
+    Job                      _job;
+    bool                     _bStopping;
+
+    // BlitBand
+    //
+    // The actual kernel: for every row asked for, look up where each destination pixel comes from, correct
+    // its color if asked to, and set it
+
+    template <bool bCorrect>
+    static void BlitBand(const Job & job, const ColorLut * pLut, size_t x0, size_t x1)
+    {
+        const PixelMap & map = *job.pMap;
+        for (size_t y = job.y0; y < job.y1; y++)
+        {
+            const uint32_t * pRow = map.Row(y);
+            for (size_t x = x0; x < x1; x++)
+            {
+                const uint32_t src = pRow[x];
+                CRGB color = src < job.cSource ? job.pSource[src] : CRGB(0, 0, 0);
+                if constexpr (bCorrect)
+                    color = pLut->Apply(color);
+                job.pCanvas->SetPixel(x, y + job.yOffset, color.r, color.g, color.b);
+            }
+        }
+    }
+
+    void BlitBand(size_t iBand)
+    {
+        if (_pLut)
+            BlitBand<true>(_job, _pLut, _bandStarts[iBand], _bandStarts[iBand + 1]);
+        else
+            BlitBand<false>(_job, nullptr, _bandStarts[iBand], _bandStarts[iBand + 1]);
+    }
+
+    void WorkerLoop(size_t iBand)
+    {
+        while (true)
+        {
+            _startBarrier.arrive_and_wait();
+            if (_bStopping)
+                break;
+            BlitBand(iBand);
+            _doneBarrier.arrive_and_wait();
+        }
+    }
+
+    static size_t BandCount(size_t width, size_t panelWidth, size_t cThreads)
+    {
+        const size_t cPanels = std::max<size_t>(1, width / std::max<size_t>(1, panelWidth));
+        return std::clamp<size_t>(cThreads, 1, cPanels);
+    }
+
+  public:
+
+    // width is the matrix width, panelWidth the width of one panel in the chain, and cThreads how many
+    // threads (including the caller) should share the work.  The color table, if any, must outlive us.
+
+    Blitter(size_t width, size_t panelWidth, size_t cThreads, const ColorLut * pLut = nullptr)
+        : _pLut(pLut && !pLut->IsIdentity() ? pLut : nullptr),
+          _startBarrier(BandCount(width, panelWidth, cThreads)),
+          _doneBarrier(BandCount(width, panelWidth, cThreads)),
+          _bStopping(false)
+    {
+        const size_t cBands  = BandCount(width, panelWidth, cThreads);
+        const size_t cPanels = std::max<size_t>(1, width / std::max<size_t>(1, panelWidth));
+
+        // Hand out whole panels as evenly as we can; any leftover columns go to the last band
+
+        for (size_t i = 0; i < cBands; i++)
+            _bandStarts.push_back((cPanels * i / cBands) * panelWidth);
+        _bandStarts.push_back(width);
+
+        for (size_t i = 1; i < cBands; i++)
+            _workers.emplace_back([this, i] { WorkerLoop(i); });
+    }
+
+    ~Blitter()
+    {
+        if (!_workers.empty())
+        {
+            _bStopping = true;
+            _startBarrier.arrive_and_wait();
+            for (auto & worker : _workers)
+                worker.join();
+        }
+    }
+
+    Blitter(const Blitter &) = delete;
+    Blitter & operator=(const Blitter &) = delete;
+
+    size_t Bands() const
+    {
+        return _bandStarts.size() - 1;
+    }
+
+    // Blit
+    //
+    // Draws cSource pixels of color data onto the canvas through the map, returning once every band is done.
+    // Map entries beyond the end of the source draw as black.  Only map rows [y0, y1) are touched, so a
+    // caller that knows the rest of the canvas is already current can skip it.  The map may cover just a
+    // band of the canvas, starting yOffset rows down; the columns, and so the GPIO words, are the same.
+
+    void Blit(const CRGB * pSource, size_t cSource, const PixelMap & map, Canvas & canvas, size_t y0, size_t y1, size_t yOffset = 0)
+    {
+        if (y0 >= y1)
+            return;
+
+        _job = Job { pSource, cSource, &map, &canvas, y0, std::min(y1, map.Height()), yOffset };
+
+        if (_workers.empty())
+        {
+            BlitBand(0);
+            return;
+        }
+
+        _startBarrier.arrive_and_wait();
+        BlitBand(0);
+        _doneBarrier.arrive_and_wait();
+    }
+
+    void Blit(const CRGB * pSource, size_t cSource, const PixelMap & map, Canvas & canvas)
+    {
+        Blit(pSource, cSource, map, canvas, 0, map.Height());
+    }
+};
@@ -0,0 +1,157 @@
+//+--------------------------------------------------------------------------
+//
+// File:        CanvasPresenter.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Keeps a small pool of offscreen FrameCanvas objects and hands finished
+//    ones to the matrix with SwapOnVSync on a dedicated presenter thread, so
+//    that the draw thread never blocks waiting for the refresh boundary.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "led-matrix.h"     // Raspberry Pi LED Matrix library
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "globals.h"
+#include "apptime.h"
+#include "metrics.h"
+
+using rgb_matrix::RGBMatrix;
+using rgb_matrix::FrameCanvas;
+
+// CanvasPresenter
+//
+// At any moment one canvas is on the panel, one may be in flight inside SwapOnVSync, one may be waiting
+// as the pending frame, and one is being drawn.  The pool is sized so that a free canvas is always
+// available to draw into; if the draw thread finishes a frame before the previous pending one was shown,
+// the newer frame replaces it and the stale canvas goes straight back into the pool.  Nothing is ever
+// copied - the canvas that was drawn is the canvas that gets displayed.
+
+class CanvasPresenter
+{
+    RGBMatrix &                 _matrix;
+    std::vector<FrameCanvas *>  _freeCanvases;              // Canvases available to draw into
+    FrameCanvas *               _pPendingCanvas;            // Finished canvas waiting for the next VSync
+    int64_t                     _pendingDueNanos;           // Server time the pending canvas's frame was due
+    std::mutex                  _mutex;                     // Protects the free list and pending slot
+    std::condition_variable     _cvPending;                 // Signals the presenter thread
+    std::condition_variable     _cvFree;                    // Signals the draw thread if the pool ran dry
+    std::thread                 _thread;
+    bool                        _bStopping;
+
+    // PresentLoop
+    //
+    // Presenter thread body: waits for a pending canvas, swaps it onto the panel at the next VSync, and
+    // returns the canvas that was previously on display to the free pool.  The swap returning is as close
+    // as we get to knowing when the frame appeared, so that's when its lateness is recorded.
+
+    void PresentLoop()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_bStopping)
+        {
+            _cvPending.wait(lock, [this] { return _bStopping || _pPendingCanvas != nullptr; });
+            if (_bStopping)
+                break;
+
+            FrameCanvas * pCanvas = _pPendingCanvas;
+            const int64_t due     = _pendingDueNanos;
+            _pPendingCanvas = nullptr;
+
+            lock.unlock();
+            FrameCanvas * pPrevious = _matrix.SwapOnVSync(pCanvas);
+            Metrics().RecordPresentation(due, CAppTime::ServerNanos());
+            lock.lock();
+
+            if (pPrevious)
+                _freeCanvases.push_back(pPrevious);
+            _cvFree.notify_one();
+        }
+    }
+
+  public:
+
+    // The canvases are owned (and eventually freed) by the RGBMatrix itself
+
+    explicit CanvasPresenter(RGBMatrix & matrix, size_t cCanvases = kFrameCanvasPoolSize)
+        : _matrix(matrix), _pPendingCanvas(nullptr), _pendingDueNanos(0), _bStopping(false)
+    {
+        _freeCanvases.reserve(cCanvases + 1);                   // +1 for the canvas the matrix starts out showing
+        for (size_t i = 0; i < cCanvases; i++)
+            _freeCanvases.push_back(_matrix.CreateFrameCanvas());
+
+        _thread = std::thread([this] { PresentLoop(); });
+    }
+
+    ~CanvasPresenter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _bStopping = true;
+        }
+        _cvPending.notify_one();
+        _thread.join();
+    }
+
+    CanvasPresenter(const CanvasPresenter &) = delete;
+    CanvasPresenter & operator=(const CanvasPresenter &) = delete;
+
+    // AcquireCanvas
+    //
+    // Returns an offscreen canvas to draw the next frame into.  The pool size means this does not wait
+    // in practice, but if every canvas is somehow tied up we block until the presenter frees one.
+
+    FrameCanvas * AcquireCanvas()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cvFree.wait(lock, [this] { return !_freeCanvases.empty(); });
+
+        FrameCanvas * pCanvas = _freeCanvases.back();
+        _freeCanvases.pop_back();
+        return pCanvas;
+    }
+
+    // Present
+    //
+    // Queues a fully drawn canvas to be swapped onto the panel at the next refresh boundary.  If a
+    // previous frame is still waiting, it was never going to be seen, so it is recycled.  dueNanos is
+    // the server time the frame on the canvas was meant to be shown.
+
+    void Present(FrameCanvas * pCanvas, int64_t dueNanos)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_pPendingCanvas)
+                _freeCanvases.push_back(_pPendingCanvas);
+            _pPendingCanvas  = pCanvas;
+            _pendingDueNanos = dueNanos;
+        }
+        _cvPending.notify_one();
+    }
+};
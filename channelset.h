@@ -0,0 +1,115 @@
+//+--------------------------------------------------------------------------
+//
+// File:        ChannelSet.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    The queues of a node that drives several logical channels, one per
+//    band of the matrix, and the mapping from a packet's channel16 bits to
+//    the channels it's meant for.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "globals.h"
+#include "ledbuffer.h"
+
+// ChannelMask
+//
+// The channel16 bits of cChannels channels numbered from firstChannel, which counts from 1
+
+constexpr uint16_t ChannelMask(int firstChannel, size_t cChannels)
+{
+    return (uint16_t)(((1u << cChannels) - 1) << (firstChannel - 1));
+}
+
+// AddressedChannels
+//
+// Which of our channels a packet is for, as a bit per channel index.  A channel16 of 0 is for everyone.
+
+constexpr uint32_t AddressedChannels(uint16_t channel16, int firstChannel, size_t cChannels)
+{
+    const uint32_t all = (1u << cChannels) - 1;
+    return channel16 == 0 ? all : ((uint32_t)channel16 >> (firstChannel - 1)) & all;
+}
+
+// ChannelSet
+//
+// One LEDBufferManager per channel, all drawing on a single pool.  A packet is read into a frame before its
+// header says which channel it's for, so sharing the pool lets that frame be queued on whichever channel it
+// turns out to be without copying it.  The pool holds what each queue would have had to itself.
+
+class ChannelSet
+{
+    LEDBufferPool                                  _pool;
+    std::vector<std::unique_ptr<LEDBufferManager>> _managers;
+    std::vector<LEDBufferManager *>                _pManagers;     // The same, in the form the stages take them
+
+  public:
+
+    ChannelSet(size_t cChannels, size_t cBuffers, size_t cLEDs, QueueFormat format = QueueFormat::Rgb24)
+        : _pool(cChannels * LEDBufferManager::PoolFrames(format, cBuffers), cLEDs)
+    {
+        for (size_t i = 0; i < cChannels; i++)
+        {
+            _managers.push_back(std::make_unique<LEDBufferManager>(_pool, cBuffers, format));
+            _pManagers.push_back(_managers.back().get());
+        }
+    }
+
+    ChannelSet(const ChannelSet &) = delete;
+    ChannelSet & operator=(const ChannelSet &) = delete;
+
+    size_t Count() const
+    {
+        return _managers.size();
+    }
+
+    LEDBufferManager & operator[](size_t i)
+    {
+        return *_managers[i];
+    }
+
+    std::span<LEDBufferManager * const> Managers() const
+    {
+        return _pManagers;
+    }
+
+    // MemoryBytes
+    //
+    // What the shared pool and every channel's arena took at startup
+
+    size_t MemoryBytes() const
+    {
+        size_t cb = _pool.MemoryBytes();
+        for (const auto & pManager : _managers)
+            cb += pManager->MemoryBytes();
+        return cb;
+    }
+};
@@ -0,0 +1,157 @@
+//+--------------------------------------------------------------------------
+//
+// File:        ColorLut.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Per-channel lookup tables that fold gamma, white balance and color
+//    temperature into a single lookup per channel, applied as each pixel
+//    is copied to the matrix.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <strings.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <array>
+
+#include "pixeltypes.h"
+
+// ColorLut
+//
+// Built once at startup, from the command line.  Each entry is (v / 255) ^ gamma, scaled by that channel's
+// white balance and color temperature, the same two factors FastLED multiplies together for its color
+// correction.  With gamma at or above 1 and no factor above 255, no entry exceeds its index, so a power
+// estimate made from the uncorrected frame is an upper bound on what the panel actually draws.
+
+class ColorLut
+{
+    std::array<std::array<uint8_t, 256>, 3> _tables;        // Red, green, blue
+
+  public:
+
+    ColorLut(const std::array<float, 3> & gamma, const CRGB & whiteBalance, const CRGB & temperature)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const double scale = (whiteBalance.raw[c] / 255.0) * (temperature.raw[c] / 255.0);
+            for (int v = 0; v < 256; v++)
+                _tables[c][v] = (uint8_t)std::lround(255.0 * std::pow(v / 255.0, gamma[c]) * scale);
+        }
+    }
+
+    // IsIdentity
+    //
+    // True if the tables change nothing, in which case the blitter can skip them entirely
+
+    bool IsIdentity() const
+    {
+        for (const auto & table : _tables)
+            for (int v = 0; v < 256; v++)
+                if (table[v] != v)
+                    return false;
+        return true;
+    }
+
+    CRGB Apply(const CRGB & color) const
+    {
+        return CRGB(_tables[0][color.r], _tables[1][color.g], _tables[2][color.b]);
+    }
+};
+
+// ParseGamma
+//
+// Either one exponent for all three channels or a comma-separated exponent for each of red, green and blue
+
+inline bool ParseGamma(const char * text, std::array<float, 3> & gamma)
+{
+    float r, g, b;
+    char  extra;
+    if (sscanf(text, "%f,%f,%f%c", &r, &g, &b, &extra) == 3)
+        gamma = { r, g, b };
+    else if (sscanf(text, "%f%c", &r, &extra) == 1)
+        gamma = { r, r, r };
+    else
+        return false;
+
+    return gamma[0] > 0 && gamma[1] > 0 && gamma[2] > 0;
+}
+
+// ParseColorCorrection
+//
+// A six-digit RRGGBB hex value, or the name of one of FastLED's LEDColorCorrection or ColorTemperature
+// presets, such as "TypicalSMD5050" or "Tungsten100W"
+
+inline bool ParseColorCorrection(const char * text, CRGB & color)
+{
+    static const struct { const char * name; uint32_t value; } presets[] =
+    {
+        { "TypicalSMD5050",          TypicalSMD5050          },
+        { "TypicalLEDStrip",         TypicalLEDStrip         },
+        { "Typical8mmPixel",         Typical8mmPixel         },
+        { "TypicalPixelString",      TypicalPixelString      },
+        { "UncorrectedColor",        UncorrectedColor        },
+        { "Candle",                  Candle                  },
+        { "Tungsten40W",             Tungsten40W             },
+        { "Tungsten100W",            Tungsten100W            },
+        { "Halogen",                 Halogen                 },
+        { "CarbonArc",               CarbonArc               },
+        { "HighNoonSun",             HighNoonSun             },
+        { "DirectSunlight",          DirectSunlight          },
+        { "OvercastSky",             OvercastSky             },
+        { "ClearBlueSky",            ClearBlueSky            },
+        { "WarmFluorescent",         WarmFluorescent         },
+        { "StandardFluorescent",     StandardFluorescent     },
+        { "CoolWhiteFluorescent",    CoolWhiteFluorescent    },
+        { "FullSpectrumFluorescent", FullSpectrumFluorescent },
+        { "GrowLightFluorescent",    GrowLightFluorescent    },
+        { "BlackLightFluorescent",   BlackLightFluorescent   },
+        { "MercuryVapor",            MercuryVapor            },
+        { "SodiumVapor",             SodiumVapor             },
+        { "MetalHalide",             MetalHalide             },
+        { "HighPressureSodium",      HighPressureSodium      },
+        { "UncorrectedTemperature",  UncorrectedTemperature  },
+    };
+
+    for (const auto & preset : presets)
+    {
+        if (0 == strcasecmp(text, preset.name))
+        {
+            color = CRGB(preset.value >> 16, (preset.value >> 8) & 0xFF, preset.value & 0xFF);
+            return true;
+        }
+    }
+
+    char * pEnd;
+    const unsigned long value = strtoul(text, &pEnd, 16);
+    if (strlen(text) != 6 || *pEnd != 0)
+        return false;
+
+    color = CRGB(value >> 16, (value >> 8) & 0xFF, value & 0xFF);
+    return true;
+}
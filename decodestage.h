@@ -0,0 +1,320 @@
+//+--------------------------------------------------------------------------
+//
+// File:        DecodeStage.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Expands compressed envelopes on worker threads of their own, so the
+//    socket thread can go straight back to reading, and hands the frames
+//    back in the order they arrived.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "globals.h"
+#include "ledbuffer.h"
+#include "decompressor.h"
+#include "metrics.h"
+#include "threadtuning.h"
+
+// ExpandEnvelope
+//
+// Expands a whole compressed envelope, which must already have passed the socket server's checks, into a
+// frame from the pool.  The frame header lands in the frame's headroom and the color data exactly where
+// it will be drawn from.  Returns an empty pointer, having said why, if it doesn't expand to a packet.
+
+inline LEDBufferPtr ExpandEnvelope(const uint8_t * pEnvelope, DecompressorSet & decompressors, LEDBufferPool & pool)
+{
+    const uint32_t header         = DWORDFromMemory(&pEnvelope[0]);
+    const uint32_t compressedSize = DWORDFromMemory(&pEnvelope[4]);
+    const uint32_t expandedSize   = DWORDFromMemory(&pEnvelope[8]);
+
+    LEDBufferPtr pFrame = pool.Acquire();
+    if (!pFrame)
+    {
+        printf("No free frame buffers in the pool\n");
+        return pFrame;
+    }
+
+    auto wireImage = pFrame->WireImage();
+    if (expandedSize > wireImage.size())
+    {
+        printf("Expanded packet would be %u but frame only holds %zu\n", expandedSize, wireImage.size());
+        return LEDBufferPtr();
+    }
+
+    bool bExpanded;
+    {
+        ScopedLatency timer(Metrics().decompressTime);
+        bExpanded = decompressors.ForTag(header)->Decompress(&pEnvelope[16], compressedSize, wireImage.data(), expandedSize);
+    }
+    if (!bExpanded)
+    {
+        printf("Error decompressing data\n");
+        Metrics().decodeErrors.fetch_add(1, std::memory_order_relaxed);
+        return LEDBufferPtr();
+    }
+
+    const auto frameHeader = WireFrameHeader::FromMemory(wireImage.data());
+    if (WireFrameHeader::kSize + frameHeader.PayloadSize() != expandedSize)
+    {
+        printf("Compressed packet promises %zu bytes of payload but expands to %u bytes\n", frameHeader.PayloadSize(), expandedSize);
+        return LEDBufferPtr();
+    }
+    return pFrame;
+}
+
+// DecodeStage
+//
+// A ring of kDecodeQueueDepth jobs, numbered in the order the socket thread hands them in.  Workers claim
+// the next job with a compare-exchange on a shared counter, expand it with decompressors of their own, and
+// mark it done; the socket thread takes finished jobs back strictly in number order, so frames reach the
+// queue, the delta decoder and the recorder in the order they arrived however the expanding interleaves.
+// A frame that arrives raw while envelopes are still out has to wait its turn, so it goes through the ring
+// too, as a job that's already done once a worker has passed over it.
+//
+// Only the socket thread submits and takes back.  Workers sleep on an atomic wait when there's nothing to
+// claim, and signal an eventfd when they finish a job so the socket thread's epoll loop wakes to collect it.
+// TCP envelopes are read into frames of our own pool; UDP ones are already in a frame when they're whole.
+
+class DecodeStage
+{
+    enum : uint32_t
+    {
+        kSlotFree,
+        kSlotQueued,                                    // An envelope waiting to be expanded
+        kSlotReady,                                     // A frame that needs nothing doing, waiting its turn
+        kSlotDone                                       // Finished, to be taken back
+    };
+
+    struct Slot
+    {
+        std::atomic<uint32_t> state { kSlotFree };
+        LEDBufferPtr          pInput;                   // The envelope, in a frame's wire image
+        LEDBufferPtr          pOutput;                  // The frame, or empty if the envelope didn't expand
+        uint64_t              source = 0;               // Whoever submitted it, handed back with the frame
+    };
+
+    LEDBufferPool &                          _framePool;     // Where expanded frames come from
+    LEDBufferPool                            _envelopes;     // What TCP envelopes are read into
+    std::unique_ptr<Slot[]>                  _slots;
+    alignas(kCacheLineSize) std::atomic<uint64_t> _submitted { 0 };  // Jobs handed in
+    alignas(kCacheLineSize) std::atomic<uint64_t> _claimed   { 0 };  // Jobs a worker has taken
+    std::atomic<uint32_t>                    _wake { 0 };    // Bumped to wake sleeping workers
+    uint64_t                                 _committed = 0; // Jobs taken back; socket thread only
+    int                                      _eventFd;
+    std::atomic<bool>                        _bStopping { false };
+    const ThreadTuning                       _tuning;
+    std::vector<std::thread>                 _workers;
+
+    Slot & SlotFor(uint64_t job)
+    {
+        return _slots[job % kDecodeQueueDepth];
+    }
+
+    void Publish(uint32_t state)
+    {
+        SlotFor(_submitted.load(std::memory_order_relaxed)).state.store(state, std::memory_order_relaxed);
+        _submitted.fetch_add(1, std::memory_order_release);
+        _wake.fetch_add(1, std::memory_order_release);
+        _wake.notify_one();
+    }
+
+    void WorkerLoop()
+    {
+        TuneCurrentThread("decode", _tuning);
+        DecompressorSet decompressors;
+
+        while (true)
+        {
+            const uint32_t wake = _wake.load(std::memory_order_acquire);
+            if (_bStopping.load(std::memory_order_acquire))
+                return;
+
+            uint64_t job = _claimed.load(std::memory_order_acquire);
+            if (job == _submitted.load(std::memory_order_acquire))
+            {
+                _wake.wait(wake, std::memory_order_acquire);
+                continue;
+            }
+            if (!_claimed.compare_exchange_weak(job, job + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                continue;
+
+            Slot & slot = SlotFor(job);
+            if (slot.state.load(std::memory_order_acquire) == kSlotQueued)
+            {
+                slot.pOutput = ExpandEnvelope(slot.pInput->WireImage().data(), decompressors, _framePool);
+                slot.pInput.reset();
+            }
+            slot.state.store(kSlotDone, std::memory_order_release);
+            slot.state.notify_one();
+
+            // A write can only fail if the counter is saturated, which leaves it readable anyway
+
+            const uint64_t one = 1;
+            if (_eventFd >= 0 && write(_eventFd, &one, sizeof(one)) < 0)
+            {
+            }
+        }
+    }
+
+  public:
+
+    DecodeStage(LEDBufferPool & framePool, size_t cThreads, const ThreadTuning & tuning)
+        : _framePool(framePool),
+          _envelopes(kDecodeQueueDepth + kSpareFrameBuffers, framePool.LEDsPerBuffer()),
+          _slots(std::make_unique<Slot[]>(kDecodeQueueDepth)),
+          _eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          _tuning(tuning)
+    {
+        if (_eventFd < 0)
+            perror("Decode stage eventfd");
+
+        cThreads = std::clamp<size_t>(cThreads, 1, kDecodeQueueDepth);
+        for (size_t i = 0; i < cThreads; i++)
+            _workers.emplace_back([this] { WorkerLoop(); });
+        printf("Decoding on %zu worker thread%s\n", cThreads, cThreads == 1 ? "" : "s");
+    }
+
+    ~DecodeStage()
+    {
+        _bStopping.store(true, std::memory_order_release);
+        _wake.fetch_add(1, std::memory_order_release);
+        _wake.notify_all();
+        for (auto & worker : _workers)
+            worker.join();
+        if (_eventFd >= 0)
+            close(_eventFd);
+    }
+
+    DecodeStage(const DecodeStage &) = delete;
+    DecodeStage & operator=(const DecodeStage &) = delete;
+
+    // EventFd
+    //
+    // Readable whenever a worker has finished a job since the last Drain(), or -1 if it couldn't be made
+
+    int EventFd() const
+    {
+        return _eventFd;
+    }
+
+    // AcquireEnvelope
+    //
+    // A frame whose wire image a TCP envelope can be read straight into, or empty if every one is in use
+
+    LEDBufferPtr AcquireEnvelope()
+    {
+        return _envelopes.Acquire();
+    }
+
+    bool HasRoom() const
+    {
+        return _submitted.load(std::memory_order_relaxed) - _committed < kDecodeQueueDepth;
+    }
+
+    bool IsIdle() const
+    {
+        return _submitted.load(std::memory_order_relaxed) == _committed;
+    }
+
+    // Submit
+    //
+    // Hands in a complete envelope held in a frame's wire image.  There must be room.  The source is the
+    // caller's own, to tell it where the frame came from when it's taken back.
+
+    void Submit(LEDBufferPtr pEnvelope, uint64_t source = 0)
+    {
+        Slot & slot = SlotFor(_submitted.load(std::memory_order_relaxed));
+        slot.pInput = std::move(pEnvelope);
+        slot.source = source;
+        Publish(kSlotQueued);
+    }
+
+    // SubmitReady
+    //
+    // Hands in a frame that needs no expanding but mustn't overtake those that do.  There must be room.
+
+    void SubmitReady(LEDBufferPtr pFrame, uint64_t source = 0)
+    {
+        Slot & slot  = SlotFor(_submitted.load(std::memory_order_relaxed));
+        slot.pOutput = std::move(pFrame);
+        slot.source  = source;
+        Publish(kSlotReady);
+    }
+
+    // Drain
+    //
+    // Takes back every finished job at the front of the ring, in order, passing the frames to commit along
+    // with the source they were submitted with.  Jobs that failed to expand are skipped.
+
+    template <typename Commit>
+    void Drain(Commit && commit)
+    {
+        // Clear the eventfd before looking, so a job finished while we're committing wakes us again.  It's
+        // fine for the read to fail, which only means nothing has finished since last time.
+
+        uint64_t cSignals;
+        if (_eventFd >= 0 && read(_eventFd, &cSignals, sizeof(cSignals)) < 0)
+        {
+        }
+
+        while (_committed != _submitted.load(std::memory_order_relaxed))
+        {
+            Slot & slot = SlotFor(_committed);
+            if (slot.state.load(std::memory_order_acquire) != kSlotDone)
+                break;
+
+            LEDBufferPtr   pFrame = std::move(slot.pOutput);
+            const uint64_t source = slot.source;
+            slot.state.store(kSlotFree, std::memory_order_relaxed);
+            _committed++;
+            if (pFrame)
+                commit(std::move(pFrame), source);
+        }
+    }
+
+    // WaitForOldest
+    //
+    // Sleeps until the job at the front of the ring is finished, for when it's full
+
+    void WaitForOldest()
+    {
+        if (IsIdle())
+            return;
+
+        Slot & slot = SlotFor(_committed);
+        for (uint32_t state = slot.state.load(std::memory_order_acquire); state != kSlotDone; state = slot.state.load(std::memory_order_acquire))
+            slot.state.wait(state, std::memory_order_acquire);
+    }
+};
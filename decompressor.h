@@ -0,0 +1,340 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Decompressor.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Decompressors for the compressed frame envelopes the master can send.
+//    Each keeps its context alive across frames so nothing is allocated per
+//    frame.  zlib is always available; libdeflate, LZ4 and zstd are compiled
+//    in when the Makefile is asked for them (WITH_LIBDEFLATE=1 and so on).
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <cstdint>
+#include <memory>
+#include <zlib.h>
+
+#ifdef NDPI_WITH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#ifdef NDPI_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef NDPI_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// The 16 byte compressed envelope starts with one of these tags, read as a little-endian DWORD, followed by the
+// compressed size, the expanded size and a reserved DWORD.  "DAVE" is the original zlib envelope.
+
+#define COMPRESSED_HEADER_TAG       (0x44415645)                                    // ascii "DAVE" - zlib
+#define COMPRESSED_HEADER_TAG_LZ4   (0x444C5A34)                                    // ascii "DLZ4" - LZ4 block
+#define COMPRESSED_HEADER_TAG_ZSTD  (0x445A5354)                                    // ascii "DZST" - zstd frame
+
+// Codec
+//
+// Bit flags, so the set we support can be advertised back to the master in a single DWORD
+
+enum Codec : uint32_t
+{
+    CODEC_ZLIB = 0x01,
+    CODEC_LZ4  = 0x02,
+    CODEC_ZSTD = 0x04
+};
+
+// Decompressor
+//
+// Expands one compressed payload into exactly cOutput bytes at pOutput
+
+class Decompressor
+{
+  public:
+    virtual ~Decompressor() = default;
+    virtual bool Decompress(const uint8_t * pInput, size_t cInput, uint8_t * pOutput, size_t cOutput) = 0;
+};
+
+#ifdef NDPI_WITH_LIBDEFLATE
+
+// ZlibDecompressor (libdeflate)
+//
+// libdeflate is a one-shot decoder that's considerably faster than zlib's inflate, and since we always
+// have the whole payload and know its expanded size, one-shot is all we need
+
+class ZlibDecompressor : public Decompressor
+{
+    libdeflate_decompressor * _pDecompressor;
+
+  public:
+    ZlibDecompressor() : _pDecompressor(libdeflate_alloc_decompressor())
+    {
+    }
+
+    ~ZlibDecompressor() override
+    {
+        if (_pDecompressor)
+            libdeflate_free_decompressor(_pDecompressor);
+    }
+
+    bool Decompress(const uint8_t * pInput, size_t cInput, uint8_t * pOutput, size_t cOutput) override
+    {
+        if (!_pDecompressor)
+        {
+            printf("ERROR: libdeflate decompressor could not be allocated\n");
+            return false;
+        }
+
+        size_t cActual = 0;
+        auto result = libdeflate_zlib_decompress(_pDecompressor, pInput, cInput, pOutput, cOutput, &cActual);
+        if (result != LIBDEFLATE_SUCCESS)
+        {
+            printf("libdeflate error %d during decompression (possibly corrupted data)\n", result);
+            return false;
+        }
+        if (cActual != cOutput)
+        {
+            printf("Expected %zu bytes, but decompressed to %zu bytes instead\n", cOutput, cActual);
+            return false;
+        }
+        return true;
+    }
+};
+
+#else
+
+// ZlibDecompressor
+//
+// Initializes zlib once and uses inflateReset between frames, so the 32K window is allocated only once
+
+class ZlibDecompressor : public Decompressor
+{
+    z_stream _stream;
+    bool     _bInitialized;
+
+  public:
+    ZlibDecompressor() : _bInitialized(false)
+    {
+        memset(&_stream, 0, sizeof(_stream));
+
+        // Use -MAX_WBITS for raw deflate; for zlib/gzip header use different options
+        int ret = inflateInit2(&_stream, MAX_WBITS);
+        if (ret != Z_OK)
+            printf("ERROR: zlib inflateInit2 failed with code %d\n", ret);
+        else
+            _bInitialized = true;
+    }
+
+    ~ZlibDecompressor() override
+    {
+        if (_bInitialized)
+            inflateEnd(&_stream);
+    }
+
+    bool Decompress(const uint8_t * pInput, size_t cInput, uint8_t * pOutput, size_t cOutput) override
+    {
+        if (!_bInitialized || inflateReset(&_stream) != Z_OK)
+        {
+            printf("ERROR: zlib stream not available\n");
+            return false;
+        }
+
+        _stream.next_in   = const_cast<Bytef*>(pInput);   // Input buffer
+        _stream.avail_in  = cInput;                       // Input buffer size
+        _stream.next_out  = pOutput;                      // Output buffer
+        _stream.avail_out = cOutput;                      // Output buffer size
+
+        // We have all the input and room for all the output, so this should finish in one call
+
+        int ret = inflate(&_stream, Z_FINISH);
+        switch (ret)
+        {
+            case Z_STREAM_END:
+                break;
+
+            case Z_DATA_ERROR:
+                printf("Data error during decompression (possibly corrupted data)\n");
+                return false;
+
+            case Z_MEM_ERROR:
+                printf("Memory error during decompression\n");
+                return false;
+
+            case Z_BUF_ERROR:
+                printf("Buffer error during decompression. Compressed data ended early or expands past %zu bytes.\n", cOutput);
+                return false;
+
+            default:
+                printf("Stream error %d during decompression\n", ret);
+                return false;
+        }
+
+        // Ensure the decompressed size matches the expected size
+        if (_stream.total_out != cOutput)
+        {
+            printf("Expected %zu bytes, but decompressed to %lu bytes instead\n", cOutput, _stream.total_out);
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
+
+#ifdef NDPI_WITH_LZ4
+
+// LZ4Decompressor
+//
+// Raw LZ4 block format; stateless, so there's nothing to keep between frames
+
+class LZ4Decompressor : public Decompressor
+{
+  public:
+    bool Decompress(const uint8_t * pInput, size_t cInput, uint8_t * pOutput, size_t cOutput) override
+    {
+        int cActual = LZ4_decompress_safe(reinterpret_cast<const char *>(pInput), reinterpret_cast<char *>(pOutput), cInput, cOutput);
+        if (cActual < 0)
+        {
+            printf("LZ4 error %d during decompression (possibly corrupted data)\n", cActual);
+            return false;
+        }
+        if ((size_t)cActual != cOutput)
+        {
+            printf("Expected %zu bytes, but decompressed to %d bytes instead\n", cOutput, cActual);
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
+
+#ifdef NDPI_WITH_ZSTD
+
+// ZstdDecompressor
+//
+// Keeps one decompression context for the life of the connection
+
+class ZstdDecompressor : public Decompressor
+{
+    ZSTD_DCtx * _pContext;
+
+  public:
+    ZstdDecompressor() : _pContext(ZSTD_createDCtx())
+    {
+    }
+
+    ~ZstdDecompressor() override
+    {
+        if (_pContext)
+            ZSTD_freeDCtx(_pContext);
+    }
+
+    bool Decompress(const uint8_t * pInput, size_t cInput, uint8_t * pOutput, size_t cOutput) override
+    {
+        if (!_pContext)
+        {
+            printf("ERROR: zstd context could not be allocated\n");
+            return false;
+        }
+
+        size_t cActual = ZSTD_decompressDCtx(_pContext, pOutput, cOutput, pInput, cInput);
+        if (ZSTD_isError(cActual))
+        {
+            printf("zstd error during decompression: %s\n", ZSTD_getErrorName(cActual));
+            return false;
+        }
+        if (cActual != cOutput)
+        {
+            printf("Expected %zu bytes, but decompressed to %zu bytes instead\n", cOutput, cActual);
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
+
+// DecompressorSet
+//
+// One of each decompressor we were built with, picked by envelope tag
+
+class DecompressorSet
+{
+    ZlibDecompressor                  _zlib;
+#ifdef NDPI_WITH_LZ4
+    LZ4Decompressor                   _lz4;
+#endif
+#ifdef NDPI_WITH_ZSTD
+    ZstdDecompressor                  _zstd;
+#endif
+
+  public:
+
+    // SupportedCodecs
+    //
+    // The CODEC_xxx flags for everything compiled in
+
+    static constexpr uint32_t SupportedCodecs()
+    {
+        uint32_t codecs = CODEC_ZLIB;
+#ifdef NDPI_WITH_LZ4
+        codecs |= CODEC_LZ4;
+#endif
+#ifdef NDPI_WITH_ZSTD
+        codecs |= CODEC_ZSTD;
+#endif
+        return codecs;
+    }
+
+    static constexpr bool IsCompressedTag(uint32_t tag)
+    {
+        return tag == COMPRESSED_HEADER_TAG || tag == COMPRESSED_HEADER_TAG_LZ4 || tag == COMPRESSED_HEADER_TAG_ZSTD;
+    }
+
+    // ForTag
+    //
+    // The decompressor for an envelope tag, or nullptr if that codec isn't built in
+
+    Decompressor * ForTag(uint32_t tag)
+    {
+        switch (tag)
+        {
+            case COMPRESSED_HEADER_TAG:
+                return &_zlib;
+#ifdef NDPI_WITH_LZ4
+            case COMPRESSED_HEADER_TAG_LZ4:
+                return &_lz4;
+#endif
+#ifdef NDPI_WITH_ZSTD
+            case COMPRESSED_HEADER_TAG_ZSTD:
+                return &_zstd;
+#endif
+            default:
+                return nullptr;
+        }
+    }
+};
@@ -0,0 +1,223 @@
+//+--------------------------------------------------------------------------
+//
+// File:        DeltaDecoder.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Applies WIFI_COMMAND_PIXELDELTA64 packets, which carry only the pixel
+//    runs that changed since the previous frame, and works out what changed
+//    in ordinary full frames so the drawing side can skip the rest.
+//
+//    A delta packet is the usual 24 byte header with length32 giving the
+//    number of bytes that follow, then:
+//
+//        uint64_t baseSeconds, baseMicros    Timestamp of the frame it applies to
+//        repeated:
+//          uint32_t offset                   First pixel of the run
+//          uint32_t count                    Pixels in the run
+//          CRGB     pixels[count]
+//
+//    Every full PIXELDATA64 frame is a keyframe.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "globals.h"
+#include "ledbuffer.h"
+
+// DeltaDecoder
+//
+// Keeps its own copy of the last frame queued, since by the time a delta arrives the consumer may already
+// have drawn and recycled the real one.  Producer side only.
+//
+// A delta names the timestamp of the frame it was made against.  If that isn't the frame we hold - the
+// keyframe was lost, a UDP packet went missing, or we've only just started - it's dropped and we ask for
+// a keyframe rather than showing garbage until the next one happens to arrive.
+
+class DeltaDecoder
+{
+    static constexpr size_t kBaseSize = 16;                 // baseSeconds and baseMicros
+    static constexpr size_t kRunSize  = 8;                  // offset and count
+
+    std::vector<CRGB> _reference;                           // The last frame we queued
+    size_t            _cReference;                          // Pixels in it
+    uint64_t          _referenceSeconds;
+    uint64_t          _referenceMicros;
+    bool              _bHaveReference;                      // At least one frame has been queued
+    bool              _bValid;                              // Deltas may be applied to the reference
+    bool              _bKeyframeNeeded;
+
+  public:
+
+    explicit DeltaDecoder(size_t cMaxLeds)
+        : _reference(cMaxLeds),
+          _cReference(0),
+          _referenceSeconds(0),
+          _referenceMicros(0),
+          _bHaveReference(false),
+          _bValid(false),
+          _bKeyframeNeeded(false)
+    {
+    }
+
+    // KeyframeNeeded
+    //
+    // True from the moment a delta had to be dropped until the next full frame arrives
+
+    bool KeyframeNeeded() const
+    {
+        return _bKeyframeNeeded;
+    }
+
+    // Invalidate
+    //
+    // Stops deltas from applying until the next keyframe.  The reference still matches the last frame
+    // queued, so keyframes go on getting narrowed dirty ranges.
+
+    void Invalidate()
+    {
+        _bValid = false;
+    }
+
+    // OnKeyframe
+    //
+    // Called with a full frame that's about to be queued.  Takes it as the new reference, and while copying
+    // it, narrows the frame's dirty range down to the pixels that actually differ from the one before.
+
+    void OnKeyframe(LEDBuffer & frame)
+    {
+        auto         pixels = frame.ColorData();
+        const size_t cLeds  = std::min(pixels.size(), _reference.size());
+
+        if (_bHaveReference && cLeds == _cReference)
+        {
+            size_t first = 0;
+            while (first < cLeds && pixels[first] == _reference[first])
+                first++;
+            size_t end = cLeds;
+            while (end > first && pixels[end - 1] == _reference[end - 1])
+                end--;
+
+            frame.SetDirtyRange(first, end);
+            std::copy(pixels.begin() + first, pixels.begin() + end, _reference.begin() + first);
+        }
+        else
+        {
+            frame.SetAllDirty();
+            std::copy(pixels.begin(), pixels.begin() + cLeds, _reference.begin());
+        }
+
+        _cReference       = cLeds;
+        _referenceSeconds = frame.Seconds();
+        _referenceMicros  = frame.MicroSeconds();
+        _bHaveReference   = true;
+        _bValid           = true;
+        _bKeyframeNeeded  = false;
+    }
+
+    // ApplyDelta
+    //
+    // Applies a delta's runs to the reference and writes the result into frame, sized and timestamped from
+    // the header.  The runs are applied to the reference before anything is written to the frame, so pBody
+    // may point into the frame's own storage, as it does when the packet was read or expanded in place.
+    // Returns false if the delta was dropped.
+
+    bool ApplyDelta(const WireFrameHeader & header, const uint8_t * pBody, LEDBuffer & frame)
+    {
+        const size_t cbBody = header.length32;
+        if (cbBody < kBaseSize)
+        {
+            printf("Delta packet too small to name its base frame\n");
+            return false;
+        }
+
+        const uint64_t baseSeconds = ULONGFromMemory(&pBody[0]);
+        const uint64_t baseMicros  = ULONGFromMemory(&pBody[8]);
+        if (!_bValid || baseSeconds != _referenceSeconds || baseMicros != _referenceMicros)
+        {
+            if (!_bKeyframeNeeded)
+                printf("Delta doesn't match the last frame we have, waiting for a keyframe\n");
+            _bValid          = false;
+            _bKeyframeNeeded = true;
+            return false;
+        }
+
+        // Check every run before touching the reference, so a malformed packet can't leave it half updated
+
+        size_t first = _cReference;
+        size_t end   = 0;
+        for (size_t offset = kBaseSize; offset < cbBody; )
+        {
+            if (cbBody - offset < kRunSize)
+                return RejectMalformed();
+
+            const uint32_t iStart = DWORDFromMemory(&pBody[offset]);
+            const uint32_t count  = DWORDFromMemory(&pBody[offset + 4]);
+            offset += kRunSize;
+
+            if ((size_t)iStart + count > _cReference || (size_t)count * sizeof(CRGB) > cbBody - offset)
+                return RejectMalformed();
+
+            first   = std::min<size_t>(first, iStart);
+            end     = std::max<size_t>(end, (size_t)iStart + count);
+            offset += (size_t)count * sizeof(CRGB);
+        }
+
+        for (size_t offset = kBaseSize; offset < cbBody; )
+        {
+            const uint32_t iStart = DWORDFromMemory(&pBody[offset]);
+            const uint32_t count  = DWORDFromMemory(&pBody[offset + 4]);
+            offset += kRunSize;
+            memcpy(&_reference[iStart], &pBody[offset], count * sizeof(CRGB));
+            offset += (size_t)count * sizeof(CRGB);
+        }
+
+        frame.SetSize(_cReference);
+        frame.SetTimestamp(header.seconds, header.micros);
+        std::copy(_reference.begin(), _reference.begin() + _cReference, frame.ColorData().begin());
+        if (first < end)
+            frame.SetDirtyRange(first, end);
+        else
+            frame.SetDirtyRange(0, 0);
+
+        _referenceSeconds = header.seconds;
+        _referenceMicros  = header.micros;
+        return true;
+    }
+
+  private:
+
+    bool RejectMalformed()
+    {
+        printf("Malformed run in delta packet\n");
+        _bValid          = false;
+        _bKeyframeNeeded = true;
+        return false;
+    }
+};
@@ -0,0 +1,138 @@
+//+--------------------------------------------------------------------------
+//
+// File:        DirtyTracker.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Works out how much of a canvas has to be redrawn to bring it up to
+//    date, from the dirty ranges of the frames drawn since it was last used.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <unordered_map>
+#include <algorithm>
+
+#include "globals.h"
+#include "ledbuffer.h"
+
+// DirtyTracker
+//
+// Each frame knows which of its pixels differ from the frame queued just before it.  With VSync there are
+// several canvases in rotation, so the one we're handed may be a few frames behind; we keep the dirty
+// ranges of the last kDirtyHistoryDepth frames and redraw the union of everything since the canvas last
+// drew.  Anything we can't vouch for - a canvas we've never drawn, a frame the queue dropped, a change of
+// frame size - means a full redraw.  Draw thread only.
+
+class DirtyTracker
+{
+    struct Range
+    {
+        size_t first;
+        size_t end;
+    };
+
+    std::array<Range, kDirtyHistoryDepth>       _history;           // Indexed by frame number
+    uint64_t                                    _cFrames;           // Frames noted so far
+    uint64_t                                    _lastSerial;
+    size_t                                      _lastSize;
+    std::unordered_map<const void *, uint64_t>  _canvasFrame;       // Frame number each canvas currently shows
+
+  public:
+
+    DirtyTracker() : _cFrames(0), _lastSerial(0), _lastSize(SIZE_MAX)
+    {
+    }
+
+    // NoteFrame
+    //
+    // Must be called for every frame taken off the queue, in order, whether it's drawn or skipped
+
+    void NoteFrame(const LEDBuffer & frame)
+    {
+        const size_t cLeds       = frame.ColorData().size();
+        const bool   bContinuous = frame.Serial() != 0 && frame.Serial() == _lastSerial + 1 && cLeds == _lastSize;
+
+        _history[++_cFrames % kDirtyHistoryDepth] = bContinuous ? Range { frame.DirtyFirst(), frame.DirtyEnd() }
+                                                                : Range { 0, SIZE_MAX };
+        _lastSerial = frame.Serial();
+        _lastSize   = cLeds;
+    }
+
+    // NoteRegion
+    //
+    // For frames made here rather than taken off the queue, such as interpolated ones, where the caller
+    // works out what changed since the last frame noted.  The next queued frame is then redrawn in full.
+
+    void NoteRegion(size_t first, size_t end)
+    {
+        _history[++_cFrames % kDirtyHistoryDepth] = Range { first, end };
+        _lastSerial = 0;
+        _lastSize   = SIZE_MAX;
+    }
+
+    // RegionFor
+    //
+    // The frame pixels [first, end) that must be drawn onto this canvas to bring it up to the last frame
+    // noted.  Assumes the caller then draws them, so the canvas is recorded as current.
+
+    void RegionFor(const void * pCanvas, size_t & first, size_t & end)
+    {
+        uint64_t & held = _canvasFrame[pCanvas];
+
+        if (held == 0 || _cFrames - held >= kDirtyHistoryDepth)
+        {
+            first = 0;
+            end   = SIZE_MAX;
+        }
+        else
+        {
+            first = SIZE_MAX;
+            end   = 0;
+            for (uint64_t i = held + 1; i <= _cFrames; i++)
+            {
+                const Range & range = _history[i % kDirtyHistoryDepth];
+                if (range.first < range.end)
+                {
+                    first = std::min(first, range.first);
+                    end   = std::max(end, range.end);
+                }
+            }
+            if (first > end)
+                first = end = 0;
+        }
+        held = _cFrames;
+    }
+
+    // Reset
+    //
+    // Forgets what every canvas holds, for when something other than the frame data changes what is drawn
+
+    void Reset()
+    {
+        _canvasFrame.clear();
+    }
+};
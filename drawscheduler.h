@@ -0,0 +1,178 @@
+//+--------------------------------------------------------------------------
+//
+// File:        DrawScheduler.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Puts the draw thread to sleep until the next frame is due, using a
+//    timerfd armed for the exact due time and the FrameSignal the producer
+//    pokes when something sooner shows up.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <cstdint>
+#include <algorithm>
+#include <span>
+
+#include "globals.h"
+#include "apptime.h"
+#include "ledbuffer.h"
+
+// DrawScheduler
+//
+// The timer runs on CLOCK_MONOTONIC, so the due time is converted from server time with the current offset.
+// It's set kDrawWakeEarlyMicros ahead, and the last stretch is spun out, since a timer wakeup on the Pi
+// lands tens of microseconds late and varies from one to the next.  Even with nothing to wait for, the
+// poll times out every kDrawPollIntervalMs so ctrl-c is noticed and a stepped clock is picked up.
+
+class DrawScheduler
+{
+    int _timerFd;
+
+    // SpinUntil
+    //
+    // Busy-waits out the last few microseconds, giving up after twice the early margin in case the clock
+    // offset moved underneath us
+
+    static void SpinUntil(int64_t dueNanos)
+    {
+        const int64_t limit = CAppTime::MonotonicNanos() + 2 * kDrawWakeEarlyMicros * NANOS_PER_MICRO;
+        while (CAppTime::ServerNanos() < dueNanos && CAppTime::MonotonicNanos() < limit)
+            ;
+    }
+
+    void SetTimer(int64_t monotonicNanos)
+    {
+        itimerspec spec = {};
+        spec.it_value.tv_sec  = monotonicNanos / NANOS_PER_SECOND;
+        spec.it_value.tv_nsec = monotonicNanos % NANOS_PER_SECOND;
+        timerfd_settime(_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+  public:
+
+    DrawScheduler() : _timerFd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC))
+    {
+        if (_timerFd < 0)
+            perror("timerfd_create");
+    }
+
+    ~DrawScheduler()
+    {
+        if (_timerFd >= 0)
+            close(_timerFd);
+    }
+
+    DrawScheduler(const DrawScheduler &) = delete;
+    DrawScheduler & operator=(const DrawScheduler &) = delete;
+
+    // WaitSource
+    //
+    // A queue to wait on, and how long after its timestamp a frame from it counts as due
+
+    struct WaitSource
+    {
+        LEDBufferManager * pManager;
+        int64_t            delayNanos;
+    };
+
+    // WaitForFrame
+    //
+    // Sleeps until the oldest frame in any of the queues is due, an earlier one is queued on any of them,
+    // wakeByNanos comes around, or the poll interval runs out, whichever is first.  Both times are server
+    // time.  The caller should look at the queues again afterwards either way.
+
+    void WaitForFrame(std::span<const WaitSource> sources, int64_t wakeByNanos = INT64_MAX)
+    {
+        const size_t cSources = std::min<size_t>(sources.size(), kMaxChannels);
+        auto disarm = [&sources](size_t cArmed)
+        {
+            for (size_t i = 0; i < cArmed; i++)
+                sources[i].pManager->Signal().Disarm();
+        };
+
+        pollfd  fds[kMaxChannels + 1] = { { _timerFd, POLLIN, 0 } };
+        int64_t target = wakeByNanos;
+        for (size_t i = 0; i < cSources; i++)
+        {
+            LEDBufferManager & bufferManager = *sources[i].pManager;
+            FrameSignal &      signal        = bufferManager.Signal();
+
+            const auto due = bufferManager.OldestDueNanos();
+            signal.Arm(due.value_or(INT64_MAX));
+            if (bufferManager.OldestDueNanos() != due)
+            {
+                disarm(i + 1);
+                return;
+            }
+            if (due)
+                target = std::min(target, *due + sources[i].delayNanos);
+            fds[i + 1] = { signal.Fd(), POLLIN, 0 };
+        }
+
+        if (target != INT64_MAX)
+        {
+            const int64_t wake = target - CAppTime::ServerOffsetNanos() - kDrawWakeEarlyMicros * NANOS_PER_MICRO;
+            if (wake <= CAppTime::MonotonicNanos())
+            {
+                disarm(cSources);
+                SpinUntil(target);
+                return;
+            }
+            SetTimer(wake);
+        }
+        else
+        {
+            SetTimer(0);                                    // Disarms the timer
+        }
+
+        int cReady = poll(fds, cSources + 1, kDrawPollIntervalMs);
+        disarm(cSources);
+
+        if (cReady > 0 && (fds[0].revents & POLLIN))
+        {
+            bool bSignalled = false;
+            for (size_t i = 1; i <= cSources; i++)
+                bSignalled = bSignalled || (fds[i].revents & POLLIN);
+
+            uint64_t expirations;
+            if (read(_timerFd, &expirations, sizeof(expirations)) > 0 && !bSignalled)
+                SpinUntil(target);
+        }
+    }
+
+    // WaitForFrame
+    //
+    // The same for a single queue, whose frames are due delayNanos after their timestamps
+
+    void WaitForFrame(LEDBufferManager & bufferManager, int64_t delayNanos = 0, int64_t wakeByNanos = INT64_MAX)
+    {
+        const WaitSource source { &bufferManager, delayNanos };
+        WaitForFrame(std::span<const WaitSource>(&source, 1), wakeByNanos);
+    }
+};
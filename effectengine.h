@@ -0,0 +1,182 @@
+//+--------------------------------------------------------------------------
+//
+// File:        EffectEngine.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Runs a local effect on its own thread whenever the stream has run dry,
+//    queueing its frames exactly as if they'd come from the master.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <algorithm>
+
+#include "globals.h"
+#include "apptime.h"
+#include "metrics.h"
+#include "ledbuffer.h"
+#include "effects.h"
+
+extern volatile bool interrupt_received;
+
+// EffectEngine
+//
+// Takes over once no frame has arrived for kEffectTakeoverMs and everything queued has been shown, and hands
+// back the moment another frame comes in.  Frames are drawn on a grid of the effect's own frame interval,
+// kEffectLeadMs ahead of when they're due, and stamped in server time so the draw loop paces them like any
+// others.  A frame that runs over its interval is counted, and the grid skips ahead past the slots it ate
+// rather than queueing a burst of frames that are already late.
+
+class EffectEngine
+{
+    std::unique_ptr<LEDEffect> _pEffect;
+    const size_t               _width;                  // Size of frame to draw, which fills the matrix
+    const size_t               _height;
+
+    // SleepUntil
+    //
+    // Sleeps until a monotonic time, but never longer than kEffectPollIntervalMs so ctrl-c is noticed
+
+    static void SleepUntil(int64_t monotonicNanos)
+    {
+        CAppTime::SleepUntil(std::min<int64_t>(monotonicNanos, CAppTime::MonotonicNanos() + kEffectPollIntervalMs * NANOS_PER_SECOND / 1000));
+    }
+
+    // StreamHasRunDry
+    //
+    // Whether the stream has gone quiet and left nothing still to be shown
+
+    static bool StreamHasRunDry(const LEDBufferManager & bufferManager)
+    {
+        if (bufferManager.NanosSinceStreamFrame() < kEffectTakeoverMs * NANOS_PER_SECOND / 1000)
+            return false;
+
+        const LEDBufferSnapshot snapshot = bufferManager.Snapshot();
+        return snapshot.size == 0 || snapshot.newestAge <= 0;
+    }
+
+    static bool StreamHasReturned(const LEDBufferManager & bufferManager)
+    {
+        return bufferManager.NanosSinceStreamFrame() < kEffectTakeoverMs * NANOS_PER_SECOND / 1000;
+    }
+
+    // DrawFrame
+    //
+    // Draws one frame due at the given monotonic time and queues it.  Returns false if the pool had no
+    // buffer to spare, which only happens when the draw loop has fallen far behind.
+
+    bool DrawFrame(LEDBufferManager & bufferManager, int64_t dueNanos)
+    {
+        LEDBufferPtr pBuffer = bufferManager.Pool().Acquire();
+        if (!pBuffer)
+            return false;
+
+        PeakData peaks;
+        if (!bufferManager.Peaks().Read(peaks) || CAppTime::MonotonicNanos() - peaks.receivedNanos > kPeakStaleMs * NANOS_PER_SECOND / 1000)
+            peaks.cBands = 0;
+
+        pBuffer->SetSize(_width * _height);
+        {
+            ScopedLatency timer(Metrics().effectDrawTime);
+            _pEffect->Draw(pBuffer->ColorData(), _width, _height, dueNanos, peaks);
+        }
+
+        const int64_t serverNanos = dueNanos + CAppTime::ServerOffsetNanos();
+        pBuffer->SetTimestamp(serverNanos / NANOS_PER_SECOND, (serverNanos % NANOS_PER_SECOND) / NANOS_PER_MICRO);
+        bufferManager.PushNewBuffer(std::move(pBuffer), false);
+        Metrics().effectFrames.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+  public:
+
+    // The effect must be one CreateEffect knows, which the options have already checked
+
+    EffectEngine(const char * effectName, size_t width, size_t height)
+        : _pEffect(CreateEffect(effectName)),
+          _width(width),
+          _height(height)
+    {
+    }
+
+    // RunLoop
+    //
+    // Waits for the stream to run dry, then plays the effect until it comes back, until we're interrupted
+
+    void RunLoop(LEDBufferManager & bufferManager)
+    {
+        if (!_pEffect || _width * _height == 0 || _width * _height > bufferManager.Pool().LEDsPerBuffer())
+        {
+            fprintf(stderr, "Effect can't be drawn at %zux%zu, so it won't be shown\n", _width, _height);
+            return;
+        }
+
+        const int64_t interval = NANOS_PER_SECOND / std::max(1, _pEffect->FramesPerSecond());
+        const int64_t lead     = kEffectLeadMs * NANOS_PER_SECOND / 1000;
+
+        while (!interrupt_received)
+        {
+            if (!StreamHasRunDry(bufferManager))
+            {
+                SleepUntil(INT64_MAX);                  // Which is to say, for one poll interval
+                continue;
+            }
+
+            printf("Stream has run dry, showing the %s effect\n", _pEffect->Name());
+            _pEffect->Start(_width, _height);
+
+            int64_t due = CAppTime::MonotonicNanos() + lead;
+            while (!interrupt_received && !StreamHasReturned(bufferManager))
+            {
+                const int64_t start = CAppTime::MonotonicNanos();
+                if (!DrawFrame(bufferManager, due))
+                    Metrics().effectFramesSkipped.fetch_add(1, std::memory_order_relaxed);
+
+                due += interval;
+
+                // Over budget: skip to the next slot that can still be drawn in time
+
+                const int64_t now = CAppTime::MonotonicNanos();
+                if (now - start > interval)
+                    Metrics().effectOverruns.fetch_add(1, std::memory_order_relaxed);
+                if (due < now + lead)
+                {
+                    const int64_t behind = (now + lead - due + interval - 1) / interval;
+                    Metrics().effectFramesSkipped.fetch_add(behind, std::memory_order_relaxed);
+                    due += behind * interval;
+                }
+
+                while (!interrupt_received && CAppTime::MonotonicNanos() < due - lead)
+                    SleepUntil(due - lead);
+            }
+
+            if (!interrupt_received)
+                printf("Stream is back, %s effect stopped\n", _pEffect->Name());
+        }
+    }
+};
@@ -0,0 +1,206 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Effects.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Effects we can draw on our own, in the manner of NightDriverStrip's,
+//    for when there is no stream to show.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <memory>
+#include <span>
+#include <vector>
+#include <algorithm>
+
+#include "globals.h"
+#include "apptime.h"
+#include "pixeltypes.h"
+#include "pixelops.h"
+#include "peakdata.h"
+
+// LEDEffect
+//
+// An effect draws whole frames, row after row at the width it was started with, into whatever buffer it's
+// handed; the buffer holds an old frame, so every pixel has to be written.  Each effect says how often it
+// wants to draw, and its frame budget is that interval: a frame that takes longer costs the frames after
+// it.  Effects are only ever touched by the effect engine's thread.
+
+class LEDEffect
+{
+  public:
+
+    virtual ~LEDEffect() = default;
+
+    virtual const char * Name() const = 0;
+    virtual int FramesPerSecond() const = 0;
+
+    // Start
+    //
+    // Called each time the effect takes over from the stream, before the first Draw
+
+    virtual void Start(size_t width, size_t height)
+    {
+    }
+
+    // Draw
+    //
+    // One frame, for the monotonic time it will be shown.  peaks has no bands if none are fresh.
+
+    virtual void Draw(std::span<CRGB> leds, size_t width, size_t height, int64_t frameNanos, const PeakData & peaks) = 0;
+};
+
+// RainbowEffect
+//
+// A rainbow scrolling sideways across the matrix, once around the color wheel every four seconds
+
+class RainbowEffect : public LEDEffect
+{
+  public:
+
+    const char * Name() const override { return "rainbow"; }
+    int FramesPerSecond() const override { return 60; }
+
+    void Draw(std::span<CRGB> leds, size_t width, size_t height, int64_t frameNanos, const PeakData & peaks) override
+    {
+        const uint8_t start = (uint8_t)(frameNanos / (NANOS_PER_SECOND / 64));        // Hue steps per second
+        const uint8_t step  = (uint8_t)std::max<size_t>(1, 256 / std::max<size_t>(width, 1));
+
+        // Every row is the same, so work out the first and copy it down
+
+        for (size_t x = 0; x < width && x < leds.size(); x++)
+            leds[x] = CHSV((uint8_t)(start + x * step), 255, 255);
+        for (size_t i = width; i < leds.size(); i++)
+            leds[i] = leds[i % width];
+    }
+};
+
+// TwinkleEffect
+//
+// Pixels light up in random colors and fade away.  The fading is done on our own copy of the frame,
+// since the buffers we draw into are never the same one twice in a row.
+
+class TwinkleEffect : public LEDEffect
+{
+    std::vector<CRGB> _state;
+    uint32_t          _random = 0x9E3779B9;
+
+    // Random
+    //
+    // xorshift32, which is plenty random enough to sparkle with
+
+    uint32_t Random()
+    {
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+        return _random;
+    }
+
+  public:
+
+    const char * Name() const override { return "twinkle"; }
+    int FramesPerSecond() const override { return 30; }
+
+    void Start(size_t width, size_t height) override
+    {
+        _state.assign(width * height, CRGB(0, 0, 0));
+    }
+
+    void Draw(std::span<CRGB> leds, size_t width, size_t height, int64_t frameNanos, const PeakData & peaks) override
+    {
+        if (_state.size() != leds.size())
+            _state.assign(leds.size(), CRGB(0, 0, 0));
+
+        PixelOps::FadeAll(_state, 24);
+
+        const size_t cNew = std::max<size_t>(1, _state.size() / 200);
+        for (size_t i = 0; i < cNew && !_state.empty(); i++)
+            _state[Random() % _state.size()] = CHSV((uint8_t)Random(), 200, 255);
+
+        std::copy(_state.begin(), _state.end(), leds.begin());
+    }
+};
+
+// SpectrumEffect
+//
+// The audio peaks as a bar for each band, rising from the bottom of the matrix in a hue of its own.  Bars
+// fall back slowly rather than dropping straight to the next level, and settle to nothing without peaks.
+
+class SpectrumEffect : public LEDEffect
+{
+    std::array<float, kMaxPeakBands> _levels = {};
+
+  public:
+
+    const char * Name() const override { return "spectrum"; }
+    int FramesPerSecond() const override { return 60; }
+
+    void Start(size_t width, size_t height) override
+    {
+        _levels.fill(0.0f);
+    }
+
+    void Draw(std::span<CRGB> leds, size_t width, size_t height, int64_t frameNanos, const PeakData & peaks) override
+    {
+        const size_t cBands = peaks.cBands ? std::min<size_t>(peaks.cBands, kMaxPeakBands) : kMaxPeakBands;
+        for (size_t band = 0; band < cBands; band++)
+        {
+            const float peak = band < peaks.cBands ? std::clamp(peaks.peaks[band], 0.0f, 1.0f) : 0.0f;
+            _levels[band] = std::max(peak, _levels[band] * 0.9f);
+        }
+
+        std::fill(leds.begin(), leds.end(), CRGB(0, 0, 0));
+        for (size_t x = 0; x < width; x++)
+        {
+            const size_t band = x * cBands / width;
+            const size_t bar  = (size_t)(_levels[band] * height + 0.5f);
+            const CRGB   color(CHSV((uint8_t)(band * 256 / cBands), 255, 255));
+
+            for (size_t y = height - std::min(bar, height); y < height; y++)
+                if (y * width + x < leds.size())
+                    leds[y * width + x] = color;
+        }
+    }
+};
+
+// CreateEffect
+//
+// The effect of the given name, or nullptr if there's no such effect
+
+inline std::unique_ptr<LEDEffect> CreateEffect(const char * name)
+{
+    if (0 == strcmp(name, "rainbow"))
+        return std::make_unique<RainbowEffect>();
+    if (0 == strcmp(name, "twinkle"))
+        return std::make_unique<TwinkleEffect>();
+    if (0 == strcmp(name, "spectrum"))
+        return std::make_unique<SpectrumEffect>();
+    return nullptr;
+}
@@ -0,0 +1,179 @@
+//+--------------------------------------------------------------------------
+//
+// File:        FlowControl.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Sizes the frame queue to the memory the Pi has to spare, and works
+//    out what to ask of the master so the queue holds the lead time we
+//    want: send faster, send slower, or send less.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "globals.h"
+#include "pixeltypes.h"
+#include "ledbuffer.h"
+
+// AvailableMemory
+//
+// Bytes the kernel says could be handed out without swapping, which counts reclaimable cache, or just the free
+// pages on a kernel too old to report that
+
+inline uint64_t AvailableMemory()
+{
+    if (FILE * pFile = fopen("/proc/meminfo", "r"))
+    {
+        char line[128];
+        unsigned long long kb = 0;
+        while (fgets(line, sizeof(line), pFile))
+            if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1)
+                break;
+        fclose(pFile);
+        if (kb)
+            return kb * 1024;
+    }
+    return (uint64_t)sysconf(_SC_AVPHYS_PAGES) * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+// QueueDepthForMemory
+//
+// How many frames of the given size the queue may hold, so that its preallocated pool takes no more than
+// kQueueMemoryPercent of the available memory.  A 512x32 matrix gets the full kMaxBuffers on a Pi 4, and a
+// Pi Zero 2 with 100 MB to spare gets about 200.  A compact format fits several times as many into the same
+// budget, less the handful of full frames it still needs.  With several channels, each queue of cLeds gets
+// an even share of the budget.
+
+inline size_t QueueDepthForMemory(size_t cLeds, QueueFormat format = QueueFormat::Rgb24, size_t cChannels = 1)
+{
+    const uint64_t cbFrame  = cLeds * sizeof(CRGB) + WireFrameHeader::kSize;
+    const uint64_t cbBudget = AvailableMemory() * kQueueMemoryPercent / 100 / std::max<size_t>(cChannels, 1);
+
+    if (format != QueueFormat::Rgb24)
+    {
+        const uint64_t cbFull   = (kSpareFrameBuffers + kExpandedFrameBuffers) * cbFrame;
+        const uint64_t cbPacked = LEDBufferManager::ArenaSize(format, 1, cLeds);
+        return (size_t)std::clamp<uint64_t>(cbBudget > cbFull ? (cbBudget - cbFull) / cbPacked : 0, kMinBuffers, kMaxBuffers);
+    }
+
+    const uint64_t cFrames  = cbBudget / cbFrame;
+    return (size_t)std::clamp<uint64_t>(cFrames > kSpareFrameBuffers ? cFrames - kSpareFrameBuffers : 0, kMinBuffers, kMaxBuffers);
+}
+
+// FlowHint
+//
+// What the master is asked to do, carried in each extended response
+
+enum class FlowHint : uint32_t
+{
+    Steady      = 0,                                // The lead is about right
+    Faster      = 1,                                // Get further ahead; the queue is running short
+    Slower      = 2,                                // Fall back; we're holding more than we need
+    DropQuality = 3                                 // Send fewer or smaller frames; we can't hold the lead otherwise
+};
+
+inline const char * FlowHintName(FlowHint hint)
+{
+    switch (hint)
+    {
+        case FlowHint::Steady:      return "steady";
+        case FlowHint::Faster:      return "faster";
+        case FlowHint::Slower:      return "slower";
+        case FlowHint::DropQuality: return "drop-quality";
+    }
+    return "unknown";
+}
+
+// FlowController
+//
+// Steers the master toward a target lead, the time between a frame arriving and its being due, as seen by
+// the newest frame in the queue.  The lead is smoothed, and a hint to go faster or slower is only given once
+// it strays more than kFlowLeadTolerance from the target and is kept until it gets back, so the master isn't
+// told to reverse on every frame.  When the queue is nearly full, or overflowing, before the lead is reached,
+// no send rate will do, so the master is asked to drop quality instead: fewer frames or cheaper ones.
+// Socket thread only.
+
+class FlowController
+{
+    const double _targetLead;                       // Seconds
+    double       _lead;                             // Smoothed, in seconds
+    bool         _bPrimed;
+    FlowHint     _hint;
+    uint64_t     _lastOverwritten;
+
+  public:
+
+    FlowController(int targetLeadMs)
+        : _targetLead(targetLeadMs / 1000.0),
+          _lead(0),
+          _bPrimed(false),
+          _hint(FlowHint::Steady),
+          _lastOverwritten(0)
+    {
+    }
+
+    constexpr int TargetLeadMs() const { return (int)(_targetLead * 1000 + 0.5); }
+    double   Lead() const              { return _lead; }
+    FlowHint Hint() const              { return _hint; }
+
+    // Update
+    //
+    // Takes the queue as it stands after a frame arrives, how many frames it can hold, and the running count
+    // of frames that same queue has dropped to make room, and returns the hint for the response
+
+    FlowHint Update(const LEDBufferSnapshot & snapshot, size_t capacity, uint64_t framesOverwritten)
+    {
+        const double lead = snapshot.size ? snapshot.newestAge : 0.0;      // An empty queue has no lead at all
+        if (!_bPrimed)
+        {
+            _lead            = lead;
+            _lastOverwritten = framesOverwritten;
+            _bPrimed         = true;
+        }
+        _lead += kFlowLeadSmoothing * (lead - _lead);
+
+        const bool bOverflowing = framesOverwritten != _lastOverwritten;
+        _lastOverwritten = framesOverwritten;
+
+        const bool bNearlyFull = snapshot.size * 100 >= capacity * kFlowHighWaterPercent;
+        const double low       = _targetLead * (1.0 - kFlowLeadTolerance);
+        const double high      = _targetLead * (1.0 + kFlowLeadTolerance);
+
+        if (bNearlyFull || bOverflowing)
+            _hint = _lead < _targetLead ? FlowHint::DropQuality : FlowHint::Slower;
+        else if (_lead < low || (_hint == FlowHint::Faster && _lead < _targetLead))
+            _hint = FlowHint::Faster;
+        else if (_lead > high || (_hint == FlowHint::Slower && _lead > _targetLead))
+            _hint = FlowHint::Slower;
+        else
+            _hint = FlowHint::Steady;
+        return _hint;
+    }
+};
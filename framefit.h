@@ -0,0 +1,321 @@
+//+--------------------------------------------------------------------------
+//
+// File:        FrameFit.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Fits frames whose size doesn't match the matrix onto it, by centering,
+//    letterboxing or stretching them.  The resampling is worked out once
+//    per frame size and reused for every frame of that size.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <span>
+#include <algorithm>
+
+#include "pixeltypes.h"
+#include "pixelmap.h"
+#include "layout.h"
+
+// FitMode
+//
+// None lays the frame's pixels out row after row at the matrix width, as we always have, and drops any
+// that don't fit.  Center shows the frame at its own size in the middle of the matrix, cropping whatever
+// overhangs.  Letterbox scales it as large as it will go without changing its shape, and Stretch scales
+// each axis to fill the matrix.
+
+enum class FitMode
+{
+    None,
+    Center,
+    Letterbox,
+    Stretch
+};
+
+// ResampleFilter
+//
+// How a scaled frame is sampled.  Nearest is folded into the pixel map and costs nothing extra; Bilinear
+// needs a pass of its own to blend four source pixels into each matrix pixel.
+
+enum class ResampleFilter
+{
+    Nearest,
+    Bilinear
+};
+
+inline const char * FitModeName(FitMode mode)
+{
+    switch (mode)
+    {
+        case FitMode::None:      return "none";
+        case FitMode::Center:    return "center";
+        case FitMode::Letterbox: return "letterbox";
+        case FitMode::Stretch:   return "stretch";
+    }
+    return "unknown";
+}
+
+inline const char * ResampleFilterName(ResampleFilter filter)
+{
+    switch (filter)
+    {
+        case ResampleFilter::Nearest:  return "nearest";
+        case ResampleFilter::Bilinear: return "bilinear";
+    }
+    return "unknown";
+}
+
+// FrameFitter
+//
+// Frames don't say how wide they are, so the width comes from the command line or, failing that, is taken
+// to be the matrix width, and the height follows from the pixel count.  Whenever the frame size changes,
+// the fit is redone: a table from each logical matrix pixel to the frame pixel it shows, composed with the
+// layout so the blitter still does one lookup per pixel, plus for bilinear scaling the four taps and
+// weights of each pixel.  Draw thread only.
+
+class FrameFitter
+{
+    // Tap
+    //
+    // The four frame pixels around a sample point, top left, top right, bottom left and bottom right, and
+    // how far toward the right and bottom the point lies, in 256ths
+
+    struct Tap
+    {
+        uint32_t index[4];
+        uint16_t fx;
+        uint16_t fy;
+    };
+
+    const Layout &        _layout;                      // Matrix pixel to logical pixel
+    const FitMode         _mode;
+    const ResampleFilter  _filter;
+    const size_t          _frameWidth;                  // 0 to use the matrix width
+    size_t                _cSource;                     // Frame size the fit was made for
+    PixelMap              _map;                         // Matrix pixel to frame pixel, or to resampled pixel
+    std::vector<Tap>      _taps;                        // Bilinear taps of each logical pixel, if resampling
+    std::vector<CRGB>     _resampled;                   // The frame resampled to the logical size
+
+    // Placement
+    //
+    // Where the frame lands on the logical matrix: the size it's scaled to and its top left corner, which
+    // can be negative when a centered frame is larger than the matrix
+
+    struct Placement
+    {
+        int64_t width;
+        int64_t height;
+        int64_t left;
+        int64_t top;
+    };
+
+    Placement Place(size_t sourceWidth, size_t sourceHeight) const
+    {
+        const int64_t W = _layout.Width(), H = _layout.Height();
+        const int64_t w = sourceWidth,     h = sourceHeight;
+        int64_t       width = w, height = h;
+
+        if (_mode == FitMode::Stretch)
+        {
+            width  = W;
+            height = H;
+        }
+        else if (_mode == FitMode::Letterbox)
+        {
+            if (W * h <= H * w)                             // Width limits us
+            {
+                width  = W;
+                height = std::max<int64_t>(1, (h * W + w / 2) / w);
+            }
+            else
+            {
+                height = H;
+                width  = std::max<int64_t>(1, (w * H + h / 2) / h);
+            }
+        }
+
+        return Placement { width, height, (W - width) / 2, (H - height) / 2 };
+    }
+
+    // Refit
+    //
+    // Works out the tables for a frame of cSource pixels
+
+    void Refit(size_t cSource)
+    {
+        const size_t W = _layout.Width(), H = _layout.Height();
+        const size_t w = std::max<size_t>(1, _frameWidth ? _frameWidth : W);
+        const size_t h = std::max<size_t>(1, (cSource + w - 1) / w);
+
+        _cSource = cSource;
+        _taps.clear();
+        _resampled.clear();
+
+        std::vector<uint32_t> fit(W * H, PixelMap::kNoSource);
+
+        if (_mode == FitMode::None)
+        {
+            for (size_t i = 0; i < fit.size(); i++)
+                fit[i] = i;
+            _map = _layout.Map().Compose(fit);
+            return;
+        }
+
+        const Placement place = Place(w, h);
+        const bool      bBilinear = _filter == ResampleFilter::Bilinear && (place.width != (int64_t)w || place.height != (int64_t)h);
+
+        if (bBilinear)
+            _taps.resize(W * H, Tap { { PixelMap::kNoSource, PixelMap::kNoSource, PixelMap::kNoSource, PixelMap::kNoSource }, 0, 0 });
+
+        for (size_t Y = 0; Y < H; Y++)
+        {
+            const int64_t dy = (int64_t)Y - place.top;
+            if (dy < 0 || dy >= place.height)
+                continue;
+
+            for (size_t X = 0; X < W; X++)
+            {
+                const int64_t dx = (int64_t)X - place.left;
+                if (dx < 0 || dx >= place.width)
+                    continue;
+
+                if (!bBilinear)
+                {
+                    // Sample at the center of each matrix pixel
+
+                    const size_t sx = (2 * dx + 1) * w / (2 * place.width);
+                    const size_t sy = (2 * dy + 1) * h / (2 * place.height);
+                    fit[Y * W + X] = sy * w + sx;
+                    continue;
+                }
+
+                // The center of the matrix pixel in frame coordinates, in 256ths of a pixel, held inside
+                // the frame so the edge pixels don't blend with black
+
+                const int64_t u  = std::clamp<int64_t>(((2 * dx + 1) * (int64_t)w * 256 / (2 * place.width)) - 128, 0, (w - 1) * 256);
+                const int64_t v  = std::clamp<int64_t>(((2 * dy + 1) * (int64_t)h * 256 / (2 * place.height)) - 128, 0, (h - 1) * 256);
+                const size_t  x0 = u >> 8, y0 = v >> 8;
+                const size_t  x1 = std::min(x0 + 1, w - 1), y1 = std::min(y0 + 1, h - 1);
+
+                _taps[Y * W + X] = Tap { { (uint32_t)(y0 * w + x0), (uint32_t)(y0 * w + x1), (uint32_t)(y1 * w + x0), (uint32_t)(y1 * w + x1) },
+                                         (uint16_t)(u & 0xFF), (uint16_t)(v & 0xFF) };
+            }
+        }
+
+        if (bBilinear)
+        {
+            _resampled.resize(W * H);
+            for (size_t i = 0; i < fit.size(); i++)
+                fit[i] = i;
+        }
+        _map = _layout.Map().Compose(fit);
+    }
+
+  public:
+
+    // The layout must outlive us
+
+    FrameFitter(const Layout & layout, FitMode mode, ResampleFilter filter, size_t frameWidth)
+        : _layout(layout),
+          _mode(mode),
+          _filter(filter),
+          _frameWidth(frameWidth),
+          _cSource(SIZE_MAX),
+          _map(layout.Map())
+    {
+    }
+
+    // Prepare
+    //
+    // Readies the tables for a frame of cSource pixels, which is free unless the size has changed
+
+    void Prepare(size_t cSource)
+    {
+        if (cSource != _cSource)
+            Refit(cSource);
+    }
+
+    // IsResampling
+    //
+    // True if frames of the current size have to go through Resample before being drawn with Map()
+
+    bool IsResampling() const
+    {
+        return !_taps.empty();
+    }
+
+    const PixelMap & Map() const
+    {
+        return _map;
+    }
+
+    // FrameWidth, FrameHeight
+    //
+    // The size of frame that fills the matrix as exactly as this fit allows, for anything drawing its own
+
+    size_t FrameWidth() const
+    {
+        return _mode != FitMode::None && _frameWidth ? _frameWidth : _layout.Width();
+    }
+
+    size_t FrameHeight() const
+    {
+        if (_mode == FitMode::None || !_frameWidth)
+            return _layout.Height();
+        return std::max<size_t>(1, _layout.Height() * _frameWidth / std::max<size_t>(1, _layout.Width()));
+    }
+
+    // Resample
+    //
+    // Blends the frame into the logical matrix size through the bilinear taps.  Pixels outside the
+    // scaled frame stay black.
+
+    std::span<const CRGB> Resample(std::span<const CRGB> source)
+    {
+        const uint8_t * p = reinterpret_cast<const uint8_t *>(source.data());
+        uint8_t *       d = reinterpret_cast<uint8_t *>(_resampled.data());
+
+        for (size_t i = 0; i < _taps.size(); i++, d += 3)
+        {
+            const Tap & tap = _taps[i];
+            if (tap.index[3] >= source.size())
+            {
+                d[0] = d[1] = d[2] = 0;
+                continue;
+            }
+
+            const uint32_t fx = tap.fx, fy = tap.fy;
+            for (int c = 0; c < 3; c++)
+            {
+                const uint32_t top    = p[tap.index[0] * 3 + c] * (256 - fx) + p[tap.index[1] * 3 + c] * fx;
+                const uint32_t bottom = p[tap.index[2] * 3 + c] * (256 - fx) + p[tap.index[3] * 3 + c] * fx;
+                d[c] = (uint8_t)((top * (256 - fy) + bottom * fy + 32768) >> 16);
+            }
+        }
+        return _resampled;
+    }
+};
@@ -0,0 +1,134 @@
+//+--------------------------------------------------------------------------
+//
+// File:        FramePacer.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Applies the presentation policy to each frame the draw loop takes off
+//    the queue, deciding whether it gets shown or dropped, and counts both.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <algorithm>
+
+#include "globals.h"
+#include "apptime.h"
+#include "options.h"
+#include "metrics.h"
+
+// FramePacer
+//
+// After a hiccup the queue can be holding hundreds of frames that are all overdue.  Every policy handles
+// that differently, but none of them ever drops the newest due frame, so even if every frame arrives late
+// (a server whose clock is behind ours, say) something is always shown.
+//
+// RateSmoothing doesn't rush.  When it falls behind it deliberately runs that far behind the timestamps,
+// a playout delay, and then wins back kSmoothingCatchUpPercent of each frame interval until it's back on
+// time, so motion stays fluid while the backlog drains.  The delay is capped at the maximum lateness,
+// beyond which frames are dropped as with BoundedLateness.
+//
+// Draw thread only.  What it shows and drops is counted in the pipeline metrics.
+
+class FramePacer
+{
+    const PresentationPolicy _policy;
+    const int64_t            _maxLatenessNanos;
+    int64_t                  _playoutDelayNanos;            // How far behind timestamps we're running
+    std::optional<int64_t>   _lastDue;                      // Timestamp of the last frame seen
+
+    // Smooth
+    //
+    // Updates the playout delay for a frame due at due that we reached at now
+
+    void Smooth(int64_t due, int64_t now)
+    {
+        const int64_t late = now - due;
+        if (late > _playoutDelayNanos)
+            _playoutDelayNanos = std::min(late, _maxLatenessNanos);
+
+        if (_lastDue)
+        {
+            const int64_t interval = std::clamp<int64_t>(due - *_lastDue, 0, NANOS_PER_SECOND);
+            _playoutDelayNanos = std::max<int64_t>(0, _playoutDelayNanos - interval * kSmoothingCatchUpPercent / 100);
+        }
+    }
+
+  public:
+
+    FramePacer(PresentationPolicy policy, int maxLatenessMs)
+        : _policy(policy),
+          _maxLatenessNanos((int64_t)maxLatenessMs * NANOS_PER_SECOND / 1000),
+          _playoutDelayNanos(0)
+    {
+    }
+
+    PresentationPolicy Policy() const
+    {
+        return _policy;
+    }
+
+    // PlayoutDelay
+    //
+    // The draw loop treats each frame as due this long after its timestamp
+
+    int64_t PlayoutDelay() const
+    {
+        return _playoutDelayNanos;
+    }
+
+    // ShouldPresent
+    //
+    // Decides about a frame just taken off the queue.  due is its timestamp and now the current time, both
+    // in server nanos, and bNextDue says whether the frame behind it is due already as well.
+
+    bool ShouldPresent(int64_t due, int64_t now, bool bNextDue)
+    {
+        bool bPresent = true;
+        switch (_policy)
+        {
+            case PresentationPolicy::DrawAll:
+                break;
+
+            case PresentationPolicy::SkipToLatest:
+                bPresent = !bNextDue;
+                break;
+
+            case PresentationPolicy::BoundedLateness:
+                bPresent = !bNextDue || now - due <= _maxLatenessNanos;
+                break;
+
+            case PresentationPolicy::RateSmoothing:
+                bPresent = !bNextDue || now - due <= _maxLatenessNanos;
+                Smooth(due, now);
+                break;
+        }
+
+        _lastDue = due;
+        (bPresent ? Metrics().framesPresented : Metrics().framesDropped).fetch_add(1, std::memory_order_relaxed);
+        return bPresent;
+    }
+};
@@ -0,0 +1,484 @@
+//+--------------------------------------------------------------------------
+//
+// File:        FramePacker.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Compact forms for frames while they wait in the queue: RGB565, an
+//    indexed palette, or deflated.  Frames are packed into a byte arena as
+//    they're queued and expanded again shortly before they're due.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <zlib.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <span>
+#include <vector>
+
+#include "globals.h"
+#include "pixeltypes.h"
+#include "decompressor.h"
+
+// QueueFormat
+//
+// How queued frames are held.  Rgb24 keeps them as they arrived, in the pool; the others pack them into the
+// manager's arena.  Rgb565 is the only lossy one.
+
+enum class QueueFormat
+{
+    Rgb24,
+    Rgb565,
+    Palette,
+    Zlib
+};
+
+inline const char * QueueFormatName(QueueFormat format)
+{
+    switch (format)
+    {
+        case QueueFormat::Rgb24:   return "rgb24";
+        case QueueFormat::Rgb565:  return "rgb565";
+        case QueueFormat::Palette: return "palette";
+        case QueueFormat::Zlib:    return "zlib";
+    }
+    return "unknown";
+}
+
+// PackedEncoding
+//
+// What a packed frame actually holds, in the first byte of its 8 byte prefix, with the pixel count in the
+// DWORD after it.  Palette and Zlib frames that don't pack well are stored as Raw24 instead.
+
+enum class PackedEncoding : uint8_t
+{
+    Raw24   = 0,                                    // cLeds * 3 bytes of CRGB
+    Rgb565  = 1,                                    // cLeds native-endian uint16_t
+    Palette = 2,                                    // DWORD color count, that many CRGB, then a byte per pixel
+    Deflate = 3                                     // DWORD compressed size, then a zlib stream of the CRGB bytes
+};
+
+constexpr size_t kPackedPrefixSize = 8;
+
+// PackedFrameEstimate
+//
+// Bytes a frame of cLeds pixels is expected to take in the arena, for sizing it.  Rgb565 is exact; a palette
+// frame of more than 256 colors or a deflated one that compresses worse than kQueueDeflateRatio takes more,
+// and the arena then holds fewer of them.
+
+constexpr size_t PackedFrameEstimate(QueueFormat format, size_t cLeds)
+{
+    switch (format)
+    {
+        case QueueFormat::Rgb565:  return kPackedPrefixSize + cLeds * sizeof(uint16_t);
+        case QueueFormat::Palette: return kPackedPrefixSize + 4 + 256 * sizeof(CRGB) + cLeds;
+        case QueueFormat::Zlib:    return kPackedPrefixSize + 4 + cLeds * sizeof(CRGB) / kQueueDeflateRatio;
+        default:                   return cLeds * sizeof(CRGB);
+    }
+}
+
+// FrameArena
+//
+// A ring of bytes that packed frames are carved from in the order they're queued, so that they also come due
+// and are freed in roughly that order.  Each record starts with a small header holding its size and a flag
+// that's set when it's freed; the producer walks the oldest end forward over freed records the next time it
+// allocates.  A record that would run off the end is placed back at the start instead, with the leftover
+// bytes at the end marked as an already-free pad.
+//
+// Allocation is producer only, under the manager's producer mutex.  Free() may be called from any thread.
+
+class FrameArena
+{
+    struct Record
+    {
+        std::atomic<uint32_t> bFree;
+        uint32_t              cbRecord;             // Bytes including this header, a multiple of 8
+    };
+
+    static_assert(sizeof(Record) == 8);
+
+    const size_t                _cbArena;
+    std::unique_ptr<uint64_t[]> _storage;           // uint64_t keeps every record 8 byte aligned
+    size_t                      _head   = 0;        // Offset where the next record goes
+    size_t                      _tail   = 0;        // Offset of the oldest record still held
+    size_t                      _cbUsed = 0;        // Bytes from tail to head, pads included
+
+    Record * At(size_t offset) const
+    {
+        return reinterpret_cast<Record *>(reinterpret_cast<uint8_t *>(_storage.get()) + offset);
+    }
+
+    uint8_t * Place(size_t cbRecord)
+    {
+        Record * pRecord = new (At(_head)) Record;
+        pRecord->bFree.store(0, std::memory_order_relaxed);
+        pRecord->cbRecord = (uint32_t)cbRecord;
+
+        _head   = (_head + cbRecord) % _cbArena;
+        _cbUsed += cbRecord;
+        return reinterpret_cast<uint8_t *>(pRecord + 1);
+    }
+
+    // Reclaim
+    //
+    // Moves the oldest end past every record that's been freed
+
+    void Reclaim()
+    {
+        while (_cbUsed > 0)
+        {
+            const Record * pRecord = At(_tail);
+            if (!pRecord->bFree.load(std::memory_order_acquire))
+                break;
+            _tail   = (_tail + pRecord->cbRecord) % _cbArena;
+            _cbUsed -= pRecord->cbRecord;
+        }
+        if (_cbUsed == 0)
+            _head = _tail = 0;
+    }
+
+  public:
+
+    explicit FrameArena(size_t cbArena)
+        : _cbArena((cbArena + 7) & ~(size_t)7),
+          _storage(std::make_unique<uint64_t[]>(_cbArena / sizeof(uint64_t)))
+    {
+    }
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena & operator=(const FrameArena &) = delete;
+
+    constexpr size_t Size() const { return _cbArena; }
+
+    // Allocate
+    //
+    // Room for cbData bytes, or nullptr if the arena hasn't that much free in one piece right now
+
+    uint8_t * Allocate(size_t cbData)
+    {
+        Reclaim();
+
+        const size_t cbRecord = (sizeof(Record) + cbData + 7) & ~(size_t)7;
+        if (cbRecord > _cbArena || _cbUsed == _cbArena)
+            return nullptr;
+
+        if (_head < _tail)
+            return _tail - _head >= cbRecord ? Place(cbRecord) : nullptr;
+
+        if (_cbArena - _head >= cbRecord)
+            return Place(cbRecord);
+
+        // Wrap to the start, if the oldest record leaves room there, padding out the end
+
+        if (cbRecord > _tail)
+            return nullptr;
+        Free(Place(_cbArena - _head));
+        return Place(cbRecord);
+    }
+
+    // OldestData
+    //
+    // The data of the oldest record still held, or nullptr if there's none.  Producer only.
+
+    const uint8_t * OldestData() const
+    {
+        return _cbUsed ? reinterpret_cast<const uint8_t *>(At(_tail) + 1) : nullptr;
+    }
+
+    // Free
+    //
+    // Gives back a record returned by Allocate.  Its bytes are reused once every record older than it is freed too.
+
+    static void Free(uint8_t * pData)
+    {
+        reinterpret_cast<Record *>(pData)[-1].bFree.store(1, std::memory_order_release);
+    }
+};
+
+// FramePacker
+//
+// Packs frames into one of the compact formats.  Everything is built up in a scratch buffer sized for the
+// largest frame at startup, so the caller can find room for the exact size in the arena before copying it
+// in, and packing never allocates.  Palette frames find their colors through a small open-addressed table
+// that's stamped with a generation count rather than cleared for each frame.  Producer only.
+
+class FramePacker
+{
+    static constexpr size_t kPaletteSlots = 1024;   // Four times the colors a palette can hold, to keep probes short
+    static constexpr size_t kMaxColors    = 256;
+
+    const QueueFormat           _format;
+    std::vector<uint8_t>        _scratch;
+    z_stream                    _deflate;
+    bool                        _bDeflate = false;
+    std::unique_ptr<uint32_t[]> _aSlotColor;        // Color in the low 24 bits
+    std::unique_ptr<uint32_t[]> _aSlotGeneration;   // The frame that last wrote each slot
+    std::unique_ptr<uint8_t[]>  _aSlotIndex;        // Palette index of each slot's color
+    uint32_t                    _generation = 0;
+
+    static void PutDWORD(uint8_t * p, uint32_t value)
+    {
+        memcpy(p, &value, sizeof(value));
+    }
+
+    std::span<const uint8_t> Prefix(PackedEncoding encoding, size_t cLeds, size_t cbBody)
+    {
+        _scratch[0] = (uint8_t)encoding;
+        _scratch[1] = _scratch[2] = _scratch[3] = 0;
+        PutDWORD(&_scratch[4], (uint32_t)cLeds);
+        return std::span<const uint8_t>(_scratch.data(), kPackedPrefixSize + cbBody);
+    }
+
+    std::span<const uint8_t> PackRaw(std::span<const CRGB> pixels)
+    {
+        memcpy(&_scratch[kPackedPrefixSize], pixels.data(), pixels.size_bytes());
+        return Prefix(PackedEncoding::Raw24, pixels.size(), pixels.size_bytes());
+    }
+
+    std::span<const uint8_t> PackRgb565(std::span<const CRGB> pixels)
+    {
+        uint16_t * pOut = reinterpret_cast<uint16_t *>(&_scratch[kPackedPrefixSize]);
+        for (const CRGB & pixel : pixels)
+            *pOut++ = (uint16_t)((pixel.r & 0xF8) << 8 | (pixel.g & 0xFC) << 3 | pixel.b >> 3);
+        return Prefix(PackedEncoding::Rgb565, pixels.size(), pixels.size() * sizeof(uint16_t));
+    }
+
+    // PackPalette
+    //
+    // The indices go first, straight after where the palette will end up were it full, and the palette is
+    // then moved down against them once we know how many colors there are
+
+    std::span<const uint8_t> PackPalette(std::span<const CRGB> pixels)
+    {
+        if (++_generation == 0)
+        {
+            std::fill_n(_aSlotGeneration.get(), kPaletteSlots, 0);
+            _generation = 1;
+        }
+
+        CRGB      palette[kMaxColors];
+        size_t    cColors  = 0;
+        uint8_t * pIndices = &_scratch[kPackedPrefixSize + 4 + kMaxColors * sizeof(CRGB)];
+
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            const CRGB &   pixel = pixels[i];
+            const uint32_t color = (uint32_t)pixel.r << 16 | (uint32_t)pixel.g << 8 | pixel.b;
+            size_t         slot  = (color * 2654435761u) >> 22;          // Top 10 bits of a Fibonacci hash
+
+            while (_aSlotGeneration[slot] == _generation && _aSlotColor[slot] != color)
+                slot = (slot + 1) % kPaletteSlots;
+
+            if (_aSlotGeneration[slot] != _generation)
+            {
+                if (cColors == kMaxColors)
+                    return PackRaw(pixels);
+                _aSlotGeneration[slot] = _generation;
+                _aSlotColor[slot]      = color;
+                _aSlotIndex[slot]      = (uint8_t)cColors;
+                palette[cColors++]     = pixel;
+            }
+            pIndices[i] = _aSlotIndex[slot];
+        }
+
+        PutDWORD(&_scratch[kPackedPrefixSize], (uint32_t)cColors);
+        const size_t cbPalette = cColors * sizeof(CRGB);
+        memmove(&_scratch[kPackedPrefixSize + 4 + cbPalette], pIndices, pixels.size());
+        memcpy(&_scratch[kPackedPrefixSize + 4], palette, cbPalette);
+        return Prefix(PackedEncoding::Palette, pixels.size(), 4 + cbPalette + pixels.size());
+    }
+
+    std::span<const uint8_t> PackDeflate(std::span<const CRGB> pixels)
+    {
+        if (!_bDeflate || deflateReset(&_deflate) != Z_OK)
+            return PackRaw(pixels);
+
+        const size_t cbRoom = pixels.size_bytes();              // No use to us if it doesn't shrink
+        _deflate.next_in   = const_cast<Bytef *>(reinterpret_cast<const Bytef *>(pixels.data()));
+        _deflate.avail_in  = pixels.size_bytes();
+        _deflate.next_out  = &_scratch[kPackedPrefixSize + 4];
+        _deflate.avail_out = cbRoom;
+
+        if (deflate(&_deflate, Z_FINISH) != Z_STREAM_END)
+            return PackRaw(pixels);
+
+        const size_t cbCompressed = cbRoom - _deflate.avail_out;
+        PutDWORD(&_scratch[kPackedPrefixSize], (uint32_t)cbCompressed);
+        return Prefix(PackedEncoding::Deflate, pixels.size(), 4 + cbCompressed);
+    }
+
+  public:
+
+    // MaxPackedSize
+    //
+    // The most a frame of up to cMaxLeds pixels can pack to, in any format
+
+    static constexpr size_t MaxPackedSize(size_t cMaxLeds)
+    {
+        return kPackedPrefixSize + 4 + kMaxColors * sizeof(CRGB) + cMaxLeds * sizeof(CRGB);
+    }
+
+    FramePacker(QueueFormat format, size_t cMaxLeds)
+        : _format(format),
+          _scratch(MaxPackedSize(cMaxLeds))
+    {
+        if (format == QueueFormat::Palette)
+        {
+            _aSlotColor      = std::make_unique<uint32_t[]>(kPaletteSlots);
+            _aSlotGeneration = std::make_unique<uint32_t[]>(kPaletteSlots);
+            _aSlotIndex      = std::make_unique<uint8_t[]>(kPaletteSlots);
+        }
+        if (format == QueueFormat::Zlib)
+        {
+            memset(&_deflate, 0, sizeof(_deflate));
+            const int ret = deflateInit(&_deflate, kQueueDeflateLevel);
+            if (ret != Z_OK)
+                printf("ERROR: zlib deflateInit failed with code %d, so queued frames will be kept raw\n", ret);
+            else
+                _bDeflate = true;
+        }
+    }
+
+    ~FramePacker()
+    {
+        if (_bDeflate)
+            deflateEnd(&_deflate);
+    }
+
+    FramePacker(const FramePacker &) = delete;
+    FramePacker & operator=(const FramePacker &) = delete;
+
+    // Pack
+    //
+    // The packed form of a frame, valid until the next call
+
+    std::span<const uint8_t> Pack(std::span<const CRGB> pixels)
+    {
+        switch (_format)
+        {
+            case QueueFormat::Rgb565:  return PackRgb565(pixels);
+            case QueueFormat::Palette: return PackPalette(pixels);
+            case QueueFormat::Zlib:    return PackDeflate(pixels);
+            default:                   return PackRaw(pixels);
+        }
+    }
+};
+
+// FrameUnpacker
+//
+// Expands what FramePacker packed.  Consumer only, as the inflate state is reused from frame to frame.
+
+class FrameUnpacker
+{
+    ZlibDecompressor _inflate;
+
+    static uint32_t GetDWORD(const uint8_t * p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+  public:
+
+    // PixelCount
+    //
+    // How many pixels a packed frame expands to
+
+    static size_t PixelCount(std::span<const uint8_t> packed)
+    {
+        return packed.size() >= kPackedPrefixSize ? GetDWORD(&packed[4]) : 0;
+    }
+
+    // Unpack
+    //
+    // Expands a packed frame into exactly PixelCount(packed) pixels, returning false if it's malformed
+
+    bool Unpack(std::span<const uint8_t> packed, std::span<CRGB> pixels)
+    {
+        if (packed.size() < kPackedPrefixSize || PixelCount(packed) != pixels.size())
+            return false;
+
+        const uint8_t * pBody  = &packed[kPackedPrefixSize];
+        const size_t    cbBody = packed.size() - kPackedPrefixSize;
+
+        switch ((PackedEncoding)packed[0])
+        {
+            case PackedEncoding::Raw24:
+                if (cbBody < pixels.size_bytes())
+                    return false;
+                memcpy(pixels.data(), pBody, pixels.size_bytes());
+                return true;
+
+            case PackedEncoding::Rgb565:
+            {
+                if (cbBody < pixels.size() * sizeof(uint16_t))
+                    return false;
+
+                // Copy the top bits down into the bottom ones, so full scale comes back as 255 rather than 248
+
+                const uint16_t * pIn = reinterpret_cast<const uint16_t *>(pBody);
+                for (CRGB & pixel : pixels)
+                {
+                    const uint16_t value = *pIn++;
+                    const uint8_t  r = value >> 11, g = (value >> 5) & 0x3F, b = value & 0x1F;
+                    pixel = CRGB((uint8_t)(r << 3 | r >> 2), (uint8_t)(g << 2 | g >> 4), (uint8_t)(b << 3 | b >> 2));
+                }
+                return true;
+            }
+
+            case PackedEncoding::Palette:
+            {
+                if (cbBody < 4)
+                    return false;
+                const size_t cColors = GetDWORD(pBody);
+                if (cColors > 256 || cbBody < 4 + cColors * sizeof(CRGB) + pixels.size())
+                    return false;
+
+                const CRGB *    pPalette = reinterpret_cast<const CRGB *>(pBody + 4);
+                const uint8_t * pIndices = pBody + 4 + cColors * sizeof(CRGB);
+                for (size_t i = 0; i < pixels.size(); i++)
+                {
+                    if (pIndices[i] >= cColors)
+                        return false;
+                    pixels[i] = pPalette[pIndices[i]];
+                }
+                return true;
+            }
+
+            case PackedEncoding::Deflate:
+            {
+                if (cbBody < 4 || cbBody - 4 < GetDWORD(pBody))
+                    return false;
+                return _inflate.Decompress(pBody + 4, GetDWORD(pBody), reinterpret_cast<uint8_t *>(pixels.data()), pixels.size_bytes());
+            }
+        }
+        return false;
+    }
+};
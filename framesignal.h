@@ -0,0 +1,122 @@
+//+--------------------------------------------------------------------------
+//
+// File:        FrameSignal.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Lets the producer wake a sleeping consumer when a frame arrives that's
+//    due sooner than whatever the consumer is waiting for.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <atomic>
+
+#include "globals.h"
+
+// FrameSignal
+//
+// An eventfd plus the due time the consumer has armed its timer for.  The producer only makes the syscall
+// when the frame it just queued would otherwise be shown late, so in steady state, with frames arriving in
+// order ahead of their due times, nothing is signaled at all.
+//
+// Both sides follow their store with a full fence before looking at the other side's state: the consumer
+// arms and then rechecks the queue, the producer queues and then checks what's armed.  Either the consumer
+// sees the new frame or the producer sees the armed time, so a wakeup can't be lost.
+
+class FrameSignal
+{
+    static constexpr int64_t kAwake = INT64_MIN;            // Consumer isn't waiting, so never signal
+
+    int                                           _eventFd;
+    alignas(kCacheLineSize) std::atomic<int64_t>  _armedDue;  // Due time the consumer is waiting for
+
+  public:
+
+    FrameSignal()
+        : _eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          _armedDue(kAwake)
+    {
+        if (_eventFd < 0)
+            perror("eventfd");
+    }
+
+    ~FrameSignal()
+    {
+        if (_eventFd >= 0)
+            close(_eventFd);
+    }
+
+    FrameSignal(const FrameSignal &) = delete;
+    FrameSignal & operator=(const FrameSignal &) = delete;
+
+    int Fd() const
+    {
+        return _eventFd;
+    }
+
+    // FrameQueued
+    //
+    // Producer side, called after a frame due at dueNanos has been published
+
+    void FrameQueued(int64_t dueNanos)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (dueNanos < _armedDue.load(std::memory_order_relaxed))
+        {
+            const uint64_t one = 1;
+            if (write(_eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+                perror("eventfd write");
+        }
+    }
+
+    // Arm
+    //
+    // Consumer side, before it goes to sleep until dueNanos (INT64_MAX if the queue is empty).  The caller
+    // must look at the queue again after this and not sleep if it has changed.
+
+    void Arm(int64_t dueNanos)
+    {
+        _armedDue.store(dueNanos, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    // Disarm
+    //
+    // Consumer side, once it's awake again; also swallows any signal that was sent
+
+    void Disarm()
+    {
+        _armedDue.store(kAwake, std::memory_order_relaxed);
+
+        uint64_t count;
+        while (read(_eventFd, &count, sizeof(count)) > 0)
+            ;
+    }
+};
@@ -2,8 +2,9 @@
 
 #include <cstdint>
 
-constexpr auto WIFI_COMMAND_PIXELDATA64 = 3;             // Wifi command with color data and 64-bit clock vals
-constexpr auto WIFI_COMMAND_PEAKDATA    = 4;             // Wifi command that delivers audio peaks
+constexpr auto WIFI_COMMAND_PIXELDATA64  = 3;            // Wifi command with color data and 64-bit clock vals
+constexpr auto WIFI_COMMAND_PEAKDATA     = 4;            // Wifi command that delivers audio peaks
+constexpr auto WIFI_COMMAND_PIXELDELTA64 = 5;            // Wifi command with changed pixel runs against the last frame
 
 // Matrix Defaults
 //
@@ -18,7 +19,71 @@ constexpr auto kDefaultRefreshRate        = 60;
 constexpr auto kDefaultDisableBusyWaiting = true;
 
 constexpr auto kIncomingSocketPort        = 49152;
-constexpr auto kMaxBuffers                = 500;
+constexpr auto kSocketPollIntervalMs      = 100;         // Longest the socket loop sleeps before checking for exit
+constexpr auto kConnectionTimeout         = 3.0;         // Seconds of silence before a connection is dropped
+constexpr auto kMaxBuffers                = 500;         // Deepest the frame queue gets, however much memory there is
+constexpr auto kDecodeQueueDepth          = 8;           // Envelopes the decode workers may have in hand at once
+constexpr auto kDefaultDecodeThreads      = 0;           // Decode workers; 0 expands on the socket thread itself
+constexpr auto kMaxRealtimePriority       = 98;          // Highest SCHED_FIFO priority we'll use; the matrix refresh thread has 99
+constexpr auto kSpareFrameBuffers         = 6 + 2 * kDecodeQueueDepth;  // Pooled frames beyond kMaxBuffers for those in flight or decoding
+constexpr auto kCacheLineSize             = 64;          // Keeps producer and consumer counters on separate lines
+constexpr auto kMaxUdpFragments           = 1024;        // Most fragments one UDP frame may be split into
+constexpr auto kMaxUdpDatagramSize        = 65536;
+constexpr auto kUdpReceiveBufferSize      = 1 << 20;     // Socket buffer big enough to ride out a burst of fragments
+constexpr auto kDefaultChannel            = 1;           // Which channel16 bit we answer to; 0 on the wire is everyone
+constexpr auto kMaxChannels               = 16;          // Channels one node may drive, one per channel16 bit
+constexpr auto kDefaultMetricsPort        = 49153;       // HTTP port for Prometheus scrapes; 0 turns it off
+constexpr auto kMetricsClientTimeoutMs    = 1000;        // How long a scraper gets to send its request
+constexpr auto kMaxPeakBands              = 16;          // Most audio bands a PeakData packet may carry
+constexpr auto kRecordingBufferBytes      = 16 << 20;    // Records waiting for the disk beyond this are dropped
+constexpr auto kReplayPollIntervalMs      = 100;         // Longest replay sleeps before checking for exit
+
+// Rendering Defaults
+
+constexpr auto kDefaultUseVSync           = true;        // Draw offscreen and swap on VSync rather than drawing live
+constexpr auto kFrameCanvasPoolSize       = 3;           // Offscreen canvases, plus the one the matrix starts with
+constexpr auto kDefaultBlitThreads        = 2;           // Threads sharing the frame copy, including the draw thread
+constexpr auto kDefaultGamma              = 1.0f;        // The matrix library already applies its CIE1931 curve
+constexpr auto kDirtyHistoryDepth         = 8;           // Frames of dirty ranges kept for partial redraws
+constexpr auto kDrawWakeEarlyMicros       = 100;         // Draw timer fires this early and spins the rest
+constexpr auto kDrawPollIntervalMs        = 100;         // Longest the draw loop sleeps before checking for exit
+constexpr auto kDefaultMaxLatenessMs      = 100;         // Lateness at which the dropping policies give up on a frame
+constexpr auto kLateFrameMs               = 17;          // Frames shown later than about one refresh count as late
+constexpr auto kSmoothingCatchUpPercent   = 10;          // How much faster than real time a backlog is played out
+constexpr auto kMaxInterpolationGapMs     = 250;         // Frames further apart than this are cut between, not blended
+
+// Flow Control
+
+constexpr auto kDefaultTargetLeadMs       = 500;         // How far ahead of its due time we ask for each frame to arrive
+constexpr auto kQueueMemoryPercent        = 10;          // Share of available memory the frame queue may take
+constexpr auto kMinBuffers                = 16;          // Shallowest queue we'll size for, however little memory there is
+constexpr auto kFlowLeadTolerance         = 0.25;        // Fraction the lead may stray from its target before we say so
+constexpr auto kFlowLeadSmoothing         = 0.2;         // EWMA weight of each lead sample
+constexpr auto kFlowHighWaterPercent      = 90;          // Queue fill past which the master is asked to slow or drop quality
+
+// Compact Queue
+
+constexpr auto kQueueDeflateLevel         = 1;           // zlib level for frames kept deflated in the queue
+constexpr auto kQueueDeflateRatio         = 4;           // Compression we size the arena for when frames are deflated
+constexpr auto kExpandedFrameBuffers      = 2;           // Full frames beyond the spares, for the oldest to be expanded into
+
+// Local Effects
+
+constexpr auto kEffectTakeoverMs          = 2000;        // Stream silence after which the effect takes over
+constexpr auto kEffectLeadMs              = 50;          // How far ahead of its due time each effect frame is queued
+constexpr auto kEffectPollIntervalMs      = 100;         // How often an idle effect engine checks on the stream
+constexpr auto kPeakStaleMs               = 500;         // Audio peaks older than this are treated as silence
+
+// Telemetry
+
+constexpr auto kFPSSmoothing              = 0.1;         // EWMA weight of each new frame interval
+constexpr auto kQueueTrendSmoothing       = 0.2;         // EWMA weight of each queue depth sample
+constexpr auto kTelemetrySampleIntervalMs = 1000;        // How often RSSI and CPU use are resampled
+constexpr auto kWirelessStatsPath         = "/proc/net/wireless";
+constexpr auto kRedMilliwattsPerLed       = 3.5;         // Average draw of one fully lit channel, after multiplexing,
+constexpr auto kGreenMilliwattsPerLed     = 3.0;         //   at full brightness, for a typical 1/16 scan HUB75 panel
+constexpr auto kBlueMilliwattsPerLed      = 3.5;
+constexpr auto kDefaultPowerLimitWatts    = 0;           // Power budget for the panels; 0 for no limit
 
 #define NUM_LEDS (Rows * Columns * ChainLength)
 
@@ -0,0 +1,111 @@
+//+--------------------------------------------------------------------------
+//
+// File:        hsv2rgb.cpp
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    The hsv2rgb_rainbow that pixeltypes.h declares, following FastLED's
+//    (MIT licensed), so CHSV colors come out the same as on the ESP32.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#include "pixeltypes.h"
+
+// scale8_video
+//
+// Like scale8, but never scales a nonzero value all the way down to zero
+
+static constexpr uint8_t scale8_video(uint8_t i, fract8 scale)
+{
+    return (uint8_t)((((int)i * (int)scale) >> 8) + ((i && scale) ? 1 : 0));
+}
+
+// hsv2rgb_rainbow
+//
+// The hue wheel is split into eight sections of 32, each one a straight-line blend between two of red,
+// orange, yellow, green, aqua, blue, purple and pink.  Yellow gets a wider share than a plain HSV
+// conversion would give it, since it otherwise looks like a thin band between orange and green.
+
+void hsv2rgb_rainbow(const CHSV & hsv, CRGB & rgb)
+{
+    const uint8_t hue = hsv.hue;
+    const uint8_t sat = hsv.sat;
+    uint8_t       val = hsv.val;
+
+    const uint8_t offset8 = (hue & 0x1F) << 3;                 // Position within the section, 0 to 248
+    const uint8_t third   = scale8(offset8, 256 / 3);           // Up to 85
+    const uint8_t twothirds = scale8(offset8, (256 * 2) / 3);   // Up to 170
+
+    uint8_t r, g, b;
+    switch (hue >> 5)
+    {
+        case 0:  r = 255 - third;     g = third;            b = 0;               break;    // Red to orange
+        case 1:  r = 171;             g = 85 + third;       b = 0;               break;    // Orange to yellow
+        case 2:  r = 171 - twothirds; g = 170 + third;      b = 0;               break;    // Yellow to green
+        case 3:  r = 0;               g = 255 - third;      b = third;           break;    // Green to aqua
+        case 4:  r = 0;               g = 171 - twothirds;  b = 85 + twothirds;  break;    // Aqua to blue
+        case 5:  r = third;           g = 0;                b = 255 - third;     break;    // Blue to purple
+        case 6:  r = 85 + third;      g = 0;                b = 171 - third;     break;    // Purple to pink
+        default: r = 170 + third;     g = 0;                b = 85 - third;      break;    // Pink to red
+    }
+
+    // Desaturate toward white, keeping the overall brightness the same
+
+    if (sat != 255)
+    {
+        if (sat == 0)
+        {
+            r = g = b = 255;
+        }
+        else
+        {
+            uint8_t desat = 255 - sat;
+            desat = scale8_video(desat, desat);
+            const uint8_t satscale = 255 - desat;
+            r = scale8(r, satscale) + desat;
+            g = scale8(g, satscale) + desat;
+            b = scale8(b, satscale) + desat;
+        }
+    }
+
+    // Then dim, on a rough square-law curve so low values still look like themselves
+
+    if (val != 255)
+    {
+        val = scale8_video(val, val);
+        if (val == 0)
+        {
+            r = g = b = 0;
+        }
+        else
+        {
+            r = scale8(r, val);
+            g = scale8(g, val);
+            b = scale8(b, val);
+        }
+    }
+
+    rgb.r = r;
+    rgb.g = g;
+    rgb.b = b;
+}
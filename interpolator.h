@@ -0,0 +1,230 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Interpolator.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Blends between the frame that is showing and the next one in the
+//    queue, so a stream sent at 20 or 30 fps moves smoothly at the panel's
+//    refresh rate.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "globals.h"
+#include "apptime.h"
+#include "ledbuffer.h"
+#include "pixelops.h"
+
+// FrameInterpolator
+//
+// Holds the latest frame that has come due and, once per refresh, blends it toward the next one by how far
+// "now" is between their timestamps.  The next frame is taken off the queue as soon as there is one and
+// held here until it comes due, so a blend only ever reads frames we own, and a packed frame is expanded
+// on its way off the queue like any other.  With no next frame - an underrun - or one of another size or
+// too far off, the current frame is simply held, and once it has been drawn as-is nothing more is drawn
+// until something changes.  Draw thread only.
+
+class FrameInterpolator
+{
+    struct Range
+    {
+        size_t first;
+        size_t end;
+    };
+
+    const int64_t _intervalNanos;                       // One panel refresh
+    int64_t       _nextTickNanos;                       // When the next blend is due, in frame time
+    LEDBufferPtr  _pCurrent;                            // Latest frame that's due, which we blend away from
+    LEDBufferPtr  _pNext;                               // The frame after it, which we blend toward
+    LEDBuffer     _output;                              // What actually gets drawn
+    bool          _bNewCurrent;                         // _pCurrent changed since the last output
+
+    // What the last output was made from, to work out what the next one changes
+
+    uint64_t      _lastFromSerial;
+    uint64_t      _lastToSerial;                        // 0 if it wasn't a blend
+    fract8        _lastAmount;
+    size_t        _lastSize;
+    Range         _lastToRange;
+
+    // RangeSince
+    //
+    // The part of a frame that differs from the one with the given serial, which is only known when that
+    // was the frame queued just before it
+
+    static Range RangeSince(const LEDBuffer & frame, uint64_t serial)
+    {
+        if (frame.Serial() != 0 && frame.Serial() == serial + 1)
+            return Range { frame.DirtyFirst(), frame.DirtyEnd() };
+        return Range { 0, SIZE_MAX };
+    }
+
+    static void Widen(Range & range, const Range & other)
+    {
+        if (other.first < other.end)
+        {
+            range.first = std::min(range.first, other.first);
+            range.end   = std::max(range.end, other.end);
+        }
+    }
+
+  public:
+
+    FrameInterpolator(size_t cLeds, int refreshHz)
+        : _intervalNanos(NANOS_PER_SECOND / std::max(refreshHz, 1)),
+          _nextTickNanos(0),
+          _output(std::vector<CRGB>(cLeds).data(), cLeds, 0, 0),
+          _bNewCurrent(false),
+          _lastFromSerial(0),
+          _lastToSerial(0),
+          _lastAmount(0),
+          _lastSize(SIZE_MAX),
+          _lastToRange { 0, 0 }
+    {
+    }
+
+    bool HasCurrent() const
+    {
+        return _pCurrent != nullptr;
+    }
+
+    int64_t NextTickNanos() const
+    {
+        return _nextTickNanos;
+    }
+
+    bool HasNext() const
+    {
+        return _pNext != nullptr;
+    }
+
+    // NextDueNanos
+    //
+    // When the next frame is due, in server nanoseconds.  Only valid if HasNext().
+
+    int64_t NextDueNanos() const
+    {
+        return (int64_t)_pNext->TimestampNanos();
+    }
+
+    LEDBuffer & Output()
+    {
+        return _output;
+    }
+
+    // SetCurrent
+    //
+    // Takes over a frame that has just come due, which the blends then start from
+
+    void SetCurrent(LEDBufferPtr pFrame)
+    {
+        _pCurrent    = std::move(pFrame);
+        _bNewCurrent = true;
+    }
+
+    // SetNext
+    //
+    // Takes over the frame that's next off the queue, which the blends then head toward
+
+    void SetNext(LEDBufferPtr pFrame)
+    {
+        _pNext = std::move(pFrame);
+    }
+
+    // TakeNext
+    //
+    // Hands back the next frame once it has come due, for the pacer to decide on
+
+    LEDBufferPtr TakeNext()
+    {
+        return std::move(_pNext);
+    }
+
+    // Render
+    //
+    // Makes the output for nowNanos, in frame time, and sets [first, end) to the pixels that differ from
+    // the last output.  Returns false if there's nothing new to draw.
+
+    bool Render(int64_t nowNanos, size_t & first, size_t & end)
+    {
+        _nextTickNanos = nowNanos + _intervalNanos;
+
+        const LEDBuffer & from  = *_pCurrent;
+        const size_t      cLeds = from.ColorData().size();
+
+        const LEDBuffer * pTo      = _pNext.get();
+        uint64_t          toSerial = 0;
+        fract8            amount   = 0;
+
+        if (pTo && pTo->ColorData().size() == cLeds && cLeds <= _output.Capacity())
+        {
+            const int64_t span    = (int64_t)pTo->TimestampNanos() - (int64_t)from.TimestampNanos();
+            const int64_t elapsed = nowNanos - (int64_t)from.TimestampNanos();
+            if (span > 0 && span <= kMaxInterpolationGapMs * NANOS_PER_SECOND / 1000)
+            {
+                amount   = (fract8)std::clamp<int64_t>(elapsed * 256 / span, 0, 255);
+                toSerial = amount ? pTo->Serial() : 0;
+            }
+        }
+
+        if (!_bNewCurrent && toSerial == _lastToSerial && amount == _lastAmount)
+            return false;
+
+        Range range = { SIZE_MAX, 0 };
+        if (_bNewCurrent)
+            Widen(range, cLeds == _lastSize ? RangeSince(from, _lastFromSerial) : Range { 0, SIZE_MAX });
+        Widen(range, _lastToRange);
+
+        Range toRange = { 0, 0 };
+        _output.SetSize(std::min(cLeds, _output.Capacity()));
+        if (toSerial)
+        {
+            toRange = RangeSince(*pTo, from.Serial());
+            PixelOps::BlendAll(_output.ColorData(), from.ColorData(), pTo->ColorData(), amount);
+        }
+        else
+        {
+            std::copy_n(from.ColorData().begin(), _output.ColorData().size(), _output.ColorData().begin());
+        }
+        Widen(range, toRange);
+
+        _bNewCurrent    = false;
+        _lastFromSerial = from.Serial();
+        _lastToSerial   = toSerial;
+        _lastAmount     = amount;
+        _lastSize       = cLeds;
+        _lastToRange    = toRange;
+
+        first = range.first;
+        end   = range.end;
+        if (first > end)
+            first = end = 0;
+        return true;
+    }
+};
@@ -0,0 +1,194 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Layout.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Describes how the panels of an installation are physically arranged,
+//    chained, rotated and mirrored, and compiles that into the PixelMap the
+//    blitter follows, once at startup.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pixelmap.h"
+
+// LayoutSpec
+//
+// What --layout says, before we know the size of the matrix.  The panels are numbered in chain order,
+// along each chain and then down the parallel chains, and laid into a grid of gridColumns by gridRows,
+// filling each row of the grid before the next.  A serpentine layout runs every other row of the grid
+// backwards, with its panels upside down, the way a chain doubles back on itself in a U.  Then the whole
+// picture is mirrored as asked and rotated clockwise.  Without --layout we mirror horizontally, which is
+// how our panels have always been wired.
+
+struct LayoutSpec
+{
+    size_t gridColumns = 0;                             // 0 to keep the panels where the matrix library has them
+    size_t gridRows    = 0;
+    bool   serpentine  = false;
+    bool   flipX       = true;
+    bool   flipY       = false;
+    int    rotation    = 0;                             // Degrees clockwise: 0, 90, 180 or 270
+};
+
+// ParseLayout
+//
+// A comma-separated list of any of "grid=<columns>x<rows>", "serpentine", "flip-x", "flip-y" and
+// "rotate=<degrees>", or "identity" for none of them
+
+inline bool ParseLayout(const char * text, LayoutSpec & spec)
+{
+    spec = LayoutSpec();
+    spec.flipX = false;
+
+    std::string terms(text);
+    for (char * pTerm = strtok(terms.data(), ","); pTerm; pTerm = strtok(nullptr, ","))
+    {
+        char extra;
+        if (0 == strcmp(pTerm, "identity"))
+            continue;
+        else if (0 == strcmp(pTerm, "serpentine"))
+            spec.serpentine = true;
+        else if (0 == strcmp(pTerm, "flip-x"))
+            spec.flipX = true;
+        else if (0 == strcmp(pTerm, "flip-y"))
+            spec.flipY = true;
+        else if (1 == sscanf(pTerm, "rotate=%d%c", &spec.rotation, &extra))
+        {
+            if (spec.rotation % 90 != 0 || spec.rotation < 0 || spec.rotation >= 360)
+                return false;
+        }
+        else if (2 != sscanf(pTerm, "grid=%zux%zu%c", &spec.gridColumns, &spec.gridRows, &extra) || !spec.gridColumns || !spec.gridRows)
+            return false;
+    }
+    return true;
+}
+
+// Layout
+//
+// The compiled form: a PixelMap from each matrix pixel to the pixel of the frame it shows, plus the size
+// of frame that makes, which is the matrix turned sideways for a rotation of 90 or 270.  However involved
+// the layout, drawing through it costs the same table lookup per pixel as drawing straight through.
+
+class Layout
+{
+    size_t   _width;                                    // Frame size the layout expects
+    size_t   _height;
+    PixelMap _map;
+
+    // Place
+    //
+    // Where matrix pixel (x, y) sits in the grid of panels
+
+    static void Place(const LayoutSpec & spec, size_t x, size_t y, size_t matrixWidth, size_t panelWidth, size_t panelHeight,
+                      size_t columns, size_t & gx, size_t & gy)
+    {
+        const size_t panel = (y / panelHeight) * (matrixWidth / panelWidth) + x / panelWidth;
+        size_t       col   = panel % columns;
+        const size_t row   = panel / columns;
+        size_t       lx    = x % panelWidth;
+        size_t       ly    = y % panelHeight;
+
+        if (spec.serpentine && (row & 1))
+        {
+            col = columns - 1 - col;
+            lx  = panelWidth - 1 - lx;
+            ly  = panelHeight - 1 - ly;
+        }
+        gx = col * panelWidth + lx;
+        gy = row * panelHeight + ly;
+    }
+
+  public:
+
+    // Fits
+    //
+    // Whether the spec's grid holds exactly the panels the matrix has
+
+    static bool Fits(const LayoutSpec & spec, size_t matrixWidth, size_t matrixHeight, size_t panelWidth, size_t panelHeight)
+    {
+        if (!panelWidth || !panelHeight || matrixWidth % panelWidth || matrixHeight % panelHeight)
+            return spec.gridColumns == 0 && !spec.serpentine;
+        if (spec.gridColumns == 0)
+            return true;
+        return spec.gridColumns * spec.gridRows == (matrixWidth / panelWidth) * (matrixHeight / panelHeight);
+    }
+
+    // The spec must have passed Fits for these dimensions
+
+    Layout(const LayoutSpec & spec, size_t matrixWidth, size_t matrixHeight, size_t panelWidth, size_t panelHeight)
+        : _width(0), _height(0), _map(matrixWidth, matrixHeight)
+    {
+        const bool   bPanels = panelWidth && panelHeight && matrixWidth % panelWidth == 0 && matrixHeight % panelHeight == 0;
+        const size_t columns = spec.gridColumns ? spec.gridColumns : bPanels ? matrixWidth / panelWidth : 1;
+        const size_t gridW   = bPanels ? columns * panelWidth : matrixWidth;
+        const size_t gridH   = bPanels ? (matrixWidth / panelWidth) * (matrixHeight / panelHeight) / columns * panelHeight : matrixHeight;
+        const bool   bSideways = spec.rotation == 90 || spec.rotation == 270;
+
+        _width  = bSideways ? gridH : gridW;
+        _height = bSideways ? gridW : gridH;
+
+        std::vector<uint32_t> index(matrixWidth * matrixHeight, PixelMap::kNoSource);
+        for (size_t y = 0; y < matrixHeight; y++)
+            for (size_t x = 0; x < matrixWidth; x++)
+            {
+                size_t gx = x, gy = y;
+                if (bPanels)
+                    Place(spec, x, y, matrixWidth, panelWidth, panelHeight, columns, gx, gy);
+
+                if (spec.flipX)
+                    gx = gridW - 1 - gx;
+                if (spec.flipY)
+                    gy = gridH - 1 - gy;
+
+                // Undo the rotation to find the frame pixel that lands here
+
+                size_t fx = gx, fy = gy;
+                switch (spec.rotation)
+                {
+                    case 90:  fx = gy;             fy = gridW - 1 - gx; break;
+                    case 180: fx = gridW - 1 - gx; fy = gridH - 1 - gy; break;
+                    case 270: fx = gridH - 1 - gy; fy = gx;             break;
+                }
+                index[y * matrixWidth + x] = fy * _width + fx;
+            }
+
+        _map = PixelMap(matrixWidth, matrixHeight, std::move(index));
+    }
+
+    const PixelMap & Map() const
+    {
+        return _map;
+    }
+
+    constexpr size_t Width()  const { return _width;  }
+    constexpr size_t Height() const { return _height; }
+};
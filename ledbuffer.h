@@ -36,13 +36,21 @@
 #include <memory>
 #include <iostream>
 #include <vector>
-#include <mutex>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
 #include <optional>
+#include <mutex>
 #include <span>
+#include <thread>
 #include "values.h"
 #include "globals.h"
 #include "pixeltypes.h"
 #include "apptime.h"
+#include "framesignal.h"
+#include "metrics.h"
+#include "peakdata.h"
+#include "framepacker.h"
 
 // A custom exception that is thrown if data can't be parsed from the wire
 
@@ -52,71 +60,408 @@ class LEDBufferException : public std::runtime_error
     explicit LEDBufferException(const std::string& message) : std::runtime_error(message) {}
 };
 
+// WireFrameHeader
+//
+// The 24 byte header at the front of every frame on the wire, ahead of the color data
+
+struct WireFrameHeader
+{
+    uint16_t command16;
+    uint16_t channel16;
+    uint32_t length32;          // Number of pixels that follow, or bands for peaks, or bytes for a delta
+    uint64_t seconds;
+    uint64_t micros;
+
+    static constexpr size_t kSize = sizeof(command16) + sizeof(channel16) + sizeof(length32) + sizeof(seconds) + sizeof(micros);
+
+    static constexpr WireFrameHeader FromMemory(const uint8_t * payloadData)
+    {
+        return WireFrameHeader
+        {
+            .command16 = WORDFromMemory(&payloadData[0]),
+            .channel16 = WORDFromMemory(&payloadData[2]),
+            .length32  = DWORDFromMemory(&payloadData[4]),
+            .seconds   = ULONGFromMemory(&payloadData[8]),
+            .micros    = ULONGFromMemory(&payloadData[16])
+        };
+    }
+
+    // ToMemory
+    //
+    // Writes the header out as it goes on the wire, little-endian like FromMemory reads it
+
+    void ToMemory(uint8_t * payloadData) const
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            payloadData[0 + i] = (uint8_t)(command16 >> (8 * i));
+            payloadData[2 + i] = (uint8_t)(channel16 >> (8 * i));
+        }
+        for (int i = 0; i < 4; i++)
+            payloadData[4 + i] = (uint8_t)(length32 >> (8 * i));
+        for (int i = 0; i < 8; i++)
+        {
+            payloadData[8 + i]  = (uint8_t)(seconds >> (8 * i));
+            payloadData[16 + i] = (uint8_t)(micros >> (8 * i));
+        }
+    }
+
+    // PayloadSize
+    //
+    // How many bytes follow the header on the wire
+
+    constexpr size_t PayloadSize() const
+    {
+        switch (command16)
+        {
+            case WIFI_COMMAND_PIXELDELTA64: return length32;
+            case WIFI_COMMAND_PEAKDATA:     return (size_t)length32 * sizeof(float);
+            default:                        return (size_t)length32 * sizeof(CRGB);
+        }
+    }
+};
+
+static_assert(WireFrameHeader::kSize == 24);
+static_assert(WireFrameHeader::kSize % sizeof(CRGB) == 0, "Frame headroom must be a whole number of pixels");
+
+class LEDBuffer;
+class LEDBufferPool;
+
+// LEDBufferRecycler
+//
+// Deleter for LEDBufferPtr.  Pooled buffers go back to the pool they came from; standalone ones are freed.
+
+struct LEDBufferRecycler
+{
+    void operator()(LEDBuffer * pBuffer) const;
+};
+
+using LEDBufferPtr = std::unique_ptr<LEDBuffer, LEDBufferRecycler>;
+
 // LEDBuffer
 //
-// Represents a frame of LED data with a timestamp.  The data is a vector of CRGB objects.
-// The timestamp is in seconds and microseconds since the epoch.
+// Represents a frame of LED data with a timestamp.  The data is an array of CRGB objects, normally
+// one slot of a LEDBufferPool's preallocated storage.  The timestamp is in seconds and microseconds
+// since the epoch.
+//
+// While it waits in a queue keeping a compact format, a frame is instead a packed record in the manager's
+// FrameArena, and has no color data of its own until the manager expands it again.
 
 class LEDBuffer
 {
+    friend class LEDBufferPool;
+    friend class LEDBufferManager;
+    friend struct LEDBufferRecycler;
+
   public:
 
+    static constexpr size_t kHeaderPixels = WireFrameHeader::kSize / sizeof(CRGB);      // Headroom, in pixels
+
   private:
 
-    std::vector<CRGB> _leds;
-    const uint64_t    _timeStampMicroseconds;
-    const uint64_t    _timeStampSeconds;
+    LEDBufferPool *         _pPool;                     // Pool that owns us, or nullptr if standalone
+    uint32_t                _iPoolIndex;                // Our slot in the pool
+    CRGB *                  _pLeds;                     // Color data storage
+    size_t                  _cCapacity;                 // Pixels the storage can hold
+    size_t                  _cLeds;                     // Pixels in the current frame
+    uint64_t                _timeStampMicroseconds;
+    uint64_t                _timeStampSeconds;
+    uint64_t                _serial;                    // Position in the producer's stream, set when queued
+    int64_t                 _queuedNanos;               // Monotonic time it was queued, for residency metrics
+    size_t                  _iDirtyFirst;               // Pixels [first, end) are all that changed since the
+    size_t                  _iDirtyEnd;                 //   frame queued just before this one
+    std::unique_ptr<CRGB[]> _ownedStorage;              // Only used by standalone buffers
+    std::shared_ptr<void>   _pBorrowed;                 // Keeps borrowed storage alive, for buffers over someone else's
+    uint8_t *               _pPacked  = nullptr;        // The frame's record in a FrameArena, if it's packed
+    size_t                  _cbPacked = 0;
 
   public:
 
+    LEDBuffer() :
+        _pPool(nullptr),
+        _iPoolIndex(0),
+        _pLeds(nullptr),
+        _cCapacity(0),
+        _cLeds(0),
+        _timeStampMicroseconds(0),
+        _timeStampSeconds(0),
+        _serial(0),
+        _queuedNanos(0),
+        _iDirtyFirst(0),
+        _iDirtyEnd(SIZE_MAX)
+    {
+    }
+
+    // A standalone buffer that owns a copy of the data; the pool is the normal way to get one
+
     explicit LEDBuffer(const CRGB * pData, size_t count, uint64_t seconds, uint64_t micros) :
+        _pPool(nullptr),
+        _iPoolIndex(0),
+        _cCapacity(count),
+        _cLeds(count),
         _timeStampMicroseconds(micros),
-        _timeStampSeconds(seconds)
+        _timeStampSeconds(seconds),
+        _serial(0),
+        _queuedNanos(0),
+        _iDirtyFirst(0),
+        _iDirtyEnd(SIZE_MAX),
+        _ownedStorage(std::make_unique<CRGB[]>(kHeaderPixels + count))
     {   
-        _leds.assign(pData, pData+count);
+        _pLeds = _ownedStorage.get() + kHeaderPixels;
+        std::copy(pData, pData + count, _pLeds);
     }
 
-    ~LEDBuffer()
+    // A standalone buffer over pixels that live elsewhere, such as a mapped recording, which pBorrowed keeps
+    // alive for as long as the buffer is.  The kHeaderPixels ahead of pData must be there too, as headroom.
+
+    explicit LEDBuffer(CRGB * pData, size_t count, uint64_t seconds, uint64_t micros, std::shared_ptr<void> pBorrowed) :
+        _pPool(nullptr),
+        _iPoolIndex(0),
+        _pLeds(pData),
+        _cCapacity(count),
+        _cLeds(count),
+        _timeStampMicroseconds(micros),
+        _timeStampSeconds(seconds),
+        _serial(0),
+        _queuedNanos(0),
+        _iDirtyFirst(0),
+        _iDirtyEnd(SIZE_MAX),
+        _pBorrowed(std::move(pBorrowed))
     {
     }
 
+    LEDBuffer(const LEDBuffer &) = delete;
+    LEDBuffer & operator=(const LEDBuffer &) = delete;
+
     constexpr uint64_t Seconds()      const  { return _timeStampSeconds;      }
     constexpr uint64_t MicroSeconds() const  { return _timeStampMicroseconds; }
-    
-    const std::vector<CRGB> & ColorData() const
+    constexpr size_t   Capacity()     const  { return _cCapacity;             }
+    constexpr uint64_t Serial()       const  { return _serial;                }
+    constexpr int64_t  QueuedNanos()  const  { return _queuedNanos;           }
+    constexpr uint64_t TimestampNanos() const { return _timeStampSeconds * NANOS_PER_SECOND + _timeStampMicroseconds * NANOS_PER_MICRO; }
+    constexpr size_t   DirtyFirst()   const  { return _iDirtyFirst;           }
+    constexpr size_t   DirtyEnd()     const  { return std::min(_iDirtyEnd, _cLeds); }
+    constexpr bool     IsPacked()     const  { return _pPacked != nullptr;    }
+
+    std::span<const uint8_t> PackedData() const
+    {
+        return std::span<const uint8_t>(_pPacked, _cbPacked);
+    }
+
+    void SetTimestamp(uint64_t seconds, uint64_t micros)
+    {
+        _timeStampSeconds      = seconds;
+        _timeStampMicroseconds = micros;
+    }
+
+    // SetSize
+    //
+    // Sets how many pixels of the storage make up this frame, which can't exceed the capacity
+
+    void SetSize(size_t count)
+    {
+        if (count > _cCapacity)
+            throw LEDBufferException("Frame has more pixels than the buffer can hold");
+        _cLeds = count;
+    }
+
+    // SetDirtyRange
+    //
+    // Records which pixels differ from the previous frame, so the drawing side can skip the rest.  A buffer
+    // starts out entirely dirty, which is always safe.
+
+    void SetDirtyRange(size_t first, size_t end)
+    {
+        _iDirtyFirst = first;
+        _iDirtyEnd   = std::max(first, end);
+    }
+
+    void SetAllDirty()
+    {
+        SetDirtyRange(0, SIZE_MAX);
+    }
+
+    // ColorData
+    //
+    // The frame's pixels, or an empty span while it's packed
+
+    std::span<const CRGB> ColorData() const
+    {
+        return std::span<const CRGB>(_pLeds, _pPacked ? 0 : _cLeds);
+    }
+
+    std::span<CRGB> ColorData()
+    {
+        return std::span<CRGB>(_pLeds, _pPacked ? 0 : _cLeds);
+    }
+
+    // WireImage
+    //
+    // Every buffer has room for a wire frame header just ahead of its color data, so a whole frame as it
+    // appears on the wire can be decompressed straight into place: the header lands in the headroom and
+    // the pixels land where they belong.  Spans the headroom plus the full pixel capacity.
+
+    std::span<uint8_t> WireImage()
     {
-        return _leds;
+        return std::span<uint8_t>(reinterpret_cast<uint8_t *>(_pLeds - kHeaderPixels), (kHeaderPixels + _cCapacity) * sizeof(CRGB));
     }
 
     // CreateFromWire
     //
-    // Parse a frame from the WiFi data and return it as a constructed LEDBuffer object
+    // Parse a frame from the WiFi data into a buffer taken from the pool
     
-    static std::unique_ptr<LEDBuffer> CreateFromWire(std::span<const uint8_t> payload)   
+    static LEDBufferPtr CreateFromWire(std::span<const uint8_t> payload, LEDBufferPool & pool);
+};
+
+// LEDBufferPool
+//
+// A fixed set of LEDBuffers whose color data lives in a single slab allocated at startup, so streaming
+// frames never touches the heap.  Buffers are handed out as LEDBufferPtrs and come back when the last
+// owner lets go of them, whether that's the draw loop after drawing or the queue dropping an old frame.
+//
+// Any thread may acquire or release, so the free list is a lock-free stack of slot indices.  The top of
+// the stack carries a version tag alongside the index so that a slot which is popped and pushed again
+// between another thread's read and its compare-exchange can't be mistaken for an unchanged stack.
+
+class LEDBufferPool
+{
+    static constexpr uint32_t kEndOfList = UINT32_MAX;
+
+    const size_t                             _cBuffers;
+    const size_t                             _cLedsPerBuffer;
+    std::unique_ptr<CRGB[]>                  _slab;          // Headroom and color data for every buffer, back to back
+    std::unique_ptr<LEDBuffer[]>             _buffers;
+    std::unique_ptr<std::atomic<uint32_t>[]> _aNextFree;     // Free list links, by slot index
+    std::atomic<uint64_t>                    _freeTop;       // Version tag in the high half, slot index in the low
+
+    static constexpr uint64_t MakeTop(uint64_t top, uint32_t index)
+    {
+        return ((top >> 32) + 1) << 32 | index;
+    }
+
+  public:
+
+    LEDBufferPool(size_t cBuffers, size_t cLedsPerBuffer)
+        : _cBuffers(cBuffers),
+          _cLedsPerBuffer(cLedsPerBuffer),
+          _slab(std::make_unique<CRGB[]>(cBuffers * (LEDBuffer::kHeaderPixels + cLedsPerBuffer))),
+          _buffers(std::make_unique<LEDBuffer[]>(cBuffers)),
+          _aNextFree(std::make_unique<std::atomic<uint32_t>[]>(cBuffers)),
+          _freeTop(cBuffers ? 0 : kEndOfList)
+    {
+        for (size_t i = 0; i < cBuffers; i++)
+        {
+            LEDBuffer & buffer = _buffers[i];
+            buffer._pPool      = this;
+            buffer._iPoolIndex = i;
+            buffer._pLeds      = &_slab[i * (LEDBuffer::kHeaderPixels + cLedsPerBuffer) + LEDBuffer::kHeaderPixels];
+            buffer._cCapacity  = cLedsPerBuffer;
+            _aNextFree[i].store(i + 1 < cBuffers ? i + 1 : kEndOfList, std::memory_order_relaxed);
+        }
+    }
+
+    LEDBufferPool(const LEDBufferPool &) = delete;
+    LEDBufferPool & operator=(const LEDBufferPool &) = delete;
+
+    constexpr size_t Size()           const { return _cBuffers;       }
+    constexpr size_t LEDsPerBuffer()  const { return _cLedsPerBuffer; }
+
+    // MemoryBytes
+    //
+    // What the slab of headroom and color data took at startup
+
+    size_t MemoryBytes() const
     {
-        const     auto payloadData = payload.data();
-        const     auto payloadLength = payload.size();
-        constexpr auto minimumPayloadLength = 24;
+        return _cBuffers * (LEDBuffer::kHeaderPixels + _cLedsPerBuffer) * sizeof(CRGB);
+    }
 
-        if (payloadLength < minimumPayloadLength) // Our header size
+    // Acquire
+    //
+    // Pops a free buffer, or returns an empty pointer if every buffer is in use.  The buffer comes back
+    // sized to its full capacity with whatever pixels and timestamp it last held.
+
+    LEDBufferPtr Acquire()
+    {
+        uint64_t top = _freeTop.load(std::memory_order_acquire);
+        while (true)
         {
-            throw LEDBufferException("Not enough data received to process");
+            const uint32_t index = (uint32_t)top;
+            if (index == kEndOfList)
+                return LEDBufferPtr();
+
+            const uint32_t next = _aNextFree[index].load(std::memory_order_relaxed);
+            if (_freeTop.compare_exchange_weak(top, MakeTop(top, next), std::memory_order_acquire, std::memory_order_acquire))
+            {
+                LEDBuffer * pBuffer = &_buffers[index];
+                pBuffer->_cLeds = pBuffer->_cCapacity;
+                pBuffer->SetAllDirty();
+                return LEDBufferPtr(pBuffer);
+            }
         }
+    }
 
-        uint16_t command16 = WORDFromMemory(&payloadData[0]);
-        uint16_t channel16 = WORDFromMemory(&payloadData[2]);
-        uint32_t length32  = DWORDFromMemory(&payloadData[4]);
-        uint64_t seconds   = ULONGFromMemory(&payloadData[8]);
-        uint64_t micros    = ULONGFromMemory(&payloadData[16]);
+    // Release
+    //
+    // Pushes a buffer back onto the free list; normally called by LEDBufferRecycler rather than directly
 
-        constexpr size_t cbHeader = sizeof(command16) + sizeof(channel16) + sizeof(length32) + sizeof(seconds) + sizeof(micros);
+    void Release(LEDBuffer * pBuffer)
+    {
+        const uint32_t index = pBuffer->_iPoolIndex;
+        uint64_t top = _freeTop.load(std::memory_order_relaxed);
+        do
+        {
+            _aNextFree[index].store((uint32_t)top, std::memory_order_relaxed);
+        } while (!_freeTop.compare_exchange_weak(top, MakeTop(top, index), std::memory_order_release, std::memory_order_relaxed));
+    }
+};
 
-        if (payloadLength < length32 * sizeof(CRGB) + cbHeader)
-            throw LEDBufferException("Data size mismatch: insufficient data for expected length");
+inline void LEDBufferRecycler::operator()(LEDBuffer * pBuffer) const
+{
+    if (pBuffer->_pPacked)
+    {
+        FrameArena::Free(pBuffer->_pPacked);
+        pBuffer->_pPacked  = nullptr;
+        pBuffer->_cbPacked = 0;
+    }
+    if (pBuffer->_pPool)
+        pBuffer->_pPool->Release(pBuffer);
+    else
+        delete pBuffer;
+}
 
-        // Create and return a new LEDBuffer object by passing in the CRGB color data, length, and timestamp
-        return std::make_unique<LEDBuffer>(reinterpret_cast<const CRGB *>(&payloadData[cbHeader]), length32, seconds, micros);
+inline LEDBufferPtr LEDBuffer::CreateFromWire(std::span<const uint8_t> payload, LEDBufferPool & pool)
+{
+    if (payload.size() < WireFrameHeader::kSize) // Our header size
+    {
+        throw LEDBufferException("Not enough data received to process");
     }
+
+    const auto header = WireFrameHeader::FromMemory(payload.data());
+
+    if (payload.size() < header.length32 * sizeof(CRGB) + WireFrameHeader::kSize)
+        throw LEDBufferException("Data size mismatch: insufficient data for expected length");
+
+    // Fill a pooled LEDBuffer with the CRGB color data, length, and timestamp
+
+    LEDBufferPtr pBuffer = pool.Acquire();
+    if (!pBuffer)
+        throw LEDBufferException("No free frame buffers in the pool");
+
+    pBuffer->SetSize(header.length32);
+    pBuffer->SetTimestamp(header.seconds, header.micros);
+    memcpy(pBuffer->_pLeds, &payload[WireFrameHeader::kSize], header.length32 * sizeof(CRGB));
+    return pBuffer;
+}
+
+// LEDBufferSnapshot
+//
+// The queue state the socket server reports back to the master, all taken at the same instant
+
+struct LEDBufferSnapshot
+{
+    size_t size;                // Frames in the queue
+    double oldestAge;           // Seconds until the oldest frame is due (negative if overdue), MAXDOUBLE if empty
+    double newestAge;           // Seconds until the newest frame is due, MAXDOUBLE if empty
 };
 
 // LEDBufferManager
@@ -124,99 +469,581 @@ class LEDBuffer
 // Maintains a circular array of LEDBuffer objects and provides methods to push new buffers
 // and pop the oldest buffers.  The buffers are timestamped, and the manager can provide the
 // age of the oldest and newest buffers in seconds.
+//
+// There is one consumer (the draw loop) and normally just the one producer (the socket server), so the ring
+// is lock free.  Head and tail are free-running 64-bit counters, so they never wrap in practice and a
+// changed value always means the queue changed.  The producer only ever writes head, except when the
+// ring is full: then it drops the oldest frame by advancing tail with a compare-exchange, the same way
+// the consumer claims a frame, so whichever of them wins owns that frame and the other simply moves on.
+// Frame timestamps are mirrored into their own atomic array so they can be peeked at without touching
+// the frames themselves.
+//
+// The effect engine can stand in for the stream when it runs dry, which makes it a second producer.  The
+// two are serialized by a mutex that only producers ever take, so the consumer side stays lock free and
+// the socket thread only ever finds it uncontended while the stream is live.  Where the consumer has to
+// read a packed frame that's still queued, it publishes the frame's record first and the producer holds
+// off reusing it until it's done, rather than the two sharing a lock.
+//
+// With a compact QueueFormat, frames are packed into a FrameArena as they're pushed and the full frame goes
+// straight back to the pool, which then only needs enough frames for those in flight.  When the arena has
+// no room the oldest frames are dropped to make some, just as they are when the ring is full.  The draw
+// loop calls ExpandOldest() while it waits, so the next frame is normally expanded before it's due, and
+// PopOldestBuffer() expands any it finds still packed.
 
 class LEDBufferManager
 {
-    std::vector<std::unique_ptr<LEDBuffer>> _aptrBuffers;   // The circular array of buffer ptrs
-    size_t _iHeadIndex;                                     // Head pointer index
-    size_t _iTailIndex;                                     // Tail pointer index
-    size_t _cMaxBuffers;                                    // Number of buffers
-    mutable std::recursive_mutex _mutex;                    // Recursive mutex to protect the buffer
+    struct alignas(kCacheLineSize) PaddedCounter
+    {
+        std::atomic<uint64_t> value { 0 };
+    };
 
-public:
-    explicit LEDBufferManager(size_t cBuffers)
-        : _aptrBuffers(cBuffers), _iHeadIndex(0), _iTailIndex(0), _cMaxBuffers(cBuffers)
-    {}
+    // PackedFrame
+    //
+    // What expanding a packed frame needs from it, copied out so it can be checked as a whole
 
-    double AgeOfOldestBuffer() const
+    struct PackedFrame
+    {
+        std::span<const uint8_t> packed;
+        size_t                   cLeds;
+        uint64_t                 seconds;
+        uint64_t                 micros;
+        uint64_t                 serial;
+        int64_t                  queuedNanos;
+        size_t                   iDirtyFirst;
+        size_t                   iDirtyEnd;
+    };
+
+    PaddedCounter                               _head;          // Next slot the producer writes
+    PaddedCounter                               _tail;          // Oldest slot still in the queue
+    const size_t                                _cMaxBuffers;   // Number of buffers
+    const QueueFormat                           _format;        // How queued frames are held
+    std::unique_ptr<LEDBufferPool>              _pOwnedPool;    // The pool, unless it's shared with other channels
+    LEDBufferPool &                             _pool;          // Preallocated storage for every full frame we can hold
+    std::unique_ptr<std::atomic<LEDBuffer *>[]> _apBuffers;     // The circular array of buffer ptrs
+    std::unique_ptr<std::atomic<uint64_t>[]>    _aTimestamps;   // Due time of each slot, in nanos since the epoch
+    FrameSignal                                 _signal;        // Wakes the consumer for frames due sooner
+    PeakSlot                                    _peaks;         // Latest audio peaks, which skip the queue
+    std::mutex                                  _producerMutex; // Serializes the socket server and effect engine
+    std::atomic<int64_t>                        _lastStreamNanos { 0 }; // Monotonic time of the last streamed frame
+    bool                                        _bLastFromStream = true;   // Where the last frame queued came from
+    bool                                        _bFrameLost = false;       // A frame was dropped before it was queued
+    std::atomic<uint64_t>                       _cOverwritten { 0 };       // Frames this queue dropped to make room
+
+    // Only with a compact format
+
+    std::unique_ptr<LEDBufferPool>              _pPackedPool;   // Frames with no storage, which point into the arena
+    std::unique_ptr<FrameArena>                 _pArena;        // Where packed frames keep their bytes
+    std::unique_ptr<FramePacker>                _pPacker;       // Producer side
+    std::unique_ptr<FrameUnpacker>              _pUnpacker;     // Consumer side
+    std::unique_ptr<std::atomic<const uint8_t *>[]> _aRecords;  // Arena record of each slot's frame while it's packed
+    std::unique_ptr<uint8_t[]>                  _pExpandScratch; // Copy of the record ExpandOldest is working on
+    std::atomic<const uint8_t *>                _pExpanding { nullptr }; // Record the consumer is reading, which mustn't be reused
+    uint64_t                                    _expandedToken = UINT64_MAX;  // Tail when ExpandOldest last looked, consumer only
+    LEDBufferPtr                                _pExpanded;     // What ExpandOldest made of that frame, consumer only
+
+    static constexpr uint64_t TimestampOf(const LEDBuffer & buffer)
+    {
+        return buffer.TimestampNanos();
+    }
+
+    static double AgeOf(uint64_t timestamp, int64_t now)
     {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);  // Lock the mutex before accessing the buffer
+        return ((int64_t)timestamp - now) / (double)NANOS_PER_SECOND;
+    }
 
-        if (!IsEmpty())
+    // PeekTimestamps
+    //
+    // Reads head, tail and the timestamps at either end, retrying until head and tail are the same before
+    // and after, which means nothing was pushed or popped while we looked.  Returns the frame count.
+
+    size_t PeekTimestamps(uint64_t & oldest, uint64_t & newest) const
+    {
+        while (true)
         {
-            const auto & pOldest = _aptrBuffers[_iTailIndex].get();
-            return (pOldest->Seconds() + pOldest->MicroSeconds() / (double)MICROS_PER_SECOND) - CAppTime::CurrentTime();
+            const uint64_t tail = _tail.value.load(std::memory_order_acquire);
+            const uint64_t head = _head.value.load(std::memory_order_acquire);
+            if (head == tail)
+                return 0;
+
+            oldest = _aTimestamps[tail % _cMaxBuffers].load(std::memory_order_acquire);
+            newest = _aTimestamps[(head - 1) % _cMaxBuffers].load(std::memory_order_acquire);
+
+            if (_tail.value.load(std::memory_order_acquire) == tail && _head.value.load(std::memory_order_acquire) == head)
+                return std::min<size_t>(head - tail, _cMaxBuffers);
         }
-        return MAXDOUBLE;
     }
 
-    double AgeOfNewestBuffer() const
+    // ClaimOldest
+    //
+    // Takes the oldest frame out of the queue just as it's held there, packed or not.  Either side may claim,
+    // and a frame claimed by one is skipped by the other.
+
+    std::optional<LEDBufferPtr> ClaimOldest()
+    {
+        uint64_t tail = _tail.value.load(std::memory_order_acquire);
+        while (tail != _head.value.load(std::memory_order_acquire))
+        {
+            // The slot has to be read before we claim it, since once tail moves on the producer may reuse it.
+            // If the claim fails the other side took this frame out from under us, so we try the next one.
+
+            LEDBuffer * pBuffer = _apBuffers[tail % _cMaxBuffers].load(std::memory_order_acquire);
+            if (_tail.value.compare_exchange_weak(tail, tail + 1, std::memory_order_seq_cst, std::memory_order_acquire))
+                return std::optional<LEDBufferPtr>(LEDBufferPtr(pBuffer));
+        }
+        return std::nullopt;
+    }
+
+    // NoteOverwritten
+    //
+    // Counts a frame dropped to make room, both for this queue and in the pipeline totals
+
+    void NoteOverwritten()
+    {
+        _cOverwritten.fetch_add(1, std::memory_order_relaxed);
+        Metrics().framesOverwritten.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // ReleaseDropped
+    //
+    // Gives back a frame the producer dropped, once the consumer isn't copying its record.  ExpandOldest
+    // publishes the record before it checks the frame is still queued, and the claim is made before we look
+    // here, so one of us always sees the other.  Producer side.
+
+    void ReleaseDropped(LEDBufferPtr pDropped)
+    {
+        if (pDropped && pDropped->_pPacked)
+            while (_pExpanding.load(std::memory_order_seq_cst) == pDropped->_pPacked)
+                std::this_thread::yield();
+    }
+
+    static PackedFrame PackedFrameOf(const LEDBuffer & buffer)
+    {
+        return PackedFrame { buffer.PackedData(), buffer._cLeds, buffer._timeStampSeconds, buffer._timeStampMicroseconds,
+                             buffer._serial, buffer._queuedNanos, buffer._iDirtyFirst, buffer._iDirtyEnd };
+    }
+
+    // Pack
+    //
+    // Trades a full frame for a packed one, dropping the oldest frames until the arena has room for it.
+    // Returns an empty pointer if the frame can't be kept at all.  Producer side, under the mutex.
+
+    LEDBufferPtr Pack(LEDBufferPtr pFrame)
+    {
+        LEDBufferPtr pPacked = _pPackedPool->Acquire();
+        if (!pPacked)
+        {
+            NoteOverwritten();
+            return LEDBufferPtr();
+        }
+
+        std::span<const uint8_t> packed;
+        {
+            ScopedLatency timer(Metrics().packTime);
+            packed = _pPacker->Pack(pFrame->ColorData());
+        }
+
+        uint8_t * pData;
+        while (!(pData = _pArena->Allocate(packed.size())))
+        {
+            // The oldest record may be the frame the consumer just took, which it gives back as soon as it's
+            // expanded, so we wait for that rather than drop a frame that would leave us no better off
+
+            const uint8_t * pOldest = _pArena->OldestData();
+            if (pOldest && pOldest == _pExpanding.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::optional<LEDBufferPtr> pDropped = ClaimOldest();
+            NoteOverwritten();
+            if (!pDropped)
+                return LEDBufferPtr();                              // Too big for the arena even when it's empty
+            ReleaseDropped(std::move(*pDropped));
+        }
+        memcpy(pData, packed.data(), packed.size());
+
+        pPacked->_pPacked               = pData;
+        pPacked->_cbPacked              = packed.size();
+        pPacked->_cLeds                 = pFrame->_cLeds;
+        pPacked->_timeStampSeconds      = pFrame->_timeStampSeconds;
+        pPacked->_timeStampMicroseconds = pFrame->_timeStampMicroseconds;
+        pPacked->SetDirtyRange(pFrame->_iDirtyFirst, pFrame->_iDirtyEnd);
+        return pPacked;
+    }
+
+    // Expand
+    //
+    // A full frame from the pool holding what a packed one does, or an empty pointer if there's no frame
+    // free or the packed one doesn't expand.  Consumer side.
+
+    LEDBufferPtr Expand(const PackedFrame & frame)
+    {
+        LEDBufferPtr pFrame = _pool.Acquire();
+        if (!pFrame)
+        {
+            printf("No free frame buffers to expand a queued frame into\n");
+            return LEDBufferPtr();
+        }
+        if (frame.cLeds > pFrame->_cCapacity)
+            return LEDBufferPtr();
+
+        {
+            ScopedLatency timer(Metrics().unpackTime);
+            if (!_pUnpacker->Unpack(frame.packed, std::span<CRGB>(pFrame->_pLeds, frame.cLeds)))
+                return LEDBufferPtr();
+        }
+
+        pFrame->_cLeds                 = frame.cLeds;
+        pFrame->_timeStampSeconds      = frame.seconds;
+        pFrame->_timeStampMicroseconds = frame.micros;
+        pFrame->_serial                = frame.serial;
+        pFrame->_queuedNanos           = frame.queuedNanos;
+        pFrame->SetDirtyRange(frame.iDirtyFirst, frame.iDirtyEnd);
+        return pFrame;
+    }
+
+    LEDBufferManager(std::unique_ptr<LEDBufferPool> pOwnedPool, LEDBufferPool * pSharedPool, size_t cBuffers, size_t cLEDs, QueueFormat format)
+        : _cMaxBuffers(cBuffers),
+          _format(format),
+          _pOwnedPool(std::move(pOwnedPool)),
+          _pool(pSharedPool ? *pSharedPool : *_pOwnedPool),
+          _apBuffers(std::make_unique<std::atomic<LEDBuffer *>[]>(cBuffers)),
+          _aTimestamps(std::make_unique<std::atomic<uint64_t>[]>(cBuffers))
     {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);  // Lock the mutex before accessing the buffer
+        for (size_t i = 0; i < cBuffers; i++)
+            _apBuffers[i].store(nullptr, std::memory_order_relaxed);
 
-        if (!IsEmpty())
+        if (format != QueueFormat::Rgb24)
         {
-            // Find the index of the newest buffer
-            size_t newestIndex = (_iHeadIndex == 0) ? _cMaxBuffers - 1 : _iHeadIndex - 1;
-            const auto & pNewest = _aptrBuffers[newestIndex];
-            return (pNewest->Seconds() + pNewest->MicroSeconds() / (double)MICROS_PER_SECOND) - CAppTime::CurrentTime();
+            _pPackedPool = std::make_unique<LEDBufferPool>(cBuffers + kSpareFrameBuffers, 0);
+            _pArena      = std::make_unique<FrameArena>(ArenaSize(format, cBuffers, cLEDs));
+            _pPacker     = std::make_unique<FramePacker>(format, cLEDs);
+            _pUnpacker   = std::make_unique<FrameUnpacker>();
+            _aRecords    = std::make_unique<std::atomic<const uint8_t *>[]>(cBuffers);
+            _pExpandScratch = std::make_unique<uint8_t[]>(FramePacker::MaxPackedSize(cLEDs));
+            for (size_t i = 0; i < cBuffers; i++)
+                _aRecords[i].store(nullptr, std::memory_order_relaxed);
         }
+    }
+
+public:
+
+    // The pool holds enough frames to fill the queue plus the few that are in the hands of the producer and
+    // consumer at any moment, each big enough for cLEDs pixels.  With a compact format the queue holds packed
+    // frames instead, in an arena sized for cBuffers of them, and the pool only the frames in flight.
+
+    LEDBufferManager(size_t cBuffers, size_t cLEDs, QueueFormat format = QueueFormat::Rgb24)
+        : LEDBufferManager(std::make_unique<LEDBufferPool>(PoolFrames(format, cBuffers), cLEDs), nullptr, cBuffers, cLEDs, format)
+    {
+    }
+
+    // Several channels' managers can draw on one pool, so a frame can be read before anyone knows which
+    // channel it's for and then queued on that channel without being copied.  The pool must outlive us and
+    // hold PoolFrames() for each manager sharing it.
+
+    LEDBufferManager(LEDBufferPool & sharedPool, size_t cBuffers, QueueFormat format = QueueFormat::Rgb24)
+        : LEDBufferManager(nullptr, &sharedPool, cBuffers, sharedPool.LEDsPerBuffer(), format)
+    {
+    }
+
+    ~LEDBufferManager()
+    {
+        while (ClaimOldest())
+            ;
+    }
+
+    // PoolFrames
+    //
+    // Full frames the pool needs for a queue of cBuffers in the given format
+
+    static constexpr size_t PoolFrames(QueueFormat format, size_t cBuffers)
+    {
+        return format == QueueFormat::Rgb24 ? cBuffers + kSpareFrameBuffers : kSpareFrameBuffers + kExpandedFrameBuffers;
+    }
+
+    // ArenaSize
+    //
+    // Bytes of arena for cBuffers packed frames of cLEDs pixels, record headers included
+
+    static constexpr size_t ArenaSize(QueueFormat format, size_t cBuffers, size_t cLEDs)
+    {
+        return format == QueueFormat::Rgb24 ? 0 : cBuffers * (PackedFrameEstimate(format, cLEDs) + 16);
+    }
+
+    // MemoryBytes
+    //
+    // What the pool, if it's ours, and the arena took between them at startup
+
+    size_t MemoryBytes() const
+    {
+        return (_pOwnedPool ? _pOwnedPool->MemoryBytes() : 0) + (_pArena ? _pArena->Size() : 0);
+    }
+
+    constexpr QueueFormat Format() const
+    {
+        return _format;
+    }
+
+    LEDBufferManager(const LEDBufferManager &) = delete;
+    LEDBufferManager & operator=(const LEDBufferManager &) = delete;
+
+    double AgeOfOldestBuffer() const
+    {
+        uint64_t oldest, newest;
+        if (PeekTimestamps(oldest, newest))
+            return AgeOf(oldest, CAppTime::ServerNanos());
+        return MAXDOUBLE;
+    }
+
+    double AgeOfNewestBuffer() const
+    {
+        uint64_t oldest, newest;
+        if (PeekTimestamps(oldest, newest))
+            return AgeOf(newest, CAppTime::ServerNanos());
         return MAXDOUBLE;
     }
 
+    // OldestDueNanos
+    //
+    // When the oldest frame is due, in server nanoseconds, or nothing if the queue is empty.  Compare it
+    // against CAppTime::ServerNanos() rather than going through a double.
+
+    std::optional<int64_t> OldestDueNanos() const
+    {
+        uint64_t oldest, newest;
+        if (PeekTimestamps(oldest, newest))
+            return (int64_t)oldest;
+        return std::nullopt;
+    }
+
+    // Snapshot
+    //
+    // Size and both ages from a single consistent look at the queue
+
+    LEDBufferSnapshot Snapshot() const
+    {
+        uint64_t oldest, newest;
+        const size_t size = PeekTimestamps(oldest, newest);
+        if (size == 0)
+            return LEDBufferSnapshot { 0, MAXDOUBLE, MAXDOUBLE };
+
+        const int64_t now = CAppTime::ServerNanos();
+        return LEDBufferSnapshot { size, AgeOf(oldest, now), AgeOf(newest, now) };
+    }
+
+    // Signal
+    //
+    // How the consumer arranges to be woken when a frame is queued that's due before it expected
+
+    FrameSignal & Signal()
+    {
+        return _signal;
+    }
+
     constexpr size_t Capacity() const
     {
         return _cMaxBuffers;
     }
 
+    LEDBufferPool & Pool()
+    {
+        return _pool;
+    }
+
+    // Peaks
+    //
+    // The audio peaks ride alongside the frames rather than in the queue.  The producer publishes them and
+    // anything drawing can read the freshest set whenever it likes.
+
+    PeakSlot & Peaks()
+    {
+        return _peaks;
+    }
+
+    const PeakSlot & Peaks() const
+    {
+        return _peaks;
+    }
+
     size_t Size() const
     {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);  // Lock the mutex before accessing the buffer parameters
-        if (_iHeadIndex < _iTailIndex)
-            return (_iHeadIndex + _cMaxBuffers - _iTailIndex);
-        else
-            return _iHeadIndex - _iTailIndex;
+        const uint64_t tail = _tail.value.load(std::memory_order_acquire);
+        const uint64_t head = _head.value.load(std::memory_order_acquire);
+        return std::min<size_t>(head - tail, _cMaxBuffers);
     }
 
     bool IsEmpty() const
     {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);  // Lock the mutex before accessing the buffer head and tail
-        return _iHeadIndex == _iTailIndex;
+        return _head.value.load(std::memory_order_acquire) == _tail.value.load(std::memory_order_acquire);
     }
 
     // PopOldestBuffer
     //
-    // Uses move semantics to return ownership of the oldest buffer
+    // Uses move semantics to return ownership of the oldest buffer, expanded if it was still packed.
+    // Consumer side only.
     
-    std::optional<std::unique_ptr<LEDBuffer>> PopOldestBuffer()
+    std::optional<LEDBufferPtr> PopOldestBuffer()
+    {
+        if (!_pArena)
+            return ClaimOldest();
+
+        // Let the producer know which record we're about to take before taking it, since once the frame has
+        // left the queue the producer can neither drop it nor reclaim its record, and would otherwise go on
+        // dropping frames that free nothing.  If the producer claims the frame first we stand down and try
+        // the next one.  The record is only freed once we're done with it.
+
+        std::optional<LEDBufferPtr> pBuffer;
+        uint64_t tail = _tail.value.load(std::memory_order_acquire);
+        while (!pBuffer && tail != _head.value.load(std::memory_order_acquire))
+        {
+            _pExpanding.store(_aRecords[tail % _cMaxBuffers].load(std::memory_order_acquire), std::memory_order_seq_cst);
+            LEDBuffer * pOldest = _apBuffers[tail % _cMaxBuffers].load(std::memory_order_acquire);
+            if (_tail.value.compare_exchange_weak(tail, tail + 1, std::memory_order_seq_cst, std::memory_order_acquire))
+                pBuffer.emplace(pOldest);
+        }
+        if (!pBuffer || !(*pBuffer)->IsPacked())
+        {
+            _pExpanding.store(nullptr, std::memory_order_release);
+            return pBuffer;
+        }
+
+        // ExpandOldest may have got to this frame already
+
+        LEDBufferPtr pFrame = std::move(_pExpanded);
+        if (tail != _expandedToken || !pFrame)
+        {
+            pFrame.reset();
+            pFrame = Expand(PackedFrameOf(**pBuffer));
+        }
+        pBuffer->reset();
+        _pExpanding.store(nullptr, std::memory_order_release);
+
+        if (!pFrame)
+        {
+            Metrics().decodeErrors.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        return std::optional<LEDBufferPtr>(std::move(pFrame));
+    }
+
+    // ExpandOldest
+    //
+    // Expands the oldest frame ahead of time, if it's packed, so PopOldestBuffer has it ready when it comes
+    // due.  The frame stays queued, so the producer may drop it at any moment.  We publish its record before
+    // checking it's still the oldest, which keeps the producer from giving the frame back to be reused until
+    // we've copied the record out, and the expanding itself then runs on our copy.  If the frame is dropped
+    // before we're done, the result is simply thrown away.  Like the rest of the consumer side this takes
+    // no lock, and it's a no-op when frames aren't packed.
+
+    void ExpandOldest()
     {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);  // Lock the mutex before modifying the buffer
+        if (!_pArena)
+            return;
+
+        const uint64_t token = _tail.value.load(std::memory_order_acquire);
+        if (token == _expandedToken || token == _head.value.load(std::memory_order_acquire))
+            return;
+
+        const uint8_t *   pRecord = _aRecords[token % _cMaxBuffers].load(std::memory_order_acquire);
+        const LEDBuffer * pOldest = _apBuffers[token % _cMaxBuffers].load(std::memory_order_acquire);
+        _pExpanding.store(pRecord, std::memory_order_seq_cst);
+        if (_tail.value.load(std::memory_order_seq_cst) != token)
+        {
+            _pExpanding.store(nullptr, std::memory_order_release);
+            return;
+        }
 
-        if (IsEmpty()) 
-            return std::nullopt;  // Return empty optional if the buffer is empty
+        PackedFrame frame = PackedFrameOf(*pOldest);
+        std::copy(frame.packed.begin(), frame.packed.end(), _pExpandScratch.get());
+        frame.packed = std::span<const uint8_t>(_pExpandScratch.get(), frame.packed.size());
+        _pExpanding.store(nullptr, std::memory_order_release);
 
-        auto pResult = std::move(_aptrBuffers[_iTailIndex]);
-        _iTailIndex = (_iTailIndex + 1) % _cMaxBuffers;
+        // A frame that doesn't expand is left for PopOldestBuffer to find and count
 
-        return std::optional<std::unique_ptr<LEDBuffer>>(std::move(pResult));
+        _expandedToken = token;
+        _pExpanded.reset();
+        if (!frame.packed.empty())
+            _pExpanded = Expand(frame);
+    }
+
+    // FramesOverwritten
+    //
+    // How many frames this queue has dropped to make room, where Metrics() has the total across channels
+
+    uint64_t FramesOverwritten() const
+    {
+        return _cOverwritten.load(std::memory_order_relaxed);
+    }
+
+    // NanosSinceStreamFrame
+    //
+    // How long since the network last queued a frame, or INT64_MAX if it never has
+
+    int64_t NanosSinceStreamFrame() const
+    {
+        const int64_t last = _lastStreamNanos.load(std::memory_order_relaxed);
+        return last == 0 ? INT64_MAX : CAppTime::MonotonicNanos() - last;
     }
 
     // PushNewBuffer
     //
-    // Uses move semantics to take ownership of the incoming buffer
+    // Uses move semantics to take ownership of the incoming buffer.  Producer side only.  Frames made
+    // locally rather than received pass bFromStream as false, so they don't count as the stream.
 
-    void PushNewBuffer(std::unique_ptr<LEDBuffer> pBuffer)
+    void PushNewBuffer(LEDBufferPtr pBuffer, bool bFromStream = true)
     {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);  // Lock the mutex before modifying the buffer
+        std::lock_guard<std::mutex> lock(_producerMutex);
 
-        // If the queue is full, pop the oldest buffer to make space
-        if ((_iHeadIndex + 1) % _cMaxBuffers == _iTailIndex)
-            _iTailIndex = (_iTailIndex + 1) % _cMaxBuffers;
+        // Serials run on across both sources, but a stream frame's dirty range was narrowed against the last
+        // stream frame, not whatever the effect queued in between, so a frame from the other source than the
+        // one before it is redrawn in full.  So is the frame after one that couldn't be packed, since it was
+        // narrowed against a frame that never got a serial and so leaves no gap for the consumer to see.
 
-        // Insert the new buffer.  If this overwrites an existing buffer, it will be destroyed and freed
-        _aptrBuffers[_iHeadIndex] = std::move(pBuffer);
+        if (bFromStream != _bLastFromStream || _bFrameLost)
+            pBuffer->SetAllDirty();
+        _bLastFromStream = bFromStream;
+        _bFrameLost      = false;
 
-        // Advance head index around the circular buffer
-        _iHeadIndex = (_iHeadIndex + 1) % _cMaxBuffers;
+        if (_pArena)
+        {
+            pBuffer = Pack(std::move(pBuffer));
+            if (!pBuffer)
+            {
+                _bFrameLost = true;
+                return;
+            }
+        }
+
+        const uint64_t head = _head.value.load(std::memory_order_relaxed);
+        uint64_t       tail = _tail.value.load(std::memory_order_acquire);
+        auto &         slot = _apBuffers[head % _cMaxBuffers];
+
+        // If the queue is full, drop the oldest buffer to make space.  It lives in the very slot we are about
+        // to fill.  If the consumer beats us to it, it owns that frame now and there is room anyway.  A
+        // dropped frame goes back to the pool once the consumer isn't reading it.
+
+        if (head - tail >= _cMaxBuffers)
+            if (_tail.value.compare_exchange_strong(tail, tail + 1, std::memory_order_seq_cst, std::memory_order_acquire))
+            {
+                ReleaseDropped(LEDBufferPtr(slot.load(std::memory_order_relaxed)));
+                NoteOverwritten();
+            }
+
+        const uint64_t timestamp = TimestampOf(*pBuffer);
+        pBuffer->_serial      = head + 1;
+        pBuffer->_queuedNanos = CAppTime::MonotonicNanos();
+        if (bFromStream)
+            _lastStreamNanos.store(pBuffer->_queuedNanos, std::memory_order_relaxed);
+        _aTimestamps[head % _cMaxBuffers].store(timestamp, std::memory_order_release);
+        if (_pArena)
+            _aRecords[head % _cMaxBuffers].store(pBuffer->_pPacked, std::memory_order_release);
+        slot.store(pBuffer.release(), std::memory_order_release);
+
+        // Advance head index around the circular buffer, which publishes the new frame to the consumer,
+        // and wake the consumer if it's asleep waiting on something later
+
+        _head.value.store(head + 1, std::memory_order_release);
+        _signal.FrameQueued((int64_t)timestamp);
     }
-};
\ No newline at end of file
+};
@@ -34,7 +34,13 @@
 #include "globals.h"
 #include "ledbuffer.h"
 #include "socketserver.h"
+#include "flowcontrol.h"
 #include "matrixdraw.h"
+#include "metricsserver.h"
+#include "effectengine.h"
+#include "replay.h"
+#include "options.h"
+#include "channelset.h"
 
 using rgb_matrix::RGBMatrix;
 
@@ -46,16 +52,15 @@ static void InterruptHandler(int signo)
     interrupt_received = true;
 }
 
-double MatrixDraw::_FPS = 0.0;
-
 // usage
 //
 // Display the command line usage options
 
 int usage(const char *progname) 
 {
-    fprintf(stderr, "Usage: %s [led-matrix-options]\n", progname);
+    fprintf(stderr, "Usage: %s [led-matrix-options] [ndpi-options]\n", progname);
     rgb_matrix::PrintMatrixFlags(stderr);
+    PrintNDPiOptions(stderr);
     return 1;
 }
 
@@ -89,8 +94,21 @@ int main(int argc, char *argv[])
     rgb_matrix::RuntimeOptions runtime_opt;
     if (!rgb_matrix::ParseOptionsFromFlags(&argc, &argv, &matrix_options, &runtime_opt)) 
         return usage(argv[0]);
+
+    // Whatever the matrix library didn't consume is for us
+    NDPiOptions options;
+    if (!ParseNDPiOptions(argc, argv, options))
+        return usage(argv[0]);
+
     runtime_opt.gpio_slowdown = kDefaultGPIOSlowdown;
 
+    // Creating the matrix drops us to an unprivileged user, so anything realtime needs root for is set
+    // up now, and each thread sets its own priority within what's been allowed once it's running
+
+    const int maxPriority = std::max({ options.socketTuning.priority, options.decodeTuning.priority, options.drawTuning.priority });
+    if (maxPriority > 0 || options.lockMemory)
+        ReserveRealtimeLimits(maxPriority, options.lockMemory);
+
     RGBMatrix *matrix = RGBMatrix::CreateFromOptions(matrix_options, runtime_opt);
     if (!matrix)
     {
@@ -98,25 +116,126 @@ int main(int argc, char *argv[])
          	return 1;
     }   
 
-    const auto maxLEDs = matrix->width() * matrix->height();
+    // Each channel gets an equal band of the matrix, top to bottom, which has to be whole rows of panels
+
+    const size_t cChannels = options.channels;
+    if (matrix->height() % (cChannels * matrix_options.rows) != 0)
+    {
+        fprintf(stderr, "The matrix's %d rows of pixels don't split into %zu bands of whole %d row panels\n",
+                matrix->height(), cChannels, matrix_options.rows);
+        delete matrix;
+        return 1;
+    }
+
+    const int bandHeight = matrix->height() / (int)cChannels;
+    if (!Layout::Fits(options.layout, matrix->width(), bandHeight, matrix_options.cols, matrix_options.rows))
+    {
+        fprintf(stderr, "Layout grid doesn't hold the %d panels of %dx%d in %s\n",
+                (matrix->width() / matrix_options.cols) * (bandHeight / matrix_options.rows), matrix_options.cols, matrix_options.rows,
+                cChannels == 1 ? "the matrix" : "each channel's band");
+        delete matrix;
+        return 1;
+    }
+
+    const auto maxLEDs     = matrix->width() * matrix->height();
+    const auto channelLEDs = matrix->width() * bandHeight;
     printf("Matrix Size: %dx%d (%d LEDs)\n", matrix->width(), matrix->height(), maxLEDs);
     matrix->Fill(0, 0, 128);
 
-    LEDBufferManager bufferManager(kMaxBuffers);
-    SocketServer socketServer(kIncomingSocketPort, maxLEDs);
+    // A recording to replay stands in for the network, so it's opened before anything starts listening
 
-    // Launch the socket server on its own thread to process incoming packets
+    std::shared_ptr<MappedRecording> pRecording;
+    if (!options.replayPath.empty() && !(pRecording = MappedRecording::Open(options.replayPath.c_str())))
+    {
+        delete matrix;
+        return 1;
+    }
+
+    // Every frame the queues can hold is allocated up front, so unless we're told how deep to make them,
+    // they're sized to the memory there is to spare, which keeps a Pi Zero 2 from pinning more than it can
+    // afford.  Each channel has a queue of its own, and frames that fill its band.
+
+    const size_t queueDepth = options.maxQueue ? options.maxQueue : QueueDepthForMemory(channelLEDs, options.queueFormat, cChannels);
+    ChannelSet   channelSet(cChannels, queueDepth, channelLEDs, options.queueFormat);
+    const auto   managers = channelSet.Managers();
+    if (cChannels == 1)
+        printf("Frame queue: %zu %s frames (%.1f MB)\n", queueDepth, QueueFormatName(options.queueFormat), channelSet.MemoryBytes() / 1e6);
+    else
+        printf("Frame queues: %zu channels from %d of %zu %s frames each (%.1f MB)\n",
+               cChannels, options.channel, queueDepth, QueueFormatName(options.queueFormat), channelSet.MemoryBytes() / 1e6);
 
-    if (socketServer.begin())
+    SocketServer socketServer(kIncomingSocketPort, channelLEDs, options);
+
+    // Launch the socket server, or the replay, on its own thread to produce frames.  It's joined before the
+    // server is shut down, so nothing is still reading from its sockets or writing a recording when it is.
+
+    if (pRecording || socketServer.begin())
     {
-        std::thread([&socketServer, &bufferManager]() 
+        std::thread sourceThread;
+        if (pRecording)
+        {
+            sourceThread = std::thread([&pRecording, &options, managers]()
+            {
+                TuneCurrentThread("replay", options.socketTuning);
+                RecordingPlayer(pRecording, options.replayFrom, options.replayLoop).RunLoop(managers, options.channel);
+            });
+        }
+        else
+        {
+            sourceThread = std::thread([&socketServer, managers, &options]()
+            {
+                TuneCurrentThread("socket", options.socketTuning);
+                socketServer.ProcessIncomingConnectionsLoop(managers);
+            });
+        }
+
+        // The draw thread is this one, and the blit and present threads it starts take its CPUs and priority
+        // with them
+
+        TuneCurrentThread("draw", options.drawTuning);
+        MatrixDraw matrixDraw(*matrix, matrix_options, options);
+
+        // Metrics get a thread of their own, so a slow scrape never holds up frames.  It watches for the
+        // interrupt too, and is joined before the objects it reports on go away.
+
+        MetricsServer metricsServer(options.metricsPort);
+        std::thread   metricsThread;
+        if (options.metricsPort != 0 && metricsServer.begin())
+        {
+            metricsThread = std::thread([&metricsServer, managers]()
+            {
+                TuneCurrentThread("metrics", ThreadTuning());
+                metricsServer.ServeLoop(managers);
+            });
+        }
+
+        // A local effect, if asked for, waits on its own thread for the stream to run dry and then draws in
+        // its place, at whatever size of frame the matrix wants.  Each channel runs dry on its own, so each
+        // gets an effect of its own.
+
+        std::vector<std::unique_ptr<EffectEngine>> effectEngines;
+        std::vector<std::thread>                   effectThreads;
+        if (!options.effect.empty())
         {
-            socketServer.ProcessIncomingConnectionsLoop(bufferManager);
-        }).detach();  // Detach to allow the thread to run independently
+            for (LEDBufferManager * pManager : managers)
+            {
+                effectEngines.push_back(std::make_unique<EffectEngine>(options.effect.c_str(), matrixDraw.FrameWidth(), matrixDraw.FrameHeight()));
+                effectThreads.emplace_back([pEngine = effectEngines.back().get(), pManager, &options]()
+                {
+                    TuneCurrentThread("effect", ThreadTuning { options.drawTuning.cpus, 0 });     // Not the draw priority, which it would starve
+                    pEngine->RunLoop(*pManager);
+                });
+            }
+        }
 
         // Loop forever, looking for frames to draw on the matrix until we are interrupted
-        MatrixDraw::RunDrawLoop(bufferManager, *matrix);
+        matrixDraw.RunDrawLoop(managers);
 
+        for (auto & effectThread : effectThreads)
+            effectThread.join();
+        if (metricsThread.joinable())
+            metricsThread.join();
+        sourceThread.join();
         socketServer.end();
     }
     delete matrix;
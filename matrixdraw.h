@@ -31,103 +31,436 @@
 
 #include "led-matrix.h"     // Raspberry Pi LED Matrix library
 #include "ledbuffer.h"      // The LED circular buffer manager
+#include "canvaspresenter.h" // Offscreen canvas pool and VSync swapping
+#include "options.h"        // RenderMode
+#include "blitter.h"        // Threaded frame-to-canvas copy
+#include "pixelmap.h"       // Frame to matrix pixel mapping
+#include "layout.h"         // Panel arrangement, compiled into a pixel map
+#include "framefit.h"       // Centering and scaling of frames that don't match the matrix
+#include "dirtytracker.h"   // Partial redraws of canvases that are nearly current
+#include "drawscheduler.h"  // Sleeps until the next frame is due
+#include "framepacer.h"     // Presentation policy for late frames
+#include "metrics.h"        // Per-stage latency histograms
+#include "powerlimiter.h"   // Dims frames that would overdraw the power supply
+#include "interpolator.h"   // Blends between frames at the refresh rate
 #include <thread>           // For spawning threads
+#include <vector>           // Per-channel draw state
 #include <chrono>           // Time and delays
-#include <omp.h>            // Include OpenMP header
 
 using rgb_matrix::RGBMatrix;
+using rgb_matrix::Canvas;
 
 extern volatile bool interrupt_received;
 
 class MatrixDraw
 {
-    static double _FPS;
+    // DrawChannel
+    //
+    // Everything that turns one channel's queue into its band of the matrix.  With a single channel the
+    // band is the whole matrix.  Each band has its own layout, pacing, dirty tracking and interpolation, and
+    // an even share of the power budget, so channels fed at different rates don't hold each other back.
+
+    struct DrawChannel
+    {
+        LEDBufferManager *                 pManager = nullptr;  // Bound when the loop starts
+        const size_t                       yOffset;             // First matrix row of the band
+        const Layout                       layout;              // Which logical pixel each matrix pixel shows
+        FrameFitter                        fitter;              // Where each logical pixel comes from in the frame
+        DirtyTracker                       dirtyTracker;        // What each canvas needs redrawn to catch up
+        FramePacer                         pacer;               // Which late frames get shown
+        PowerLimiter                       powerLimiter;        // Keeps frames within the band's share of the budget
+        std::unique_ptr<FrameInterpolator> pInterpolator;       // Blends between frames, if enabled
+        LEDBufferPtr                       pShown;              // Last frame off the queue to be shown
+        LEDBuffer *                        pCurrent   = nullptr;  // What the band shows now, or nothing yet
+        int64_t                            dueNanos   = 0;      // When pCurrent was meant to be seen
+        bool                               bChanged   = false;  // pCurrent moved on since the last present
+        uint32_t                           milliwatts = 0;      // Estimated draw of pCurrent
+
+        DrawChannel(const NDPiOptions & options, size_t width, size_t height, size_t y0, size_t panelWidth, size_t panelHeight, int refreshHz)
+            : yOffset(y0),
+              layout(options.layout, width, height, panelWidth, panelHeight),
+              fitter(layout, options.fitMode, options.resample, options.frameWidth),
+              pacer(options.policy, options.maxLatenessMs),
+              powerLimiter(options.powerLimitMilliwatts / options.channels)
+        {
+            if (options.interpolate)
+                pInterpolator = std::make_unique<FrameInterpolator>(width * height, refreshHz);
+        }
+    };
+
+    // Read by the socket and metrics threads for their reports
+
+    inline static std::atomic<double>   _FPS        { 0 };   // Smoothed rate at which frames are drawn
+    inline static std::atomic<int64_t>  _lastFrame  { 0 };   // Monotonic time of the last frame drawn
+    inline static std::atomic<uint32_t> _milliwatts { 0 };   // Estimated draw of the last frame, every band together
+    inline static std::atomic<double>   _brightness { 100 }; // Matrix brightness, in percent
+
+    RGBMatrix &                      _matrix;
+    std::vector<std::unique_ptr<DrawChannel>> _channels;    // One per band, top to bottom
+    const ColorLut                   _colorLut;             // Gamma and color correction, applied by the blitter
+    Blitter                          _blitter;              // Persistent workers that copy frames to canvases
+    std::unique_ptr<CanvasPresenter> _pPresenter;           // Offscreen canvases and VSync swapping, if enabled
+    DrawScheduler                    _scheduler;            // Timer and producer wakeups between frames
+    double                           _averageInterval;      // EWMA of the time between frames, in nanos
 
   protected:
 	
     // DrawFrame
     //
-    // Sends a frame's worth of color data to the matrix and then swaps it on the next VSync
+    // Sends a channel's current frame to its band of a canvas, which is either an offscreen FrameCanvas that
+    // will be swapped in on the next VSync or the live matrix itself.  Only the rows that changed since that
+    // canvas was last drawn are actually copied, and a band the canvas already has current isn't touched.
 	
-    static void DrawFrame(std::unique_ptr<LEDBuffer> & buffer, RGBMatrix & matrix)
+    void DrawFrame(DrawChannel & channel, Canvas & canvas)
+    {
+        if (!channel.pCurrent)
+            return;
+
+        std::span<const CRGB> source = channel.pCurrent->ColorData();
+        channel.fitter.Prepare(source.size());
+
+        size_t first, end, y0, y1;
+        channel.dirtyTracker.RegionFor(&canvas, first, end);
+        if (first >= end)
+            return;
+
+        ScopedLatency timer(Metrics().blitTime);
+
+        // Bilinear scaling spreads every frame pixel over its neighbours, so it redraws in full
+
+        if (channel.fitter.IsResampling())
+        {
+            source = channel.fitter.Resample(source);
+            first  = 0;
+            end    = SIZE_MAX;
+        }
+
+        const PixelMap & map = channel.fitter.Map();
+        if (!map.DestinationRows(first, end, y0, y1))
+        {
+            y0 = 0;
+            y1 = map.Height();
+        }
+
+        _blitter.Blit(source.data(), source.size(), map, canvas, y0, y1, channel.yOffset);
+    }
+
+    // Present
+    //
+    // Brings every band up to date and gets the result onto the panel, through the presenter in VSync mode
+    // or straight onto the live matrix otherwise.  The frame time it was meant to be seen is the earliest
+    // of those that changed.
+
+    void Present()
+    {
+        UpdateFrameRate();
+
+        int64_t  dueNanos   = INT64_MAX;
+        uint32_t milliwatts = 0;
+        for (auto & pChannel : _channels)
+        {
+            if (pChannel->bChanged)
+                dueNanos = std::min(dueNanos, pChannel->dueNanos);
+            pChannel->bChanged = false;
+            milliwatts += pChannel->milliwatts;
+        }
+        _milliwatts.store(milliwatts, std::memory_order_relaxed);
+
+        if (_pPresenter)
+        {
+            FrameCanvas * pCanvas = _pPresenter->AcquireCanvas();
+            for (auto & pChannel : _channels)
+                DrawFrame(*pChannel, *pCanvas);
+            _pPresenter->Present(pCanvas, dueNanos);
+        }
+        else
+        {
+            for (auto & pChannel : _channels)
+                DrawFrame(*pChannel, _matrix);
+            Metrics().RecordPresentation(dueNanos, CAppTime::ServerNanos());
+        }
+    }
+
+    // Interpolate
+    //
+    // Renders the interpolator's output for the current frame time, if it has anything new, and makes it what
+    // the band shows.  Its frames aren't the queue's, so it tells the dirty tracker itself what each one
+    // changed.
+
+    bool Interpolate(DrawChannel & channel)
+    {
+        const int64_t now = CAppTime::ServerNanos() - channel.pacer.PlayoutDelay();
+
+        TakeNextFrame(channel);
+
+        size_t first, end;
+        if (!channel.pInterpolator->Render(now, first, end))
+            return false;
+
+        channel.dirtyTracker.NoteRegion(first, end);
+        LimitPower(channel, channel.pInterpolator->Output());
+        channel.pCurrent = &channel.pInterpolator->Output();
+        channel.dueNanos = now;
+        channel.bChanged = true;
+        return true;
+    }
+
+    // TakeNextFrame
+    //
+    // Gives the interpolator the next frame off the queue, if it hasn't one and there is one
+
+    void TakeNextFrame(DrawChannel & channel)
+    {
+        if (channel.pInterpolator->HasNext())
+            return;
+
+        std::optional<LEDBufferPtr> buffer = channel.pManager->PopOldestBuffer();
+        if (buffer.has_value())
+            channel.pInterpolator->SetNext(std::move(buffer.value()));
+    }
+
+    // AdvanceInterpolated
+    //
+    // Advance for a channel that interpolates.  The frame the interpolator holds as its next stands at the
+    // head of the queue: once it's due the pacer decides on it, and if it's shown the blends start from it.
+
+    bool AdvanceInterpolated(DrawChannel & channel)
+    {
+        FrameInterpolator & interpolator = *channel.pInterpolator;
+        const int64_t       delay        = channel.pacer.PlayoutDelay();
+        while (true)
+        {
+            TakeNextFrame(channel);
+
+            const int64_t now = CAppTime::ServerNanos();
+            if (!interpolator.HasNext() || interpolator.NextDueNanos() + delay > now)
+            {
+                if (interpolator.HasCurrent() && now >= interpolator.NextTickNanos() + delay)
+                    return Interpolate(channel);
+                return false;
+            }
+
+            LEDBufferPtr pNext = interpolator.TakeNext();
+            Metrics().queueResidency.Record(CAppTime::MonotonicNanos() - pNext->QueuedNanos());
+
+            const bool bNextDue = NanosUntilOldestDue(channel).value_or(1) <= 0;
+            if (!channel.pacer.ShouldPresent(pNext->TimestampNanos(), now, bNextDue))
+                continue;
+
+            interpolator.SetCurrent(std::move(pNext));
+            return Interpolate(channel);
+        }
+    }
+
+    // Advance
+    //
+    // Moves a channel on to the frame it should show now, if that's changed: the next one off the queue the
+    // pacer wants shown, or when interpolating, the blend for this refresh.  Frames the pacer drops are
+    // passed over on the way.  Returns whether the band needs drawing.
+
+    bool Advance(DrawChannel & channel)
     {
-        static double lastTime = 0.0;
-        double currentTime = CAppTime::CurrentTime();
-        double delta = currentTime - lastTime + DBL_EPSILON;        // Add epsilon to avoid divide by zero
-        lastTime = currentTime;
-        _FPS =  1.0 / delta;
+        if (channel.pInterpolator)
+            return AdvanceInterpolated(channel);
+
+        LEDBufferManager & bufferManager = *channel.pManager;
+        while (true)
+        {
+            if (NanosUntilOldestDue(channel).value_or(1) > 0)
+                return false;
 
-        const size_t width = matrix.width();
-        const size_t height = matrix.height();
-        const size_t numpixels = width * height;
+            std::optional<LEDBufferPtr> buffer = bufferManager.PopOldestBuffer();
+            if (!buffer.has_value())
+                return false;
 
-        // TODO: This code could center a smaller buffer on the matrix or scale it up to fill the matrix
-        //       if the matrix is larger than the frame, but for now, we just require that the frames being
-        //       sent are the same size as the matrix.
+            Metrics().queueResidency.Record(CAppTime::MonotonicNanos() - buffer.value()->QueuedNanos());
+            channel.dirtyTracker.NoteFrame(*buffer.value());
 
-        if (buffer->ColorData().size() > numpixels)
-            throw std::runtime_error("More data received than matrix can accomodate");
-            
-        // Process the entire frame in a single loop for better cache locality
+            const int64_t due      = buffer.value()->TimestampNanos();
+            const bool    bNextDue = NanosUntilOldestDue(channel).value_or(1) <= 0;
+            if (!channel.pacer.ShouldPresent(due, CAppTime::ServerNanos(), bNextDue))
+                continue;
 
-        #pragma omp parallel for
-        for (size_t idx = 0; idx < numpixels; ++idx)
+            LimitPower(channel, *buffer.value());
+            channel.pShown   = std::move(buffer.value());
+            channel.pCurrent = channel.pShown.get();
+            channel.dueNanos = due;
+            channel.bChanged = true;
+            return true;
+        }
+    }
+
+    // UpdateFrameRate
+    //
+    // Folds the interval since the last frame into the average frame rate.  Averaging intervals rather than
+    // rates means one long stall doesn't get lost among quick frames.
+
+    void UpdateFrameRate()
+    {
+        const int64_t now  = CAppTime::MonotonicNanos();
+        const int64_t last = _lastFrame.exchange(now, std::memory_order_relaxed);
+        if (last != 0)
         {
-            const int x = idx % width;
-            const int y = idx / width;
+            const double interval = (double)std::min<int64_t>(now - last, NANOS_PER_SECOND);
+            _averageInterval = _averageInterval == 0 ? interval : _averageInterval + kFPSSmoothing * (interval - _averageInterval);
+            _FPS.store(NANOS_PER_SECOND / (_averageInterval + DBL_EPSILON), std::memory_order_relaxed);
+        }
+    }
 
-            // Get the pixel color
-            const CRGB color = buffer->ColorData()[idx];
+    // LimitPower
+    //
+    // Dims the frame if it would overdraw the band's power budget and records what it will draw.  When the
+    // dimming changes, every pixel of the band on every canvas is stale, not just the ones that changed in
+    // the frame.
+
+    void LimitPower(DrawChannel & channel, LEDBuffer & buffer)
+    {
+        const uint8_t brightness = _matrix.brightness();
+        bool          bScaleChanged;
+
+        channel.milliwatts = channel.powerLimiter.Apply(buffer.ColorData(), brightness, bScaleChanged);
+        if (bScaleChanged)
+            channel.dirtyTracker.Reset();
+
+        _brightness.store(brightness, std::memory_order_relaxed);
+    }
+
+    // NanosUntilOldestDue
+    //
+    // How long until the oldest frame should be shown, allowing for any playout delay, negative if it's
+    // overdue, or nothing if there isn't one
 
-            // Set the pixel in the matrix (x is flipped)
-            matrix.SetPixel(matrix.width() - 1 - x, y, color.r, color.g, color.b);
+    std::optional<int64_t> NanosUntilOldestDue(const DrawChannel & channel) const
+    {
+        const auto due = channel.pManager->OldestDueNanos();
+        if (!due)
+            return std::nullopt;
+        return *due + channel.pacer.PlayoutDelay() - CAppTime::ServerNanos();
+    }
+
+    // WaitForFrames
+    //
+    // Sleeps until any channel has something to show.  If a queue holds packed frames, its next one is
+    // expanded first, while there's time.
+
+    void WaitForFrames()
+    {
+        DrawScheduler::WaitSource sources[kMaxChannels];
+        int64_t                   wakeBy = INT64_MAX;
+        for (size_t i = 0; i < _channels.size(); i++)
+        {
+            DrawChannel & channel = *_channels[i];
+            channel.pManager->ExpandOldest();
+            if (channel.pInterpolator && channel.pInterpolator->HasCurrent())
+                wakeBy = std::min(wakeBy, channel.pInterpolator->NextTickNanos() + channel.pacer.PlayoutDelay());
+            if (channel.pInterpolator && channel.pInterpolator->HasNext())
+                wakeBy = std::min(wakeBy, channel.pInterpolator->NextDueNanos() + channel.pacer.PlayoutDelay());
+            sources[i] = { channel.pManager, channel.pacer.PlayoutDelay() };
         }
+        _scheduler.WaitForFrame(std::span<const DrawScheduler::WaitSource>(sources, _channels.size()), wakeBy);
     }
 
   public:
 
+    // The blitter splits work by panel, which is only safe when the matrix library isn't remapping pixels
+    // itself, so a library pixel mapper drops us back to a single thread.  Our own --layout has no such
+    // problem, since it only changes which frame pixel each matrix pixel reads.  With several channels the
+    // matrix is cut into as many bands of equal height, each of which must be whole panels.
+
+    MatrixDraw(RGBMatrix & matrix, const RGBMatrix::Options & matrixOptions, const NDPiOptions & options)
+        : _matrix(matrix),
+          _colorLut(options.gamma, options.whiteBalance, options.colorTemperature),
+          _blitter(matrix.width(),
+                   matrixOptions.cols,
+                   (matrixOptions.pixel_mapper_config && *matrixOptions.pixel_mapper_config) ? 1 : options.blitThreads,
+                   &_colorLut),
+          _averageInterval(0)
+    {
+        const int    refreshHz  = matrixOptions.limit_refresh_rate_hz > 0 ? matrixOptions.limit_refresh_rate_hz : kDefaultRefreshRate;
+        const size_t bandHeight = matrix.height() / options.channels;
+        for (size_t i = 0; i < options.channels; i++)
+            _channels.push_back(std::make_unique<DrawChannel>(options, matrix.width(), bandHeight, i * bandHeight,
+                                                              matrixOptions.cols, matrixOptions.rows, refreshHz));
+
+        if (options.renderMode == RenderMode::VSync)
+            _pPresenter = std::make_unique<CanvasPresenter>(matrix);
+    }
+
     // FPS
     // 
-    // The framerate as of the last drawing operation
+    // The smoothed framerate, which falls away once frames stop arriving rather than sticking at the last rate
 
     static double FPS()
     {
-        return _FPS;
+        const int64_t sinceLast = CAppTime::MonotonicNanos() - _lastFrame.load(std::memory_order_relaxed);
+        return std::min(_FPS.load(std::memory_order_relaxed), (double)NANOS_PER_SECOND / std::max<int64_t>(sinceLast, 1));
     }
 
-    // RunDrawLoop
-    // 
-    // Loops looking for frames that have matured on the buffer manager, then drawing them on the matrix as they do
+    static uint32_t Milliwatts()
+    {
+        return _milliwatts.load(std::memory_order_relaxed);
+    }
 
-    static bool RunDrawLoop(LEDBufferManager & bufferManager, RGBMatrix & matrix)
+    static double Brightness()
     {
-        // If set to true, this will cause backlogged frames to be discarded.  If false, they will be drawn
-        // as fast as possible to catch up to the current time
-        constexpr auto burnExtraFrames = false;
+        return _brightness.load(std::memory_order_relaxed);
+    }
 
-        // How long to wait (micros) when no frames available in the buffer (about 1/24th of a second).  Can't be
-        // too long, as if frames come in it will take that long to catch up.  But can't be too short, as it would
-        // burn too much CPU spinning in a tight loop.  So this is a compromise that seems appropriate for video.
+    // FrameWidth, FrameHeight
+    //
+    // The size of frame that fills a channel's band of the matrix, given the layout and fit
 
-        constexpr auto kMaximumWait = 40000.0;  
+    size_t FrameWidth() const
+    {
+        return _channels.front()->fitter.FrameWidth();
+    }
 
-        while (!interrupt_received)
+    size_t FrameHeight() const
+    {
+        return _channels.front()->fitter.FrameHeight();
+    }
+
+    // RunDrawLoop
+    // 
+    // Loops looking for frames that have matured on the buffer managers, one per channel, then drawing them on
+    // the matrix as they do.  In VSync mode each frame is drawn offscreen and handed to the presenter, so it
+    // only ever appears whole.  Between frames the scheduler sleeps until exactly when the next one on any
+    // channel is due, or until a producer queues one that's due sooner.  Once a frame is off the queue, its
+    // channel's pacer decides whether it's still worth showing.  When interpolating, the next frame is taken
+    // off the queue early to blend toward, a frame that's shown becomes the one the interpolator blends from,
+    // and between frames the loop also wakes once per refresh to draw the next blend.  Channels that moved on together are presented together.
+
+    bool RunDrawLoop(std::span<LEDBufferManager * const> managers)
+    {
+        if (managers.size() != _channels.size())
         {
-            while (bufferManager.AgeOfOldestBuffer() <= 0)
-            {
-                std::optional<std::unique_ptr<LEDBuffer>> buffer = bufferManager.PopOldestBuffer();
-                if (!buffer.has_value())
-                    continue;
+            printf("The matrix has %zu bands but was given %zu queues\n", _channels.size(), managers.size());
+            return false;
+        }
+        for (size_t i = 0; i < managers.size(); i++)
+            _channels[i]->pManager = managers[i];
 
-                if (burnExtraFrames && bufferManager.AgeOfOldestBuffer() <= 0)
-                    continue;
+        while (!interrupt_received)
+        {
+            bool bChanged = false;
+            for (auto & pChannel : _channels)
+                bChanged = Advance(*pChannel) || bChanged;
 
-                DrawFrame(buffer.value(), matrix);
-            }
-            const int64_t delay = std::min(kMaximumWait, bufferManager.AgeOfOldestBuffer() * MICROS_PER_SECOND);
-            if (delay > 0)
-                std::this_thread::sleep_for(std::chrono::microseconds(delay));
+            if (bChanged)
+                Present();
+            else
+                WaitForFrames();
         }
+
+        printf("Presented %llu frames and dropped %llu with the %s policy\n",
+               (unsigned long long)Metrics().framesPresented.load(), (unsigned long long)Metrics().framesDropped.load(),
+               PresentationPolicyName(_channels.front()->pacer.Policy()));
 	    return true;
     }
+
+    bool RunDrawLoop(LEDBufferManager & bufferManager)
+    {
+        LEDBufferManager * const pManager = &bufferManager;
+        return RunDrawLoop(std::span<LEDBufferManager * const>(&pManager, 1));
+    }
 };
@@ -0,0 +1,221 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Metrics.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Lock-free latency histograms and counters for each stage of the
+//    pipeline, written in Prometheus text format by the MetricsServer.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <bit>
+#include <string>
+#include <algorithm>
+
+#include "globals.h"
+#include "apptime.h"
+
+// LatencyHistogram
+//
+// Power-of-two buckets from 1us up to about 16s, plus one for anything longer.  Recording is a couple of
+// relaxed atomic adds, so any thread can record from its hot path; readers see each bucket exactly but
+// not necessarily all of them from the same instant, which is all Prometheus asks for.
+
+class alignas(kCacheLineSize) LatencyHistogram
+{
+  public:
+
+    static constexpr size_t kBuckets = 26;                  // Bucket i holds values up to 2^i us; the last, +Inf
+
+  private:
+
+    std::atomic<uint64_t> _aCounts[kBuckets];
+    std::atomic<uint64_t> _sumNanos;
+
+  public:
+
+    LatencyHistogram() : _sumNanos(0)
+    {
+        for (auto & count : _aCounts)
+            count.store(0, std::memory_order_relaxed);
+    }
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram & operator=(const LatencyHistogram &) = delete;
+
+    void Record(int64_t nanos)
+    {
+        const uint64_t value  = (uint64_t)std::max<int64_t>(0, nanos);
+        const uint64_t micros = (value + NANOS_PER_MICRO - 1) / NANOS_PER_MICRO;
+        const size_t   bucket = micros <= 1 ? 0 : std::min<size_t>(std::bit_width(micros - 1), kBuckets - 1);
+
+        _aCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+        _sumNanos.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // Quantile
+    //
+    // The upper bound, in nanoseconds, of the bucket holding the given fraction of the values, so within a
+    // factor of two of the true quantile.  INT64_MAX if it falls in the last bucket, 0 if there are none.
+
+    int64_t Quantile(double fraction) const
+    {
+        uint64_t total = 0;
+        for (const auto & count : _aCounts)
+            total += count.load(std::memory_order_relaxed);
+        if (total == 0)
+            return 0;
+
+        const uint64_t rank       = std::max<uint64_t>(1, (uint64_t)(fraction * total + 0.5));
+        uint64_t       cumulative = 0;
+        for (size_t i = 0; i + 1 < kBuckets; i++)
+        {
+            cumulative += _aCounts[i].load(std::memory_order_relaxed);
+            if (cumulative >= rank)
+                return (int64_t)(1ull << i) * NANOS_PER_MICRO;
+        }
+        return INT64_MAX;
+    }
+
+    // Write
+    //
+    // Appends this histogram to a Prometheus text exposition, in seconds, with cumulative buckets
+
+    void Write(std::string & out, const char * name, const char * help) const
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+        out += line;
+
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < kBuckets; i++)
+        {
+            cumulative += _aCounts[i].load(std::memory_order_relaxed);
+            if (i + 1 < kBuckets)
+                snprintf(line, sizeof(line), "%s_bucket{le=\"%.9g\"} %llu\n", name, (double)(1ull << i) / MICROS_PER_SECOND, (unsigned long long)cumulative);
+            else
+                snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)cumulative);
+            out += line;
+        }
+
+        snprintf(line, sizeof(line), "%s_sum %.9f\n%s_count %llu\n", name,
+                 _sumNanos.load(std::memory_order_relaxed) / (double)NANOS_PER_SECOND, name, (unsigned long long)cumulative);
+        out += line;
+    }
+};
+
+// ScopedLatency
+//
+// Records how long it lived into a histogram
+
+class ScopedLatency
+{
+    LatencyHistogram & _histogram;
+    const int64_t      _start;
+
+  public:
+
+    explicit ScopedLatency(LatencyHistogram & histogram)
+        : _histogram(histogram), _start(CAppTime::MonotonicNanos())
+    {
+    }
+
+    ~ScopedLatency()
+    {
+        _histogram.Record(CAppTime::MonotonicNanos() - _start);
+    }
+};
+
+// PipelineMetrics
+//
+// One set for the whole process, reached through Metrics().  Besides the metrics server, the socket server
+// reads the counters to report them back to the master in the extended response.
+
+struct PipelineMetrics
+{
+    LatencyHistogram      readTime;                 // Each read() or recv() on a socket
+    LatencyHistogram      decompressTime;           // Expanding one compressed envelope
+    LatencyHistogram      queueResidency;           // From PushNewBuffer until the draw loop takes the frame
+    LatencyHistogram      presentedLate;            // How long after its timestamp each frame reached the panel
+    LatencyHistogram      presentedEarly;           // ...or before, for the few that make it early
+    LatencyHistogram      blitTime;                 // Copying a frame onto a canvas
+    LatencyHistogram      effectDrawTime;           // A local effect drawing one frame
+    LatencyHistogram      packTime;                 // Packing a frame into a compact queue format
+    LatencyHistogram      unpackTime;               // Expanding a packed frame again
+
+    std::atomic<uint64_t> framesPresented    { 0 }; // Shown by the presentation policy
+    std::atomic<uint64_t> framesDropped      { 0 }; // Judged too late to show by the presentation policy
+    std::atomic<uint64_t> framesLate         { 0 }; // Shown more than kLateFrameMs after their timestamp
+    std::atomic<uint64_t> framesOverwritten  { 0 }; // Dropped from a full queue to make room
+    std::atomic<uint64_t> decodeErrors       { 0 }; // Compressed envelopes that failed to expand
+    std::atomic<uint64_t> deltasDropped      { 0 }; // Deltas that didn't match our reference frame
+    std::atomic<uint64_t> udpPacketsComplete { 0 };
+    std::atomic<uint64_t> udpPacketsDropped  { 0 }; // Abandoned with fragments missing
+    std::atomic<uint64_t> peakPackets        { 0 }; // Audio peaks published to the side channel
+    std::atomic<uint64_t> effectFrames       { 0 }; // Drawn by the local effect while the stream was dry
+    std::atomic<uint64_t> effectOverruns     { 0 }; // Effect frames that took longer than their interval
+    std::atomic<uint64_t> effectFramesSkipped { 0 }; // Effect frames not drawn, to catch up or for want of a buffer
+    std::atomic<uint64_t> recordsDropped     { 0 }; // Recording records dropped because the disk fell behind
+
+    // RecordPresentation
+    //
+    // Files a frame under late or early depending on which side of its timestamp it was shown
+
+    void RecordPresentation(int64_t dueNanos, int64_t shownNanos)
+    {
+        if (shownNanos >= dueNanos)
+        {
+            presentedLate.Record(shownNanos - dueNanos);
+            if (shownNanos - dueNanos > kLateFrameMs * NANOS_PER_SECOND / 1000)
+                framesLate.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+            presentedEarly.Record(dueNanos - shownNanos);
+    }
+};
+
+inline PipelineMetrics & Metrics()
+{
+    static PipelineMetrics metrics;
+    return metrics;
+}
+
+inline void WriteCounter(std::string & out, const char * name, const char * help, uint64_t value)
+{
+    char line[256];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, (unsigned long long)value);
+    out += line;
+}
+
+inline void WriteGauge(std::string & out, const char * name, const char * help, double value)
+{
+    char line[256];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s gauge\n%s %g\n", name, help, name, name, value);
+    out += line;
+}
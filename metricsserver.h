@@ -0,0 +1,227 @@
+//+--------------------------------------------------------------------------
+//
+// File:        MetricsServer.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Serves the pipeline metrics over plain HTTP in the Prometheus text
+//    format, on a port of its own so scraping never gets in the way of
+//    the frame stream.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <cstdio>
+#include <span>
+#include <string>
+
+#include "globals.h"
+#include "metrics.h"
+#include "ledbuffer.h"
+#include "matrixdraw.h"
+
+extern volatile bool interrupt_received;
+
+// MetricsServer
+//
+// One request at a time on its own thread, which is plenty for a scraper or two.  Whatever the path, the
+// answer is the same page.  A client gets kMetricsClientTimeoutMs to send its request before we give up
+// on it, so a stuck scraper can't wedge the server.
+
+class MetricsServer
+{
+    int _port;
+    int _server_fd;
+
+    // RenderPage
+    //
+    // Builds the whole exposition from the global histograms and counters, the queues and the draw loop's
+    // gauges.  With several channels, the queue gauges are totals across all of them.
+
+    static std::string RenderPage(std::span<LEDBufferManager * const> managers)
+    {
+        PipelineMetrics & metrics = Metrics();
+        std::string       page;
+
+        size_t cQueued = 0, cCapacity = 0;
+        for (const LEDBufferManager * pManager : managers)
+        {
+            cQueued   += pManager->Size();
+            cCapacity += pManager->Capacity();
+        }
+
+        metrics.readTime.Write(page,       "ndpi_read_seconds",             "Time spent in each read or recv on a frame socket");
+        metrics.decompressTime.Write(page, "ndpi_decompress_seconds",       "Time spent expanding each compressed packet");
+        metrics.queueResidency.Write(page, "ndpi_queue_residency_seconds",  "Time from a frame being queued to the draw loop taking it");
+        metrics.blitTime.Write(page,       "ndpi_blit_seconds",             "Time spent copying each frame onto a canvas");
+        metrics.presentedLate.Write(page,  "ndpi_presented_late_seconds",   "How long after its timestamp each frame reached the panel");
+        metrics.presentedEarly.Write(page, "ndpi_presented_early_seconds",  "How long before its timestamp each early frame reached the panel");
+        metrics.effectDrawTime.Write(page, "ndpi_effect_draw_seconds",      "Time the local effect spent drawing each frame");
+        metrics.packTime.Write(page,       "ndpi_pack_seconds",             "Time spent packing each frame into the compact queue format");
+        metrics.unpackTime.Write(page,     "ndpi_unpack_seconds",           "Time spent expanding each packed frame");
+
+        WriteCounter(page, "ndpi_frames_presented_total",   "Frames the presentation policy showed",       metrics.framesPresented.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_frames_dropped_total",     "Frames the presentation policy dropped",      metrics.framesDropped.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_frames_late_total",        "Frames shown more than a refresh late",       metrics.framesLate.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_frames_overwritten_total", "Frames dropped from a full queue",            metrics.framesOverwritten.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_decode_errors_total",      "Compressed packets that failed to expand",    metrics.decodeErrors.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_deltas_dropped_total",     "Delta packets that did not match our frame",  metrics.deltasDropped.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_udp_packets_total",        "UDP packets fully reassembled",               metrics.udpPacketsComplete.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_udp_packets_dropped_total","UDP packets abandoned with fragments missing",metrics.udpPacketsDropped.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_peak_packets_total",       "Audio peak packets received",                 metrics.peakPackets.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_effect_frames_total",      "Frames drawn by the local effect",            metrics.effectFrames.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_effect_overruns_total",    "Effect frames that overran their budget",     metrics.effectOverruns.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_effect_frames_skipped_total", "Effect frames skipped to stay on time",    metrics.effectFramesSkipped.load(std::memory_order_relaxed));
+        WriteCounter(page, "ndpi_records_dropped_total",    "Recorded packets dropped by a slow disk",     metrics.recordsDropped.load(std::memory_order_relaxed));
+
+        WriteGauge(page, "ndpi_queue_depth",    "Frames waiting in the queue",              (double)cQueued);
+        WriteGauge(page, "ndpi_queue_capacity", "Frames the queue can hold",                (double)cCapacity);
+        WriteGauge(page, "ndpi_fps",            "Smoothed frame rate of the frames drawn",  MatrixDraw::FPS());
+        WriteGauge(page, "ndpi_power_watts",    "Estimated power draw of the last frame",   MatrixDraw::Milliwatts() / 1000.0);
+        WriteGauge(page, "ndpi_clock_offset_seconds", "Offset from the monotonic clock to server time",
+                   CAppTime::ServerOffsetNanos() / (double)NANOS_PER_SECOND);
+        return page;
+    }
+
+    // ServeClient
+    //
+    // Reads until the end of the request headers, or as much as fits, then writes the page and hangs up
+
+    void ServeClient(int fd, std::span<LEDBufferManager * const> managers)
+    {
+        timeval timeout = { kMetricsClientTimeoutMs / 1000, (kMetricsClientTimeoutMs % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        char   request[1024];
+        size_t cbRequest = 0;
+        while (cbRequest < sizeof(request) - 1)
+        {
+            ssize_t cbRead = read(fd, request + cbRequest, sizeof(request) - 1 - cbRequest);
+            if (cbRead <= 0)
+                return;
+            cbRequest += cbRead;
+            request[cbRequest] = 0;
+            if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+                break;
+        }
+
+        const std::string page = RenderPage(managers);
+        char header[160];
+        int cbHeader = snprintf(header, sizeof(header),
+                                "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                                page.size());
+
+        // A scraper that hangs up mid-page mustn't take the process down with SIGPIPE
+
+        if (send(fd, header, cbHeader, MSG_NOSIGNAL) == cbHeader)
+        {
+            size_t cbSent = 0;
+            while (cbSent < page.size())
+            {
+                ssize_t cbWritten = send(fd, page.data() + cbSent, page.size() - cbSent, MSG_NOSIGNAL);
+                if (cbWritten <= 0)
+                    break;
+                cbSent += cbWritten;
+            }
+        }
+    }
+
+  public:
+
+    explicit MetricsServer(int port) : _port(port), _server_fd(-1)
+    {
+    }
+
+    ~MetricsServer()
+    {
+        end();
+    }
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer & operator=(const MetricsServer &) = delete;
+
+    bool begin()
+    {
+        if ((_server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        {
+            perror("metrics socket");
+            return false;
+        }
+
+        int opt = 1;
+        setsockopt(_server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        sockaddr_in address = {};
+        address.sin_family      = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port        = htons(_port);
+
+        if (bind(_server_fd, (sockaddr *)&address, sizeof(address)) < 0 || listen(_server_fd, 4) < 0)
+        {
+            perror("metrics bind failed");
+            end();
+            return false;
+        }
+
+        printf("Serving metrics on port %d\n", _port);
+        return true;
+    }
+
+    void end()
+    {
+        if (_server_fd >= 0)
+        {
+            close(_server_fd);
+            _server_fd = -1;
+        }
+    }
+
+    // ServeLoop
+    //
+    // Answers scrapes until we're interrupted, waking every kSocketPollIntervalMs to check
+
+    void ServeLoop(std::span<LEDBufferManager * const> managers)
+    {
+        while (!interrupt_received && _server_fd >= 0)
+        {
+            pollfd fd = { _server_fd, POLLIN, 0 };
+            if (poll(&fd, 1, kSocketPollIntervalMs) <= 0)
+                continue;
+
+            int client = accept4(_server_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0)
+                continue;
+
+            ServeClient(client, managers);
+            close(client);
+        }
+    }
+};
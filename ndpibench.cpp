@@ -0,0 +1,583 @@
+//+--------------------------------------------------------------------------
+//
+// File:        NDPiBench.cpp
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Runs the whole pipeline - SocketServer, LEDBufferManager and
+//    MatrixDraw - against the simulated matrix, feeding it a synthetic or
+//    recorded stream over loopback, and reports throughput, latency and
+//    allocations per frame.  Needs no panels, so it runs anywhere.  Built
+//    with "make ndpi-bench".
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#include "led-matrix.h"     // The simulator's, from the include path
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "apptime.h"
+#include "globals.h"
+#include "metrics.h"
+#include "ledbuffer.h"
+#include "socketserver.h"
+#include "flowcontrol.h"
+#include "matrixdraw.h"
+#include "options.h"
+#include "colorlut.h"
+#include "wireencoder.h"
+#include "replay.h"
+
+using rgb_matrix::RGBMatrix;
+using rgb_matrix::FrameCanvas;
+
+volatile bool interrupt_received = false;
+
+constexpr int    kBenchPort        = 49160;              // Out of the way of a real ndpi on the same box
+constexpr size_t kSendRing         = 1 << 16;            // Send times kept, by sequence number
+constexpr size_t kMaxLatencySamples = 1 << 20;
+constexpr int    kVerifyEvery      = 16;                 // Presented frames checked pixel by pixel
+constexpr int    kDrainMs          = 500;                // Time after the last send for the queue to empty
+
+// Allocation counting
+//
+// Every operator new in the process comes through here, so allocations per frame covers the socket thread,
+// the draw loop and the presenter alike, along with anything the bench itself does while measuring, which
+// is nothing.  They're kept out of line so the compiler can't see malloc and free meeting new and delete.
+
+static std::atomic<uint64_t> g_cAllocations { 0 };
+
+[[gnu::noinline]] void * operator new(size_t cb)
+{
+    g_cAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void * p = malloc(cb ? cb : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+[[gnu::noinline]] void operator delete(void * p, size_t) noexcept
+{
+    free(p);
+}
+
+static void InterruptHandler(int signo)
+{
+    interrupt_received = true;
+}
+
+// BenchSettings
+//
+// The bench's own flags; everything else goes to the matrix simulator and then NDPi's option parser
+
+struct BenchSettings
+{
+    int         fps           = 60;                     // Synthetic frames per second, or 0 for flat out
+    double      seconds       = 10.0;                   // How long to measure for
+    double      warmupSeconds = 1.0;                    // Run before measuring, so pools and caches settle
+    int         compression   = -1;                     // zlib level for synthetic frames, or -1 to send raw
+    std::string recordingPath;                          // Send the packets of this recording instead
+};
+
+static bool ParseBenchFlags(int & argc, char * argv[], BenchSettings & settings)
+{
+    int kept = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        const char * arg = argv[i];
+        if (0 == strncmp(arg, "--fps=", 6))
+            settings.fps = std::max(0, atoi(arg + 6));
+        else if (0 == strncmp(arg, "--seconds=", 10))
+            settings.seconds = std::max(0.1, atof(arg + 10));
+        else if (0 == strncmp(arg, "--warmup=", 9))
+            settings.warmupSeconds = std::max(0.0, atof(arg + 9));
+        else if (0 == strncmp(arg, "--compress=", 11))
+        {
+            settings.compression = atoi(arg + 11);
+            if (settings.compression < -1 || settings.compression > 9)
+                return false;
+        }
+        else if (0 == strncmp(arg, "--recording=", 12))
+            settings.recordingPath = arg + 12;
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+    return true;
+}
+
+static int usage(const char * progname)
+{
+    fprintf(stderr, "Usage: %s [bench-options] [led-matrix-options] [ndpi-options]\n", progname);
+    fprintf(stderr, "Bench options:\n");
+    fprintf(stderr, "\t--fps=<n>                : Synthetic frames sent per second, or 0 for as fast as they'll go. Default: 60\n");
+    fprintf(stderr, "\t--seconds=<s>            : How long to measure. Default: 10\n");
+    fprintf(stderr, "\t--warmup=<s>             : How long to run before measuring. Default: 1\n");
+    fprintf(stderr, "\t--compress=<0-9>         : Send synthetic frames in zlib envelopes at this level. Default: raw\n");
+    fprintf(stderr, "\t--recording=<file>       : Send the packets of a recording, at their original pace, instead\n");
+    rgb_matrix::PrintMatrixFlags(stderr);
+    PrintNDPiOptions(stderr);
+    return 1;
+}
+
+// SyntheticFrame
+//
+// A frame that changes everywhere every time, with its sequence number in the first pixel so the swap
+// observer can tell which frame it's looking at.  Any frame can be made again from its number to check it.
+
+static void SyntheticFrame(std::span<CRGB> pixels, uint32_t sequence)
+{
+    for (size_t i = 0; i < pixels.size(); i++)
+        pixels[i] = CRGB((uint8_t)(i + sequence), (uint8_t)(i * 3 + sequence * 7), (uint8_t)((i >> 4) ^ sequence));
+    if (!pixels.empty())
+        pixels[0] = CRGB((uint8_t)(sequence >> 16), (uint8_t)(sequence >> 8), (uint8_t)sequence);
+}
+
+// BenchClient
+//
+// One TCP connection to the server under test.  Responses are read and thrown away on a thread of their
+// own, so the server never blocks on a full socket.
+
+class BenchClient
+{
+    int         _fd;
+    std::thread _drain;
+
+  public:
+
+    BenchClient() : _fd(-1)
+    {
+    }
+
+    ~BenchClient()
+    {
+        Close();
+    }
+
+    bool Connect(int port)
+    {
+        _fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (_fd < 0)
+            return false;
+
+        int opt = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        sockaddr_in address = {};
+        address.sin_family      = AF_INET;
+        address.sin_port        = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(_fd, (sockaddr *)&address, sizeof(address)) < 0)
+        {
+            perror("Can't connect to the server under test");
+            return false;
+        }
+
+        _drain = std::thread([this]()
+        {
+            uint8_t buffer[4096];
+            while (recv(_fd, buffer, sizeof(buffer), 0) > 0)
+                ;
+        });
+        return true;
+    }
+
+    bool Send(std::span<const uint8_t> packet)
+    {
+        while (!packet.empty())
+        {
+            const ssize_t cbSent = send(_fd, packet.data(), packet.size(), MSG_NOSIGNAL);
+            if (cbSent < 0 && errno == EINTR)
+                continue;
+            if (cbSent <= 0)
+                return false;
+            packet = packet.subspan(cbSent);
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if (_fd < 0)
+            return;
+        shutdown(_fd, SHUT_RDWR);
+        if (_drain.joinable())
+            _drain.join();
+        close(_fd);
+        _fd = -1;
+    }
+};
+
+// BenchResults
+//
+// Filled in by the swap observer on the presenter thread and by the sender, and read once both are done
+
+struct BenchResults
+{
+    std::unique_ptr<std::atomic<int64_t>[]> sendNanos = std::make_unique<std::atomic<int64_t>[]>(kSendRing);
+    std::vector<int64_t>  latencies;                    // Send to swap, for frames presented while measuring
+    std::atomic<bool>     bMeasuring    { false };
+    std::atomic<uint64_t> cPresented    { 0 };          // While measuring
+    std::atomic<uint64_t> cSent         { 0 };
+    std::atomic<uint64_t> cbSent        { 0 };
+    uint64_t              cVerified     = 0;
+    uint64_t              cMismatched   = 0;
+    uint64_t              allocsAtStart = 0;
+    uint64_t              allocsAtEnd   = 0;
+    uint64_t              presentedAtEnd = 0;
+    int64_t               measuredNanos = 0;
+};
+
+// Verify
+//
+// Whether the canvas shows exactly the synthetic frame it says it does
+
+static bool Verify(const FrameCanvas & canvas, uint32_t sequence, std::vector<CRGB> & expected)
+{
+    SyntheticFrame(expected, sequence);
+    for (int y = 0; y < canvas.height(); y++)
+        for (int x = 0; x < canvas.width(); x++)
+        {
+            uint8_t r, g, b;
+            canvas.GetPixel(x, y, &r, &g, &b);
+            const CRGB & want = expected[y * canvas.width() + x];
+            if (r != want.r || g != want.g || b != want.b)
+                return false;
+        }
+    return true;
+}
+
+// SendSynthetic
+//
+// Sends numbered frames at the target rate until the run is over
+
+static void SendSynthetic(BenchClient & client, const BenchSettings & settings, size_t cLeds, int64_t endNanos, BenchResults & results)
+{
+    WireEncoder       encoder(cLeds, settings.compression);
+    std::vector<CRGB> frame(cLeds);
+    const int64_t     interval = settings.fps ? NANOS_PER_SECOND / settings.fps : 0;
+    int64_t           next     = CAppTime::MonotonicNanos();
+
+    for (uint32_t sequence = 0; !interrupt_received && CAppTime::MonotonicNanos() < endNanos; sequence++)
+    {
+        SyntheticFrame(frame, sequence & 0xFFFFFF);
+        const int64_t now    = CAppTime::MonotonicNanos();
+        auto          packet = encoder.EncodeFrame(frame, 0, CAppTime::ServerNanos());
+
+        results.sendNanos[sequence % kSendRing].store(now, std::memory_order_release);
+        if (packet.empty() || !client.Send(packet))
+            return;
+        results.cSent.fetch_add(1, std::memory_order_relaxed);
+        results.cbSent.fetch_add(packet.size(), std::memory_order_relaxed);
+
+        if (interval)
+        {
+            next += interval;
+            CAppTime::SleepUntil(next);
+        }
+    }
+}
+
+// SendRecording
+//
+// Sends every packet of the recording as it originally arrived, with its original spacing, over and over
+// until the run is over
+
+static void SendRecording(BenchClient & client, const MappedRecording & recording, int64_t endNanos, BenchResults & results)
+{
+    const auto packets = recording.Scan({ RecordType::Wire });
+    if (packets.empty())
+    {
+        printf("Recording has no packets to send\n");
+        return;
+    }
+
+    while (!interrupt_received && CAppTime::MonotonicNanos() < endNanos)
+    {
+        const int64_t offset = CAppTime::MonotonicNanos() - packets.front().receivedNanos;
+        for (const auto & entry : packets)
+        {
+            CAppTime::SleepUntil(entry.receivedNanos + offset);
+            if (interrupt_received || CAppTime::MonotonicNanos() >= endNanos)
+                return;
+
+            uint8_t *            pPacket;
+            const RecordHeader * pRecord = recording.Record(entry, pPacket);
+            if (!pRecord || !client.Send(std::span<const uint8_t>(pPacket, pRecord->cbData)))
+                return;
+            results.cSent.fetch_add(1, std::memory_order_relaxed);
+            results.cbSent.fetch_add(pRecord->cbData, std::memory_order_relaxed);
+        }
+    }
+}
+
+static double Millis(int64_t nanos)
+{
+    return nanos / 1e6;
+}
+
+static void PrintStage(const char * name, const LatencyHistogram & histogram)
+{
+    auto format = [](int64_t nanos, char * text, size_t cb)
+    {
+        if (nanos == INT64_MAX)
+            snprintf(text, cb, "     >16s");
+        else
+            snprintf(text, cb, "%7.3fms", Millis(nanos));
+    };
+
+    if (histogram.Quantile(1.0) == 0)
+    {
+        printf("  %-18s no samples\n", name);
+        return;
+    }
+
+    char p50[32], p99[32];
+    format(histogram.Quantile(0.50), p50, sizeof(p50));
+    format(histogram.Quantile(0.99), p99, sizeof(p99));
+    printf("  %-18s p50 <%s  p99 <%s\n", name, p50, p99);
+}
+
+int main(int argc, char * argv[])
+{
+    signal(SIGTERM, InterruptHandler);
+    signal(SIGINT, InterruptHandler);
+
+    BenchSettings settings;
+    if (!ParseBenchFlags(argc, argv, settings))
+        return usage(argv[0]);
+
+    RGBMatrix::Options matrix_options;
+    matrix_options.rows                  = kDefualtRows;
+    matrix_options.cols                  = kDefaultColumns;
+    matrix_options.chain_length          = kDefaultChainLength;
+    matrix_options.limit_refresh_rate_hz = kDefaultRefreshRate;
+
+    rgb_matrix::RuntimeOptions runtime_opt;
+    if (!rgb_matrix::ParseOptionsFromFlags(&argc, &argv, &matrix_options, &runtime_opt))
+        return usage(argv[0]);
+
+    // Frames only come back off the canvas the way they went in without a layout or corrections in the way,
+    // which is what the bench defaults to, though any of NDPi's own options can still be given
+
+    NDPiOptions options;
+    options.layout.flipX = false;
+    if (!ParseNDPiOptions(argc, argv, options))
+        return usage(argv[0]);
+    if (options.channels != 1)
+    {
+        fprintf(stderr, "The bench drives a single channel\n");
+        return 1;
+    }
+
+    std::shared_ptr<MappedRecording> pRecording;
+    if (!settings.recordingPath.empty() && !(pRecording = MappedRecording::Open(settings.recordingPath.c_str())))
+        return 1;
+
+    const int maxPriority = std::max({ options.socketTuning.priority, options.decodeTuning.priority, options.drawTuning.priority });
+    if (maxPriority > 0 || options.lockMemory)
+        ReserveRealtimeLimits(maxPriority, options.lockMemory);
+
+    RGBMatrix * matrix = RGBMatrix::CreateFromOptions(matrix_options, runtime_opt);
+    if (!matrix)
+    {
+        fprintf(stderr, "Error creating the simulated matrix\n");
+        return 1;
+    }
+
+    if (!Layout::Fits(options.layout, matrix->width(), matrix->height(), matrix_options.cols, matrix_options.rows))
+    {
+        fprintf(stderr, "Layout grid doesn't fit the simulated matrix\n");
+        delete matrix;
+        return 1;
+    }
+
+    const size_t cLeds     = matrix->width() * matrix->height();
+    const bool   bIdentity = options.layout.gridColumns == 0 && !options.layout.flipX && !options.layout.flipY && options.layout.rotation == 0;
+    const bool   bSequenced = !pRecording && bIdentity && options.fitMode == FitMode::None && !options.interpolate
+                              && options.powerLimitMilliwatts == 0 && options.renderMode == RenderMode::VSync
+                              && options.queueFormat != QueueFormat::Rgb565
+                              && ColorLut(options.gamma, options.whiteBalance, options.colorTemperature).IsIdentity();
+
+    printf("Simulated matrix %dx%d at %d Hz, %s\n", matrix->width(), matrix->height(), matrix_options.limit_refresh_rate_hz,
+           pRecording ? settings.recordingPath.c_str()
+                      : settings.compression >= 0 ? "synthetic frames, zlib compressed" : "synthetic frames, raw");
+
+    BenchResults results;
+    results.latencies.reserve(kMaxLatencySamples);
+    std::vector<CRGB> expected(cLeds);
+    uint64_t          cObserved = 0;
+
+    // The observer runs on the presenter thread as each canvas goes on display
+
+    matrix->SetSwapObserver([&](const FrameCanvas & canvas)
+    {
+        const int64_t now = CAppTime::MonotonicNanos();
+        if (!results.bMeasuring.load(std::memory_order_acquire))
+            return;
+        results.cPresented.fetch_add(1, std::memory_order_relaxed);
+        if (!bSequenced)
+            return;
+
+        uint8_t r, g, b;
+        canvas.GetPixel(0, 0, &r, &g, &b);
+        const uint32_t sequence = (uint32_t)r << 16 | (uint32_t)g << 8 | b;
+        const int64_t  sent     = results.sendNanos[sequence % kSendRing].load(std::memory_order_acquire);
+        if (sent && results.latencies.size() < results.latencies.capacity())
+            results.latencies.push_back(now - sent);
+
+        if (++cObserved % kVerifyEvery == 0)
+        {
+            results.cVerified++;
+            if (!Verify(canvas, sequence, expected))
+                results.cMismatched++;
+        }
+    });
+
+    LEDBufferManager bufferManager(options.maxQueue ? options.maxQueue : QueueDepthForMemory(cLeds, options.queueFormat), cLeds, options.queueFormat);
+    SocketServer     socketServer(kBenchPort, cLeds, options);
+    if (!socketServer.begin())
+    {
+        delete matrix;
+        return 1;
+    }
+
+    std::thread socketThread([&socketServer, &bufferManager, &options]()
+    {
+        TuneCurrentThread("socket", options.socketTuning);
+        socketServer.ProcessIncomingConnectionsLoop(bufferManager);
+    });
+
+    TuneCurrentThread("draw", options.drawTuning);
+    MatrixDraw matrixDraw(*matrix, matrix_options, options);
+
+    // The sender runs the show: it warms up, measures, lets the queue drain and then stops everything
+
+    std::thread senderThread([&]()
+    {
+        BenchClient client;
+        if (!client.Connect(kBenchPort))
+        {
+            interrupt_received = true;
+            return;
+        }
+
+        const int64_t start        = CAppTime::MonotonicNanos();
+        const int64_t measureStart = start + (int64_t)(settings.warmupSeconds * NANOS_PER_SECOND);
+        const int64_t measureEnd   = measureStart + (int64_t)(settings.seconds * NANOS_PER_SECOND);
+
+        std::thread timer([&]()
+        {
+            CAppTime::SleepUntil(measureStart);
+            results.allocsAtStart = g_cAllocations.load(std::memory_order_relaxed);
+            results.cSent.store(0, std::memory_order_relaxed);
+            results.cbSent.store(0, std::memory_order_relaxed);
+            results.bMeasuring.store(true, std::memory_order_release);
+        });
+
+        if (pRecording)
+            SendRecording(client, *pRecording, measureEnd, results);
+        else
+            SendSynthetic(client, settings, cLeds, measureEnd, results);
+        timer.join();
+
+        results.bMeasuring.store(false, std::memory_order_release);
+        results.measuredNanos  = CAppTime::MonotonicNanos() - measureStart;
+        results.allocsAtEnd    = g_cAllocations.load(std::memory_order_relaxed);
+        results.presentedAtEnd = results.cPresented.load(std::memory_order_relaxed);
+
+        CAppTime::SleepUntil(CAppTime::MonotonicNanos() + kDrainMs * NANOS_PER_SECOND / 1000);
+        client.Close();
+        interrupt_received = true;
+    });
+
+    matrixDraw.RunDrawLoop(bufferManager);
+
+    senderThread.join();
+    socketThread.join();
+    socketServer.end();
+
+    // Report
+
+    const PipelineMetrics & metrics  = Metrics();
+    const double            seconds  = std::max<int64_t>(results.measuredNanos, 1) / (double)NANOS_PER_SECOND;
+    const uint64_t          cSent    = results.cSent.load();
+    const uint64_t          presented = results.presentedAtEnd;
+
+    printf("\nMeasured for %.2f seconds\n", seconds);
+    printf("  Sent               %llu packets, %.1f per second, %.2f MB/s\n", (unsigned long long)cSent, cSent / seconds, results.cbSent.load() / seconds / 1e6);
+    printf("  Presented          %llu frames, %.1f per second\n", (unsigned long long)presented, presented / seconds);
+    printf("  Queue              %zu %s frames in %.1f MB\n", bufferManager.Capacity(), QueueFormatName(bufferManager.Format()), bufferManager.MemoryBytes() / 1e6);
+    printf("  Not shown          %llu overwritten in the queue, %llu dropped late, over the whole run\n",
+           (unsigned long long)metrics.framesOverwritten.load(), (unsigned long long)metrics.framesDropped.load());
+
+    if (!results.latencies.empty())
+    {
+        auto & latencies = results.latencies;
+        std::sort(latencies.begin(), latencies.end());
+        auto at = [&](double fraction) { return Millis(latencies[std::min(latencies.size() - 1, (size_t)(fraction * latencies.size()))]); };
+        printf("  Send to swap       p50 %.3fms  p90 %.3fms  p99 %.3fms  max %.3fms over %zu frames\n",
+               at(0.50), at(0.90), at(0.99), Millis(latencies.back()), latencies.size());
+    }
+    else
+        printf("  Send to swap       not measured; it needs synthetic frames drawn without layout, fit, corrections or a lossy queue\n");
+
+    printf("  Stages, whole run:\n");
+    PrintStage("read",            metrics.readTime);
+    PrintStage("decompress",      metrics.decompressTime);
+    PrintStage("queue residency", metrics.queueResidency);
+    if (bufferManager.Format() != QueueFormat::Rgb24)
+    {
+        PrintStage("pack",            metrics.packTime);
+        PrintStage("unpack",          metrics.unpackTime);
+    }
+    PrintStage("blit",            metrics.blitTime);
+    PrintStage("presented late",  metrics.presentedLate);
+
+    printf("  Allocations        %.3f per frame presented\n",
+           presented ? (results.allocsAtEnd - results.allocsAtStart) / (double)presented : 0.0);
+
+    if (bSequenced)
+        printf("  Verified           %llu frames, %llu mismatched\n", (unsigned long long)results.cVerified, (unsigned long long)results.cMismatched);
+
+    delete matrix;
+    return (presented == 0 || results.cMismatched != 0) ? 1 : 0;
+}
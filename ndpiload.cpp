@@ -0,0 +1,639 @@
+//+--------------------------------------------------------------------------
+//
+// File:        NDPiLoad.cpp
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    A load generator that stands in for a NightDriver master.  It streams
+//    a pattern to an ndpi at each of a series of frame rates, over one or
+//    more connections, raw or in "DAVE" envelopes, and prints what was sent
+//    against what the SocketResponses say came of it: one row per rate, a
+//    throughput and latency curve to compare between builds and boards.
+//    Built with "make ndpi-load"; it needs no matrix library.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "apptime.h"
+#include "globals.h"
+#include "pixeltypes.h"
+#include "wireencoder.h"
+#include "socketresponse.h"
+#include "flowcontrol.h"
+
+volatile bool interrupt_received = false;
+
+constexpr size_t kLoadSendRing  = 4096;                 // Frames a connection can have sent but not yet heard about
+constexpr int    kLoadSettleMs  = 1000;                 // Pause between rates, for the queue to drain
+constexpr int    kLoadLingerMs  = 100;                  // Wait after each rate for the last responses
+
+static void InterruptHandler(int signo)
+{
+    interrupt_received = true;
+}
+
+enum class LoadPattern
+{
+    Solid,                                              // One color, changing every frame; compresses to nothing
+    Gradient,                                           // A moving rainbow; compresses moderately
+    Noise                                               // New random pixels every frame; doesn't compress at all
+};
+
+struct LoadSettings
+{
+    std::string      host        = "127.0.0.1";
+    int              port        = kIncomingSocketPort;
+    int              width       = kDefaultColumns * kDefaultChainLength;
+    int              height      = kDefualtRows;
+    uint16_t         channel16   = 0;                   // Everyone
+    std::vector<int> rates       = { 30, 60, 120, 240, 480 };
+    double           seconds     = 5.0;                 // At each rate
+    int              connections = 1;                   // The rate is shared among them
+    int              compression = -1;                  // zlib level, or -1 to send frames raw
+    LoadPattern      pattern     = LoadPattern::Gradient;
+    int              leadMs      = 0;                   // How far ahead of sending each frame is due
+    std::string      csvPath;                           // Write the curve here as well, if set
+    std::string      responsesPath;                     // Log every response here, if set
+};
+
+static int usage(const char * progname)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progname);
+    fprintf(stderr, "\t--host=<address>         : The ndpi to load. Default: 127.0.0.1\n");
+    fprintf(stderr, "\t--port=<port>            : Its port. Default: %d\n", kIncomingSocketPort);
+    fprintf(stderr, "\t--width=<n>              : Width of each frame. Default: %d\n", kDefaultColumns * kDefaultChainLength);
+    fprintf(stderr, "\t--height=<n>             : Height of each frame. Default: %d\n", kDefualtRows);
+    fprintf(stderr, "\t--channel=<bits>         : channel16 bits to address, or 0 for every node. Default: 0\n");
+    fprintf(stderr, "\t--rates=<fps,...>        : Frame rates to step through, 0 being as fast as it'll go. Default: 30,60,120,240,480\n");
+    fprintf(stderr, "\t--seconds=<s>            : How long to send at each rate. Default: 5\n");
+    fprintf(stderr, "\t--connections=<n>        : Connections to share each rate among. Default: 1\n");
+    fprintf(stderr, "\t--compress=<0-9>         : Send frames in zlib envelopes at this level. Default: raw\n");
+    fprintf(stderr, "\t--pattern=<name>         : solid, gradient or noise. Default: gradient\n");
+    fprintf(stderr, "\t--lead=<ms>              : How far in the future each frame is timestamped. Default: 0\n");
+    fprintf(stderr, "\t--csv=<file>             : Also write the results as CSV\n");
+    fprintf(stderr, "\t--responses=<file>       : Log every SocketResponse received, as CSV\n");
+    return 1;
+}
+
+static bool ParseRates(const char * psz, std::vector<int> & rates)
+{
+    rates.clear();
+    while (*psz)
+    {
+        char * pEnd;
+        const long rate = strtol(psz, &pEnd, 10);
+        if (pEnd == psz || rate < 0)
+            return false;
+        rates.push_back((int)rate);
+        psz = *pEnd == ',' ? pEnd + 1 : pEnd;
+        if (*pEnd && *pEnd != ',')
+            return false;
+    }
+    return !rates.empty();
+}
+
+static bool ParseLoadOptions(int argc, char * argv[], LoadSettings & settings)
+{
+    static const struct option longOptions[] =
+    {
+        { "host",         required_argument, nullptr, 'h' },
+        { "port",         required_argument, nullptr, 'p' },
+        { "width",        required_argument, nullptr, 'W' },
+        { "height",       required_argument, nullptr, 'H' },
+        { "channel",      required_argument, nullptr, 'c' },
+        { "rates",        required_argument, nullptr, 'r' },
+        { "seconds",      required_argument, nullptr, 's' },
+        { "connections",  required_argument, nullptr, 'n' },
+        { "compress",     required_argument, nullptr, 'z' },
+        { "pattern",      required_argument, nullptr, 'P' },
+        { "lead",         required_argument, nullptr, 'l' },
+        { "csv",          required_argument, nullptr, 'C' },
+        { "responses",    required_argument, nullptr, 'R' },
+        { nullptr,        0,                 nullptr, 0   }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+            case 'h':
+                settings.host = optarg;
+                break;
+
+            case 'p':
+                settings.port = atoi(optarg);
+                if (settings.port <= 0 || settings.port > 65535)
+                    return false;
+                break;
+
+            case 'W':
+                settings.width = atoi(optarg);
+                if (settings.width <= 0)
+                    return false;
+                break;
+
+            case 'H':
+                settings.height = atoi(optarg);
+                if (settings.height <= 0)
+                    return false;
+                break;
+
+            case 'c':
+                settings.channel16 = (uint16_t)strtoul(optarg, nullptr, 0);
+                break;
+
+            case 'r':
+                if (!ParseRates(optarg, settings.rates))
+                    return false;
+                break;
+
+            case 's':
+                settings.seconds = std::max(0.1, atof(optarg));
+                break;
+
+            case 'n':
+                settings.connections = std::max(1, atoi(optarg));
+                break;
+
+            case 'z':
+                settings.compression = atoi(optarg);
+                if (settings.compression < 0 || settings.compression > 9)
+                    return false;
+                break;
+
+            case 'P':
+                if (0 == strcmp(optarg, "solid"))
+                    settings.pattern = LoadPattern::Solid;
+                else if (0 == strcmp(optarg, "gradient"))
+                    settings.pattern = LoadPattern::Gradient;
+                else if (0 == strcmp(optarg, "noise"))
+                    settings.pattern = LoadPattern::Noise;
+                else
+                    return false;
+                break;
+
+            case 'l':
+                settings.leadMs = std::max(0, atoi(optarg));
+                break;
+
+            case 'C':
+                settings.csvPath = optarg;
+                break;
+
+            case 'R':
+                settings.responsesPath = optarg;
+                break;
+
+            default:
+                return false;
+        }
+    }
+    return optind == argc;
+}
+
+// FillPattern
+//
+// Draws one frame of the pattern.  The noise is a xorshift per connection, so it costs the sender very little.
+
+static void FillPattern(LoadPattern pattern, std::span<CRGB> pixels, int width, uint32_t frame, uint32_t & noise)
+{
+    switch (pattern)
+    {
+        case LoadPattern::Solid:
+            std::fill(pixels.begin(), pixels.end(), CRGB((uint8_t)frame, (uint8_t)(frame * 3), (uint8_t)(frame * 7)));
+            break;
+
+        case LoadPattern::Gradient:
+            for (size_t i = 0; i < pixels.size(); i++)
+            {
+                const uint8_t x = (uint8_t)((i % width) * 256 / width + frame * 2);
+                const uint8_t y = (uint8_t)(i / width * 8 + frame);
+                pixels[i] = CRGB(x, (uint8_t)(255 - x), y);
+            }
+            break;
+
+        case LoadPattern::Noise:
+            for (auto & pixel : pixels)
+            {
+                noise ^= noise << 13;
+                noise ^= noise >> 17;
+                noise ^= noise << 5;
+                pixel = CRGB((uint8_t)noise, (uint8_t)(noise >> 8), (uint8_t)(noise >> 16));
+            }
+            break;
+    }
+}
+
+// StepResults
+//
+// What one rate came to.  The receivers add to it as responses arrive, under the lock.
+
+struct StepResults
+{
+    std::mutex           lock;
+    std::vector<int64_t> roundTrips;                    // From a frame starting to go out to its response being read
+    uint64_t             cResponses     = 0;
+    uint64_t             queueSum       = 0;
+    uint32_t             queueMax       = 0;
+    uint64_t             fpsSum         = 0;
+    uint64_t             cpuSum         = 0;
+    uint64_t             cExtended      = 0;
+    uint64_t             cFlow          = 0;            // Responses with flow control, from version 4
+    double               leadSum        = 0;
+    uint64_t             aHints[4]      = {};           // How often each FlowHint was given
+    SocketResponseEx     first          = {};           // The extended counters, at the start and end of the step
+    SocketResponseEx     last           = {};
+
+    std::atomic<uint64_t> cSent  { 0 };
+    std::atomic<uint64_t> cbSent { 0 };
+
+    void Reset()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        roundTrips.clear();
+        cResponses = queueSum = fpsSum = cpuSum = cExtended = cFlow = 0;
+        leadSum    = 0;
+        std::fill(std::begin(aHints), std::end(aHints), 0);
+        queueMax = 0;
+        cSent    = 0;
+        cbSent   = 0;
+    }
+};
+
+// LoadConnection
+//
+// A connection to the ndpi under test.  The server answers every frame, in order, so a ring of send times
+// pairs each response with its frame: the sender adds to it and the receiver takes from it.  The server can
+// skip a response when we aren't reading them, but the receiver always is, so the pairing holds.
+
+class LoadConnection
+{
+    int                         _fd;
+    int                         _index;
+    std::thread                 _receiver;
+    std::unique_ptr<int64_t[]>  _sendNanos;
+    std::atomic<uint64_t>       _cSent;
+    uint64_t                    _cAnswered;            // Receiver only
+
+    bool ReadAll(void * pData, size_t cbData)
+    {
+        uint8_t * p = static_cast<uint8_t *>(pData);
+        while (cbData > 0)
+        {
+            const ssize_t cbRead = recv(_fd, p, cbData, 0);
+            if (cbRead < 0 && errno == EINTR)
+                continue;
+            if (cbRead <= 0)
+                return false;
+            p      += cbRead;
+            cbData -= cbRead;
+        }
+        return true;
+    }
+
+    void ReceiveLoop(StepResults & results, FILE * pLog)
+    {
+        SocketResponseEx response;
+        uint8_t          skip[256];
+        while (ReadAll(&response.response.size, sizeof(uint32_t)))
+        {
+            // Read as much of the response as we understand, and pass over anything a newer server adds
+
+            const size_t cbResponse = response.response.size;
+            if (cbResponse < sizeof(SocketResponse))
+                break;
+            const size_t cbKnown = std::min(cbResponse, sizeof(SocketResponseEx));
+            if (!ReadAll(reinterpret_cast<uint8_t *>(&response) + sizeof(uint32_t), cbKnown - sizeof(uint32_t)))
+                break;
+            for (size_t cbLeft = cbResponse - cbKnown; cbLeft > 0; )
+            {
+                const size_t cb = std::min(cbLeft, sizeof(skip));
+                if (!ReadAll(skip, cb))
+                    return;
+                cbLeft -= cb;
+            }
+
+            const int64_t now      = CAppTime::MonotonicNanos();
+            const bool    bExtended = cbKnown >= offsetof(SocketResponseEx, targetLeadMs) && response.version >= 3;
+            const bool    bFlow     = cbKnown == sizeof(SocketResponseEx) && response.version >= 4;
+            int64_t       roundTrip = -1;
+            if (_cAnswered < _cSent.load(std::memory_order_acquire))
+                roundTrip = now - _sendNanos[_cAnswered++ % kLoadSendRing];
+
+            {
+                std::lock_guard<std::mutex> guard(results.lock);
+                if (roundTrip >= 0)
+                    results.roundTrips.push_back(roundTrip);
+                results.cResponses++;
+                results.queueSum += response.response.bufferPos;
+                results.queueMax  = std::max(results.queueMax, response.response.bufferPos);
+                results.fpsSum   += response.response.fpsDrawing;
+                if (bExtended)
+                {
+                    if (results.cExtended++ == 0)
+                        results.first = response;
+                    results.last    = response;
+                    results.cpuSum += response.cpuPercent;
+                }
+                if (bFlow)
+                {
+                    results.cFlow++;
+                    results.leadSum += response.leadMs;
+                    results.aHints[std::min<uint32_t>(response.flowHint, 3)]++;
+                }
+            }
+
+            if (pLog)
+                fprintf(pLog, "%.6f,%d,%s,%u,%u,%u,%u,%.3f,%.3f,%s,%s,%s\n", now / (double)NANOS_PER_SECOND, _index,
+                        roundTrip >= 0 ? std::to_string(roundTrip / 1e6).c_str() : "",
+                        response.response.bufferPos, response.response.bufferSize, response.response.fpsDrawing, response.response.watts,
+                        response.response.oldestPacket, response.response.newestPacket,
+                        bExtended ? std::to_string(response.cpuPercent).c_str() : "",
+                        bFlow ? std::to_string(response.leadMs).c_str() : "",
+                        bFlow ? FlowHintName((FlowHint)response.flowHint) : "");
+        }
+    }
+
+  public:
+
+    LoadConnection(int index) : _fd(-1), _index(index), _sendNanos(std::make_unique<int64_t[]>(kLoadSendRing)), _cSent(0), _cAnswered(0)
+    {
+    }
+
+    ~LoadConnection()
+    {
+        Close();
+    }
+
+    bool Connect(const LoadSettings & settings, StepResults & results, FILE * pLog)
+    {
+        addrinfo hints = {};
+        hints.ai_family   = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo * pInfo  = nullptr;
+        const std::string port = std::to_string(settings.port);
+        if (getaddrinfo(settings.host.c_str(), port.c_str(), &hints, &pInfo) != 0 || !pInfo)
+        {
+            fprintf(stderr, "Can't resolve %s\n", settings.host.c_str());
+            return false;
+        }
+
+        _fd = socket(pInfo->ai_family, pInfo->ai_socktype | SOCK_CLOEXEC, pInfo->ai_protocol);
+        const bool bConnected = _fd >= 0 && connect(_fd, pInfo->ai_addr, pInfo->ai_addrlen) == 0;
+        freeaddrinfo(pInfo);
+        if (!bConnected)
+        {
+            perror("Can't connect");
+            return false;
+        }
+
+        int opt = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        _receiver = std::thread([this, &results, pLog]() { ReceiveLoop(results, pLog); });
+        return true;
+    }
+
+    // Send
+    //
+    // Sends one whole packet, timing its response from when the first byte goes.  The time is noted before
+    // sending, as the response can be back before send() has even returned.
+
+    bool Send(std::span<const uint8_t> packet)
+    {
+        const uint64_t sent = _cSent.load(std::memory_order_relaxed);
+        _sendNanos[sent % kLoadSendRing] = CAppTime::MonotonicNanos();
+        _cSent.store(sent + 1, std::memory_order_release);
+
+        while (!packet.empty())
+        {
+            const ssize_t cbSent = send(_fd, packet.data(), packet.size(), MSG_NOSIGNAL);
+            if (cbSent < 0 && errno == EINTR)
+                continue;
+            if (cbSent <= 0)
+                return false;
+            packet = packet.subspan(cbSent);
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if (_fd < 0)
+            return;
+        shutdown(_fd, SHUT_RDWR);
+        if (_receiver.joinable())
+            _receiver.join();
+        close(_fd);
+        _fd = -1;
+    }
+};
+
+// SendAtRate
+//
+// One connection's share of a step.  If the server stops taking frames as fast as we mean to send them, the
+// sends block and we fall behind rather than bursting to catch up, so the rate achieved is the rate it took.
+
+static void SendAtRate(LoadConnection & connection, const LoadSettings & settings, int index, int fps, int64_t endNanos, StepResults & results)
+{
+    const size_t      cLeds = (size_t)settings.width * settings.height;
+    WireEncoder       encoder(cLeds, settings.compression);
+    std::vector<CRGB> frame(cLeds);
+    uint32_t          noise    = 0x9E3779B9u * (index + 1);
+    const int64_t     interval = fps ? NANOS_PER_SECOND * settings.connections / fps : 0;
+    int64_t           next     = CAppTime::MonotonicNanos() + interval * index / settings.connections;
+
+    for (uint32_t sequence = index; !interrupt_received; sequence += settings.connections)
+    {
+        if (interval)
+        {
+            CAppTime::SleepUntil(next);
+            next = std::max(next + interval, CAppTime::MonotonicNanos() - interval);
+        }
+        if (CAppTime::MonotonicNanos() >= endNanos)
+            return;
+
+        FillPattern(settings.pattern, frame, settings.width, sequence, noise);
+        auto packet = encoder.EncodeFrame(frame, settings.channel16, CAppTime::ServerNanos() + (int64_t)settings.leadMs * NANOS_PER_SECOND / 1000);
+        if (packet.empty() || !connection.Send(packet))
+        {
+            fprintf(stderr, "Connection %d lost\n", index);
+            interrupt_received = true;
+            return;
+        }
+        results.cSent.fetch_add(1, std::memory_order_relaxed);
+        results.cbSent.fetch_add(packet.size(), std::memory_order_relaxed);
+    }
+}
+
+// PrintStep
+//
+// One row of the curve, to the console and optionally the CSV
+
+static void PrintStep(int fps, double seconds, StepResults & results, FILE * pCsv)
+{
+    std::lock_guard<std::mutex> guard(results.lock);
+
+    auto & trips = results.roundTrips;
+    std::sort(trips.begin(), trips.end());
+    auto at = [&](double fraction) { return trips.empty() ? 0.0 : trips[std::min(trips.size() - 1, (size_t)(fraction * trips.size()))] / 1e6; };
+
+    const double sentFps   = results.cSent / seconds;
+    const double mbps      = results.cbSent / seconds / 1e6;
+    const double queueAvg  = results.cResponses ? results.queueSum / (double)results.cResponses : 0.0;
+    const double drawnFps  = results.cResponses ? results.fpsSum / (double)results.cResponses : 0.0;
+
+    char target[16];
+    snprintf(target, sizeof(target), fps ? "%d" : "max", fps);
+    printf("%7s %8.1f %7.2f %8.2f %8.2f %8.2f %8.2f %6.1f %5u %7.1f",
+           target, sentFps, mbps, at(0.50), at(0.90), at(0.99), trips.empty() ? 0.0 : trips.back() / 1e6, queueAvg, results.queueMax, drawnFps);
+
+    // The hint given most often over the step, and the average lead it was steering
+
+    const double   leadAvg = results.cFlow ? results.leadSum / results.cFlow : 0.0;
+    const FlowHint hint    = (FlowHint)(std::max_element(std::begin(results.aHints), std::end(results.aHints)) - std::begin(results.aHints));
+
+    const SocketResponseEx & a = results.first;
+    const SocketResponseEx & b = results.last;
+    if (results.cExtended)
+        printf(" %8llu %7llu %7llu %7llu %6llu %4.0f",
+               (unsigned long long)(b.framesPresented - a.framesPresented), (unsigned long long)(b.framesDropped - a.framesDropped),
+               (unsigned long long)(b.framesLate - a.framesLate), (unsigned long long)(b.framesOverwritten - a.framesOverwritten),
+               (unsigned long long)(b.decodeErrors - a.decodeErrors), results.cpuSum / (double)results.cExtended);
+    if (results.cFlow)
+        printf(" %7.1f %s", leadAvg, FlowHintName(hint));
+    printf("\n");
+
+    if (pCsv)
+    {
+        fprintf(pCsv, "%d,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%u,%.2f", fps, sentFps, mbps, at(0.50), at(0.90), at(0.99),
+                trips.empty() ? 0.0 : trips.back() / 1e6, queueAvg, results.queueMax, drawnFps);
+        if (results.cExtended)
+            fprintf(pCsv, ",%llu,%llu,%llu,%llu,%llu,%.1f\n",
+                    (unsigned long long)(b.framesPresented - a.framesPresented), (unsigned long long)(b.framesDropped - a.framesDropped),
+                    (unsigned long long)(b.framesLate - a.framesLate), (unsigned long long)(b.framesOverwritten - a.framesOverwritten),
+                    (unsigned long long)(b.decodeErrors - a.decodeErrors), results.cpuSum / (double)results.cExtended);
+        else
+            fprintf(pCsv, ",,,,,,");
+        if (results.cFlow)
+            fprintf(pCsv, ",%.1f,%s\n", leadAvg, FlowHintName(hint));
+        else
+            fprintf(pCsv, ",,\n");
+        fflush(pCsv);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    signal(SIGTERM, InterruptHandler);
+    signal(SIGINT, InterruptHandler);
+
+    LoadSettings settings;
+    if (!ParseLoadOptions(argc, argv, settings))
+        return usage(argv[0]);
+
+    FILE * pCsv = nullptr;
+    FILE * pLog = nullptr;
+    if (!settings.csvPath.empty() && !(pCsv = fopen(settings.csvPath.c_str(), "w")))
+    {
+        perror("Can't create the CSV file");
+        return 1;
+    }
+    if (!settings.responsesPath.empty() && !(pLog = fopen(settings.responsesPath.c_str(), "w")))
+    {
+        perror("Can't create the response log");
+        return 1;
+    }
+    if (pCsv)
+        fprintf(pCsv, "target_fps,sent_fps,mb_per_sec,rtt_p50_ms,rtt_p90_ms,rtt_p99_ms,rtt_max_ms,queue_avg,queue_max,drawn_fps,"
+                      "presented,dropped,late,overwritten,decode_errors,cpu_percent,lead_ms,hint\n");
+    if (pLog)
+        fprintf(pLog, "time,connection,rtt_ms,buffer_pos,buffer_size,fps_drawing,watts,oldest_packet,newest_packet,cpu_percent,lead_ms,hint\n");
+
+    const char * patternNames[] = { "solid", "gradient", "noise" };
+    printf("Loading %s:%d with %dx%d %s frames, %s, over %d connection%s\n", settings.host.c_str(), settings.port,
+           settings.width, settings.height, patternNames[(int)settings.pattern],
+           settings.compression >= 0 ? "zlib compressed" : "raw", settings.connections, settings.connections == 1 ? "" : "s");
+
+    StepResults results;
+    std::vector<std::unique_ptr<LoadConnection>> connections;
+    for (int i = 0; i < settings.connections; i++)
+    {
+        connections.push_back(std::make_unique<LoadConnection>(i));
+        if (!connections.back()->Connect(settings, results, pLog))
+            return 1;
+    }
+
+    printf("\n %6s %8s %7s %8s %8s %8s %8s %6s %5s %7s %8s %7s %7s %7s %6s %4s %7s %s\n", "target", "sent/s", "MB/s", "rtt p50", "p90", "p99", "max",
+           "queue", "max", "drawn/s", "shown", "dropped", "late", "overrun", "errors", "cpu%", "lead", "hint");
+
+    for (int fps : settings.rates)
+    {
+        if (interrupt_received)
+            break;
+
+        results.Reset();
+        const int64_t start = CAppTime::MonotonicNanos();
+        const int64_t end   = start + (int64_t)(settings.seconds * NANOS_PER_SECOND);
+
+        std::vector<std::thread> senders;
+        for (int i = 0; i < settings.connections; i++)
+            senders.emplace_back([&, i]() { SendAtRate(*connections[i], settings, i, fps, end, results); });
+        for (auto & sender : senders)
+            sender.join();
+
+        // The responses to the last frames are still on their way, so give them a moment before the row is
+        // totalled, then let the server's queue drain before the next rate begins
+
+        const int64_t elapsed = CAppTime::MonotonicNanos() - start;
+        CAppTime::SleepUntil(CAppTime::MonotonicNanos() + kLoadLingerMs * NANOS_PER_SECOND / 1000);
+        PrintStep(fps, elapsed / (double)NANOS_PER_SECOND, results, pCsv);
+        CAppTime::SleepUntil(CAppTime::MonotonicNanos() + kLoadSettleMs * NANOS_PER_SECOND / 1000);
+    }
+
+    connections.clear();
+    if (pCsv)
+        fclose(pCsv);
+    if (pLog)
+        fclose(pLog);
+    return 0;
+}
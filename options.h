@@ -0,0 +1,446 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Options.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    NightDriverPi's own command line options.  The rgb_matrix library strips
+//    the --led-xxx flags it understands first, and whatever remains is parsed
+//    here.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <string.h>
+#include <array>
+#include "globals.h"
+#include "pixeltypes.h"
+#include "colorlut.h"
+#include "framefit.h"
+#include "layout.h"
+#include "effects.h"
+#include "framepacker.h"
+#include "threadtuning.h"
+
+// RenderMode
+//
+// How frames get onto the panel.  VSync draws each frame into an offscreen canvas and swaps it in at
+// the refresh boundary; Direct writes straight into the live matrix, which can show partial frames.
+
+enum class RenderMode
+{
+    VSync,
+    Direct
+};
+
+// PresentationPolicy
+//
+// What to do with frames that are already late when we get to them.  DrawAll shows every one as fast as it
+// can, SkipToLatest shows only the newest of those that are due, BoundedLateness drops any more than a set
+// time late, and RateSmoothing plays a backlog out a little faster than real time until it's caught up.
+
+enum class PresentationPolicy
+{
+    DrawAll,
+    SkipToLatest,
+    BoundedLateness,
+    RateSmoothing
+};
+
+inline const char * PresentationPolicyName(PresentationPolicy policy)
+{
+    switch (policy)
+    {
+        case PresentationPolicy::DrawAll:         return "draw-all";
+        case PresentationPolicy::SkipToLatest:    return "skip-to-latest";
+        case PresentationPolicy::BoundedLateness: return "bounded-lateness";
+        case PresentationPolicy::RateSmoothing:   return "smooth";
+    }
+    return "unknown";
+}
+
+// NDPiOptions
+//
+// Runtime settings that are ours rather than the matrix library's
+
+struct NDPiOptions
+{
+    RenderMode renderMode  = kDefaultUseVSync ? RenderMode::VSync : RenderMode::Direct;
+    size_t     blitThreads = kDefaultBlitThreads;
+    bool       extendedResponse = false;
+    bool       udp         = false;                     // Also accept fragmented frames over UDP
+    std::string udpMulticastGroup;                      // If set, join this group for UDP frames
+    int        channel     = kDefaultChannel;           // 1-16, the channel16 bit that addresses this node
+    size_t     channels    = 1;                         // Channels driven, one per band of the matrix, from that bit up
+    PresentationPolicy policy = PresentationPolicy::DrawAll;
+    int        maxLatenessMs = kDefaultMaxLatenessMs;   // Frames later than this are dropped, for the policies that drop
+    int        targetLeadMs = kDefaultTargetLeadMs;     // How far ahead the master is asked to keep each frame
+    size_t     maxQueue    = 0;                         // Frames the queue may hold, or 0 to size it to the memory free
+    QueueFormat queueFormat = QueueFormat::Rgb24;       // How frames are held while they wait in the queue
+    size_t     decodeThreads = kDefaultDecodeThreads;   // Workers expanding compressed frames, or 0 to do it inline
+    ThreadTuning socketTuning;                          // Where each stage's threads run, and at what priority
+    ThreadTuning decodeTuning;
+    ThreadTuning drawTuning;
+    bool       lockMemory  = false;                     // Keep every page resident once it's touched
+    int        metricsPort = kDefaultMetricsPort;       // Where Prometheus scrapes us, or 0 for nowhere
+    uint32_t   powerLimitMilliwatts = kDefaultPowerLimitWatts * 1000;   // Frames are dimmed to fit this, if set
+    std::array<float, 3> gamma = { kDefaultGamma, kDefaultGamma, kDefaultGamma };
+    CRGB       whiteBalance     = CRGB(UncorrectedColor);
+    CRGB       colorTemperature = CRGB(UncorrectedTemperature);
+    bool       interpolate = false;                     // Blend between frames at the panel refresh rate
+    FitMode    fitMode     = FitMode::None;             // How frames of a different size go on the matrix
+    ResampleFilter resample = ResampleFilter::Nearest;
+    size_t     frameWidth  = 0;                         // Width of incoming frames, or 0 for the matrix width
+    LayoutSpec layout;                                  // How the panels are arranged, compiled once the matrix exists
+    std::string effect;                                 // Local effect to show when the stream runs dry, if any
+    std::string recordPath;                             // Record the incoming stream to this file, if set
+    std::string replayPath;                             // Play this recording instead of listening, if set
+    double     replayFrom  = 0.0;                       // Seconds into the recording to start playing
+    bool       replayLoop  = false;
+};
+
+// PrintNDPiOptions
+//
+// Writes the usage text for our own options
+
+inline void PrintNDPiOptions(FILE * out)
+{
+    fprintf(out, "NightDriverPi options:\n");
+    fprintf(out, "\t--direct                 : Draw straight onto the live matrix instead of swapping on VSync\n");
+    fprintf(out, "\t--blit-threads=<n>       : Threads used to copy each frame to the matrix, split by panel. Default: %d\n", kDefaultBlitThreads);
+    fprintf(out, "\t--extended-response      : Send the versioned extended SocketResponse, which includes supported codecs\n");
+    fprintf(out, "\t--udp                    : Also receive fragmented frames over UDP on port %d\n", kIncomingSocketPort);
+    fprintf(out, "\t--udp-multicast=<group>  : Receive UDP frames sent to this multicast group (implies --udp)\n");
+    fprintf(out, "\t--channel=<1-16>         : Channel this node answers to, for sharing one stream among groups. Default: %d\n", kDefaultChannel);
+    fprintf(out, "\t--channels=<n>           : Drive n channels, from --channel up, each on its own band of the matrix. Default: 1\n");
+    fprintf(out, "\t--policy=<name>          : What to do with late frames: draw-all, skip-to-latest, bounded-lateness or smooth. Default: draw-all\n");
+    fprintf(out, "\t--max-lateness=<ms>      : How late a frame may be before bounded-lateness or smooth drops it. Default: %d\n", kDefaultMaxLatenessMs);
+    fprintf(out, "\t--target-lead=<ms>       : How far ahead of its due time the master is asked to send each frame. Default: %d\n", kDefaultTargetLeadMs);
+    fprintf(out, "\t--max-queue=<frames>     : Most frames to hold, up to %d. Default: as many as %d%% of free memory holds\n", kMaxBuffers, kQueueMemoryPercent);
+    fprintf(out, "\t--queue-format=<format>  : Hold queued frames as rgb24, rgb565 (lossy), palette or zlib. Default: rgb24\n");
+    fprintf(out, "\t--decode-threads=<n>     : Expand compressed frames on this many worker threads, up to %d, or 0 on the socket thread. Default: %d\n", kDecodeQueueDepth, kDefaultDecodeThreads);
+    fprintf(out, "\t--socket-cpus=<list>     : CPUs the socket thread may run on, like 1 or 2-3. Default: any\n");
+    fprintf(out, "\t--decode-cpus=<list>     : CPUs the decode workers may run on. Default: any\n");
+    fprintf(out, "\t--draw-cpus=<list>       : CPUs the draw, blit and effect threads may run on. Default: any\n");
+    fprintf(out, "\t--socket-priority=<n>    : Run the socket thread under SCHED_FIFO at this priority, up to %d, or 0 for normal. Default: 0\n", kMaxRealtimePriority);
+    fprintf(out, "\t--decode-priority=<n>    : Run the decode workers under SCHED_FIFO at this priority. Default: 0\n");
+    fprintf(out, "\t--draw-priority=<n>      : Run the draw, blit and present threads under SCHED_FIFO at this priority. Default: 0\n");
+    fprintf(out, "\t--lock-memory            : Lock our memory into RAM with mlockall, so drawing never waits on a page fault\n");
+    fprintf(out, "\t--metrics-port=<port>    : Serve Prometheus metrics over HTTP on this port, or 0 for none. Default: %d\n", kDefaultMetricsPort);
+    fprintf(out, "\t--power-limit=<watts>    : Dim frames whose estimated draw would exceed this many watts, or 0 for no limit. Default: %d\n", kDefaultPowerLimitWatts);
+    fprintf(out, "\t--gamma=<g>|<r,g,b>      : Gamma exponent for all channels or each of red, green and blue. Default: %.1f\n", kDefaultGamma);
+    fprintf(out, "\t--white-balance=<color>  : Per-channel correction, as RRGGBB hex or a preset like TypicalSMD5050. Default: none\n");
+    fprintf(out, "\t--color-temperature=<color> : Color temperature, as RRGGBB hex or a preset like Tungsten100W. Default: none\n");
+    fprintf(out, "\t--interpolate            : Blend between frames so slower streams move smoothly at the refresh rate\n");
+    fprintf(out, "\t--fit=<mode>             : Fit frames of another size: none, center, letterbox or stretch. Default: none\n");
+    fprintf(out, "\t--resample=<filter>      : How scaled frames are sampled: nearest or bilinear. Default: nearest\n");
+    fprintf(out, "\t--frame-width=<n>        : Width of incoming frames, if not the matrix width\n");
+    fprintf(out, "\t--layout=<terms>         : Panel arrangement, from grid=<c>x<r>, serpentine, flip-x, flip-y, rotate=<deg>. Default: flip-x\n");
+    fprintf(out, "\t--effect=<name>          : Show rainbow, twinkle or spectrum whenever the stream runs dry. Default: none\n");
+    fprintf(out, "\t--record=<file>          : Record every packet received, and each frame it became, to a file\n");
+    fprintf(out, "\t--replay=<file>          : Play a recording with its original timing instead of listening on the network\n");
+    fprintf(out, "\t--replay-from=<seconds>  : Start the replay this far into the recording\n");
+    fprintf(out, "\t--replay-loop            : Play the recording over and over\n");
+}
+
+// ParseNDPiOptions
+//
+// Parses whatever is left on the command line once the matrix library has taken its flags.  Returns
+// false on anything we don't recognize so the caller can show usage.
+
+inline bool ParseNDPiOptions(int argc, char * argv[], NDPiOptions & options)
+{
+    static const struct option longOptions[] =
+    {
+        { "direct",       no_argument,       nullptr, 'd' },
+        { "blit-threads", required_argument, nullptr, 'b' },
+        { "extended-response", no_argument,  nullptr, 'x' },
+        { "udp",          no_argument,       nullptr, 'u' },
+        { "udp-multicast", required_argument, nullptr, 'm' },
+        { "channel",      required_argument, nullptr, 'c' },
+        { "channels",     required_argument, nullptr, 'C' },
+        { "policy",       required_argument, nullptr, 'p' },
+        { "max-lateness", required_argument, nullptr, 'l' },
+        { "target-lead",  required_argument, nullptr, 't' },
+        { "max-queue",    required_argument, nullptr, 'q' },
+        { "queue-format", required_argument, nullptr, 'Q' },
+        { "decode-threads", required_argument, nullptr, 'j' },
+        { "socket-cpus",  required_argument, nullptr, 'N' },
+        { "decode-cpus",  required_argument, nullptr, 'D' },
+        { "draw-cpus",    required_argument, nullptr, 'A' },
+        { "socket-priority", required_argument, nullptr, 'K' },
+        { "decode-priority", required_argument, nullptr, 'E' },
+        { "draw-priority", required_argument, nullptr, 'G' },
+        { "lock-memory",  no_argument,       nullptr, 'U' },
+        { "metrics-port", required_argument, nullptr, 'M' },
+        { "power-limit",  required_argument, nullptr, 'w' },
+        { "gamma",        required_argument, nullptr, 'g' },
+        { "white-balance", required_argument, nullptr, 'W' },
+        { "color-temperature", required_argument, nullptr, 'T' },
+        { "interpolate",  no_argument,       nullptr, 'i' },
+        { "fit",          required_argument, nullptr, 'f' },
+        { "resample",     required_argument, nullptr, 'r' },
+        { "frame-width",  required_argument, nullptr, 'F' },
+        { "layout",       required_argument, nullptr, 'L' },
+        { "effect",       required_argument, nullptr, 'e' },
+        { "record",       required_argument, nullptr, 'R' },
+        { "replay",       required_argument, nullptr, 'P' },
+        { "replay-from",  required_argument, nullptr, 'S' },
+        { "replay-loop",  no_argument,       nullptr, 'o' },
+        { nullptr,        0,                 nullptr, 0   }
+    };
+
+    optind = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+            case 'd':
+                options.renderMode = RenderMode::Direct;
+                break;
+
+            case 'b':
+                options.blitThreads = std::max(1, atoi(optarg));
+                break;
+
+            case 'x':
+                options.extendedResponse = true;
+                break;
+
+            case 'u':
+                options.udp = true;
+                break;
+
+            case 'm':
+                options.udp = true;
+                options.udpMulticastGroup = optarg;
+                break;
+
+            case 'c':
+                options.channel = atoi(optarg);
+                if (options.channel < 1 || options.channel > 16)
+                    return false;
+                break;
+
+            case 'C':
+            {
+                const int cChannels = atoi(optarg);
+                if (cChannels < 1 || cChannels > kMaxChannels)
+                    return false;
+                options.channels = (size_t)cChannels;
+                break;
+            }
+
+            case 'p':
+            {
+                bool bFound = false;
+                for (auto policy : { PresentationPolicy::DrawAll, PresentationPolicy::SkipToLatest,
+                                     PresentationPolicy::BoundedLateness, PresentationPolicy::RateSmoothing })
+                {
+                    if (0 == strcmp(optarg, PresentationPolicyName(policy)))
+                    {
+                        options.policy = policy;
+                        bFound = true;
+                    }
+                }
+                if (!bFound)
+                    return false;
+                break;
+            }
+
+            case 'l':
+                options.maxLatenessMs = std::max(0, atoi(optarg));
+                break;
+
+            case 't':
+                options.targetLeadMs = std::max(0, atoi(optarg));
+                break;
+
+            case 'q':
+                options.maxQueue = (size_t)std::clamp(atoi(optarg), 1, (int)kMaxBuffers);
+                break;
+
+            case 'Q':
+            {
+                bool bFound = false;
+                for (auto format : { QueueFormat::Rgb24, QueueFormat::Rgb565, QueueFormat::Palette, QueueFormat::Zlib })
+                {
+                    if (0 == strcmp(optarg, QueueFormatName(format)))
+                    {
+                        options.queueFormat = format;
+                        bFound = true;
+                    }
+                }
+                if (!bFound)
+                    return false;
+                break;
+            }
+
+            case 'j':
+                options.decodeThreads = (size_t)std::clamp(atoi(optarg), 0, (int)kDecodeQueueDepth);
+                break;
+
+            case 'N':
+                if (!ParseCpuList(optarg, options.socketTuning.cpus))
+                    return false;
+                break;
+
+            case 'D':
+                if (!ParseCpuList(optarg, options.decodeTuning.cpus))
+                    return false;
+                break;
+
+            case 'A':
+                if (!ParseCpuList(optarg, options.drawTuning.cpus))
+                    return false;
+                break;
+
+            case 'K':
+                if (!ParsePriority(optarg, options.socketTuning.priority))
+                    return false;
+                break;
+
+            case 'E':
+                if (!ParsePriority(optarg, options.decodeTuning.priority))
+                    return false;
+                break;
+
+            case 'G':
+                if (!ParsePriority(optarg, options.drawTuning.priority))
+                    return false;
+                break;
+
+            case 'U':
+                options.lockMemory = true;
+                break;
+
+            case 'M':
+                options.metricsPort = atoi(optarg);
+                if (options.metricsPort < 0 || options.metricsPort > 65535)
+                    return false;
+                break;
+
+            case 'w':
+                options.powerLimitMilliwatts = (uint32_t)(std::max(0.0, atof(optarg)) * 1000);
+                break;
+
+            case 'g':
+                if (!ParseGamma(optarg, options.gamma))
+                    return false;
+                break;
+
+            case 'W':
+                if (!ParseColorCorrection(optarg, options.whiteBalance))
+                    return false;
+                break;
+
+            case 'T':
+                if (!ParseColorCorrection(optarg, options.colorTemperature))
+                    return false;
+                break;
+
+            case 'i':
+                options.interpolate = true;
+                break;
+
+            case 'f':
+            {
+                bool bFound = false;
+                for (auto mode : { FitMode::None, FitMode::Center, FitMode::Letterbox, FitMode::Stretch })
+                {
+                    if (0 == strcmp(optarg, FitModeName(mode)))
+                    {
+                        options.fitMode = mode;
+                        bFound = true;
+                    }
+                }
+                if (!bFound)
+                    return false;
+                break;
+            }
+
+            case 'r':
+            {
+                bool bFound = false;
+                for (auto filter : { ResampleFilter::Nearest, ResampleFilter::Bilinear })
+                {
+                    if (0 == strcmp(optarg, ResampleFilterName(filter)))
+                    {
+                        options.resample = filter;
+                        bFound = true;
+                    }
+                }
+                if (!bFound)
+                    return false;
+                break;
+            }
+
+            case 'F':
+                options.frameWidth = std::max(0, atoi(optarg));
+                break;
+
+            case 'L':
+                if (!ParseLayout(optarg, options.layout))
+                    return false;
+                break;
+
+            case 'e':
+                if (!CreateEffect(optarg))
+                    return false;
+                options.effect = optarg;
+                break;
+
+            case 'R':
+                options.recordPath = optarg;
+                break;
+
+            case 'P':
+                options.replayPath = optarg;
+                break;
+
+            case 'S':
+                options.replayFrom = std::max(0.0, atof(optarg));
+                break;
+
+            case 'o':
+                options.replayLoop = true;
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    // The channels take consecutive channel16 bits, so they have to fit above the first
+
+    if (options.channel - 1 + options.channels > (size_t)kMaxChannels)
+        return false;
+    return optind == argc;
+}
@@ -0,0 +1,115 @@
+//+--------------------------------------------------------------------------
+//
+// File:        PeakData.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    The latest audio peaks from the master, kept in a single slot that
+//    the socket thread overwrites and anyone can read without locking.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <atomic>
+
+#include "globals.h"
+
+// PeakData
+//
+// One set of band levels, as sent in a WIFI_COMMAND_PEAKDATA packet
+
+struct PeakData
+{
+    uint32_t                          cBands         = 0;
+    uint32_t                          reserved       = 0;
+    int64_t                           timestampNanos = 0;   // Server time the peaks were measured
+    int64_t                           receivedNanos  = 0;   // Monotonic time they arrived, to judge staleness
+    std::array<float, kMaxPeakBands>  peaks          = {};
+};
+
+// PeakSlot
+//
+// Peaks are only worth anything while they're fresh, so rather than queueing them behind the frames there's
+// just the one slot, and each packet replaces the last.  It's a seqlock: the writer bumps the sequence to
+// odd, writes, and bumps it to even again, and a reader that sees the sequence change, or odd, while it
+// copies simply copies again.  Readers never block the writer and a read is a few dozen loads.  The data
+// is held as relaxed atomic words so the overlapping reads and writes stay well defined.  One writer only.
+
+class PeakSlot
+{
+    static constexpr size_t kWords = sizeof(PeakData) / sizeof(uint32_t);
+    static_assert(sizeof(PeakData) % sizeof(uint32_t) == 0);
+
+    std::atomic<uint32_t>                    _sequence { 0 };
+    std::array<std::atomic<uint32_t>, kWords> _words;
+
+  public:
+
+    PeakSlot()
+    {
+        for (auto & word : _words)
+            word.store(0, std::memory_order_relaxed);
+    }
+
+    PeakSlot(const PeakSlot &) = delete;
+    PeakSlot & operator=(const PeakSlot &) = delete;
+
+    void Publish(const PeakData & data)
+    {
+        uint32_t words[kWords];
+        memcpy(words, &data, sizeof(words));
+
+        const uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < kWords; i++)
+            _words[i].store(words[i], std::memory_order_relaxed);
+
+        _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Read
+    //
+    // Copies out the latest peaks.  Returns false if none have arrived yet.
+
+    bool Read(PeakData & data) const
+    {
+        uint32_t words[kWords];
+        uint32_t sequence;
+        do
+        {
+            sequence = _sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < kWords; i++)
+                words[i] = _words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((sequence & 1) || sequence != _sequence.load(std::memory_order_relaxed));
+
+        memcpy(&data, words, sizeof(words));
+        return sequence != 0;
+    }
+};
@@ -0,0 +1,169 @@
+//+--------------------------------------------------------------------------
+//
+// File:        PixelMap.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    A precomputed table that says, for every pixel on the matrix, which
+//    pixel of the incoming frame should be shown there.  Building the table
+//    once means the blit loop never does any coordinate math per pixel.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// PixelMap
+//
+// Destination-major: entry [y * width + x] holds the index into the frame's color data for matrix
+// pixel (x, y), or kNoSource if that pixel should be black.  Alongside the table we keep the span of frame
+// pixels each matrix row reads from, so a partial redraw can find the rows it touches whatever the mapping.
+
+class PixelMap
+{
+    struct Span
+    {
+        size_t first;
+        size_t end;
+    };
+
+    size_t                _width;
+    size_t                _height;
+    std::vector<uint32_t> _sourceIndex;
+    std::vector<Span>     _rowSources;              // Frame pixels [first, end) cover everything row y reads
+
+  public:
+
+    static constexpr uint32_t kNoSource = UINT32_MAX;
+
+    PixelMap(size_t width, size_t height)
+        : PixelMap(width, height, std::vector<uint32_t>(width * height, kNoSource))
+    {
+    }
+
+    PixelMap(size_t width, size_t height, std::vector<uint32_t> sourceIndex)
+        : _width(width), _height(height), _sourceIndex(std::move(sourceIndex)), _rowSources(height, Span { SIZE_MAX, 0 })
+    {
+        _sourceIndex.resize(width * height, kNoSource);
+        for (size_t y = 0; y < height; y++)
+            for (size_t x = 0; x < width; x++)
+            {
+                const uint32_t src = _sourceIndex[y * width + x];
+                if (src != kNoSource)
+                {
+                    _rowSources[y].first = std::min<size_t>(_rowSources[y].first, src);
+                    _rowSources[y].end   = std::max<size_t>(_rowSources[y].end, src + 1);
+                }
+            }
+    }
+
+    // Identity
+    //
+    // Frame pixel N lands on matrix pixel N, rows left to right
+
+    static PixelMap Identity(size_t width, size_t height)
+    {
+        std::vector<uint32_t> index(width * height);
+        for (size_t i = 0; i < width * height; i++)
+            index[i] = i;
+        return PixelMap(width, height, std::move(index));
+    }
+
+    // FlipX
+    //
+    // Mirrors every row horizontally, which is how our panels have always been wired
+
+    static PixelMap FlipX(size_t width, size_t height)
+    {
+        std::vector<uint32_t> index(width * height);
+        for (size_t y = 0; y < height; y++)
+            for (size_t x = 0; x < width; x++)
+                index[y * width + x] = y * width + (width - 1 - x);
+        return PixelMap(width, height, std::move(index));
+    }
+
+    // Compose
+    //
+    // Follows this map and then another: matrix pixel d shows whatever pixel of the frame the second map
+    // places at index this[d].  Folding a layout and a resize into a single table keeps the blit to one
+    // lookup per pixel.
+
+    PixelMap Compose(const std::vector<uint32_t> & then) const
+    {
+        std::vector<uint32_t> index(_sourceIndex.size(), kNoSource);
+        for (size_t d = 0; d < index.size(); d++)
+            if (_sourceIndex[d] < then.size())
+                index[d] = then[_sourceIndex[d]];
+        return PixelMap(_width, _height, std::move(index));
+    }
+
+    constexpr size_t Width()  const { return _width;  }
+    constexpr size_t Height() const { return _height; }
+
+    // DestinationRows
+    //
+    // The matrix rows [y0, y1) that can show frame pixels [first, end).  An end of SIZE_MAX means the whole
+    // canvas is stale, which includes rows that only ever draw black.  Returns false if the map is empty
+    // and the caller should just redraw everything.
+
+    bool DestinationRows(size_t first, size_t end, size_t & y0, size_t & y1) const
+    {
+        if (_width == 0)
+            return false;
+
+        if (end == SIZE_MAX && first == 0)
+        {
+            y0 = 0;
+            y1 = _height;
+            return true;
+        }
+
+        y0 = _height;
+        y1 = 0;
+        for (size_t y = 0; y < _height; y++)
+        {
+            if (_rowSources[y].first < end && first < _rowSources[y].end)
+            {
+                y0 = std::min(y0, y);
+                y1 = y + 1;
+            }
+        }
+        if (y0 >= y1)
+            y0 = y1 = 0;
+        return true;
+    }
+
+    const uint32_t * Row(size_t y) const
+    {
+        return &_sourceIndex[y * _width];
+    }
+
+    uint32_t operator[](size_t destIndex) const
+    {
+        return _sourceIndex[destIndex];
+    }
+};
@@ -0,0 +1,293 @@
+//+--------------------------------------------------------------------------
+//
+// File:        PixelOps.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Whole-frame operations on packed CRGB arrays, vectorized with NEON on
+//    the Pi and SSE2 on a development machine.  Each gives exactly the same
+//    result as applying the scalar helpers in pixeltypes.h to every pixel,
+//    which is what the fallback does.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <algorithm>
+
+#include "pixeltypes.h"
+
+#if defined(__ARM_NEON)
+    #include <arm_neon.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+static_assert(sizeof(CRGB) == 3, "Bulk pixel operations assume tightly packed CRGB");
+
+// PixelOps
+//
+// Apart from the channel sums, every operation here treats all three channels alike, so a frame is handled
+// as a plain run of bytes, 16 at a time, with the scalar helper finishing off whatever is left over.  The
+// destination may be the same array as a source, as each byte is read before it's written.
+
+namespace PixelOps
+{
+    struct ChannelSums
+    {
+        uint64_t red;
+        uint64_t green;
+        uint64_t blue;
+    };
+
+    inline uint8_t * Bytes(std::span<CRGB> pixels)
+    {
+        return reinterpret_cast<uint8_t *>(pixels.data());
+    }
+
+    inline const uint8_t * Bytes(std::span<const CRGB> pixels)
+    {
+        return reinterpret_cast<const uint8_t *>(pixels.data());
+    }
+
+#if defined(__ARM_NEON)
+
+    inline uint64_t HorizontalSum(uint32x4_t v)
+    {
+        #if defined(__aarch64__)
+            return vaddlvq_u32(v);
+        #else
+            const uint64x2_t pairs = vpaddlq_u32(v);
+            return vgetq_lane_u64(pairs, 0) + vgetq_lane_u64(pairs, 1);
+        #endif
+    }
+
+    // Scale8
+    //
+    // scale8 on 16 bytes: (v * (scale + 1)) >> 8, with the +1 done as a widening add so a scale of 255
+    // still fits in a byte-sized multiplier
+
+    inline uint8x16_t Scale8(uint8x16_t v, uint8x8_t scale)
+    {
+        const uint8x8_t lo = vshrn_n_u16(vaddw_u8(vmull_u8(vget_low_u8(v),  scale), vget_low_u8(v)),  8);
+        const uint8x8_t hi = vshrn_n_u16(vaddw_u8(vmull_u8(vget_high_u8(v), scale), vget_high_u8(v)), 8);
+        return vcombine_u8(lo, hi);
+    }
+
+#elif defined(__SSE2__)
+
+    inline __m128i Scale8(__m128i v, __m128i scaleFixed)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i lo   = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), scaleFixed), 8);
+        const __m128i hi   = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), scaleFixed), 8);
+        return _mm_packus_epi16(lo, hi);
+    }
+
+    // ChannelMask
+    //
+    // In 48 bytes of pixels, the bytes of one channel in the given 16-byte third
+
+    inline __m128i ChannelMask(int channel, int third)
+    {
+        alignas(16) uint8_t mask[16];
+        for (int i = 0; i < 16; i++)
+            mask[i] = (third * 16 + i) % 3 == channel ? 0xFF : 0x00;
+        return _mm_load_si128(reinterpret_cast<const __m128i *>(mask));
+    }
+
+#endif
+
+    // SumChannels
+    //
+    // Adds up each channel separately across the frame.  On NEON the 16-bit lane sums are widened every
+    // 128 vectors, before two bytes' worth per lane per vector can overflow them.  SSE2 has no deinterleaving
+    // load, so it masks each channel out of the three registers 16 pixels span and sums them with psadbw.
+
+    inline ChannelSums SumChannels(std::span<const CRGB> pixels)
+    {
+        const uint8_t * p = Bytes(pixels);
+        const size_t    n = pixels.size();
+        size_t          i = 0;
+        ChannelSums     sums = { 0, 0, 0 };
+
+#if defined(__ARM_NEON)
+        uint32x4_t red = vdupq_n_u32(0), green = vdupq_n_u32(0), blue = vdupq_n_u32(0);
+        while (i + 16 <= n)
+        {
+            uint16x8_t red16 = vdupq_n_u16(0), green16 = vdupq_n_u16(0), blue16 = vdupq_n_u16(0);
+            for (size_t j = 0; j < 128 && i + 16 <= n; j++, i += 16)
+            {
+                const uint8x16x3_t rgb = vld3q_u8(p + i * 3);
+                red16   = vpadalq_u8(red16,   rgb.val[0]);
+                green16 = vpadalq_u8(green16, rgb.val[1]);
+                blue16  = vpadalq_u8(blue16,  rgb.val[2]);
+            }
+            red   = vpadalq_u16(red,   red16);
+            green = vpadalq_u16(green, green16);
+            blue  = vpadalq_u16(blue,  blue16);
+        }
+        sums = { HorizontalSum(red), HorizontalSum(green), HorizontalSum(blue) };
+#elif defined(__SSE2__)
+        static const __m128i masks[3][3] =
+        {
+            { ChannelMask(0, 0), ChannelMask(0, 1), ChannelMask(0, 2) },
+            { ChannelMask(1, 0), ChannelMask(1, 1), ChannelMask(1, 2) },
+            { ChannelMask(2, 0), ChannelMask(2, 1), ChannelMask(2, 2) }
+        };
+        const __m128i zero = _mm_setzero_si128();
+        __m128i       acc[3] = { zero, zero, zero };
+
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m128i v[3] = { _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 3)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 3 + 16)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 3 + 32)) };
+            for (int c = 0; c < 3; c++)
+                for (int k = 0; k < 3; k++)
+                    acc[c] = _mm_add_epi64(acc[c], _mm_sad_epu8(_mm_and_si128(v[k], masks[c][k]), zero));
+        }
+
+        uint64_t lanes[3][2];
+        for (int c = 0; c < 3; c++)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes[c]), acc[c]);
+        sums = { lanes[0][0] + lanes[0][1], lanes[1][0] + lanes[1][1], lanes[2][0] + lanes[2][1] };
+#endif
+
+        for (; i < n; i++)
+        {
+            sums.red   += p[i * 3 + 0];
+            sums.green += p[i * 3 + 1];
+            sums.blue  += p[i * 3 + 2];
+        }
+        return sums;
+    }
+
+    // ScaleAll
+    //
+    // CRGB::nscale8 on every pixel
+
+    inline void ScaleAll(std::span<CRGB> pixels, fract8 scale)
+    {
+        if (scale == 255)
+            return;                                         // nscale8x3 by 255 is exact
+
+        uint8_t *    p = Bytes(pixels);
+        const size_t n = pixels.size() * sizeof(CRGB);
+        size_t       i = 0;
+
+#if defined(__ARM_NEON)
+        const uint8x8_t factor = vdup_n_u8(scale);
+        for (; i + 16 <= n; i += 16)
+            vst1q_u8(p + i, Scale8(vld1q_u8(p + i), factor));
+#elif defined(__SSE2__)
+        const __m128i factor = _mm_set1_epi16((int16_t)scale + 1);
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i * pv = reinterpret_cast<__m128i *>(p + i);
+            _mm_storeu_si128(pv, Scale8(_mm_loadu_si128(pv), factor));
+        }
+#endif
+
+        for (; i < n; i++)
+            p[i] = scale8(p[i], scale);
+    }
+
+    // FadeAll
+    //
+    // CRGB::fadeToBlackBy on every pixel
+
+    inline void FadeAll(std::span<CRGB> pixels, fract8 fadeBy)
+    {
+        ScaleAll(pixels, 255 - fadeBy);
+    }
+
+    // AddAll
+    //
+    // dest += src on every pixel, saturating each channel at 255 like CRGB::operator+=
+
+    inline void AddAll(std::span<CRGB> dest, std::span<const CRGB> src)
+    {
+        uint8_t *       d = Bytes(dest);
+        const uint8_t * s = Bytes(src);
+        const size_t    n = std::min(dest.size(), src.size()) * sizeof(CRGB);
+        size_t          i = 0;
+
+#if defined(__ARM_NEON)
+        for (; i + 16 <= n; i += 16)
+            vst1q_u8(d + i, vqaddq_u8(vld1q_u8(d + i), vld1q_u8(s + i)));
+#elif defined(__SSE2__)
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i * pv = reinterpret_cast<__m128i *>(d + i);
+            _mm_storeu_si128(pv, _mm_adds_epu8(_mm_loadu_si128(pv), _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i))));
+        }
+#endif
+
+        for (; i < n; i++)
+            d[i] = qadd8(d[i], s[i]);
+    }
+
+    // BlendAll
+    //
+    // dest = from.lerp8(to, amount) on every pixel.  lerp8by8 scales the distance between the two values and
+    // moves toward the second, which the vector paths reproduce with an absolute difference and a select.
+
+    inline void BlendAll(std::span<CRGB> dest, std::span<const CRGB> from, std::span<const CRGB> to, fract8 amount)
+    {
+        uint8_t *       d = Bytes(dest);
+        const uint8_t * a = Bytes(from);
+        const uint8_t * b = Bytes(to);
+        const size_t    n = std::min({ dest.size(), from.size(), to.size() }) * sizeof(CRGB);
+        size_t          i = 0;
+
+#if defined(__ARM_NEON)
+        const uint8x8_t factor = vdup_n_u8(amount);
+        for (; i + 16 <= n; i += 16)
+        {
+            const uint8x16_t va     = vld1q_u8(a + i);
+            const uint8x16_t vb     = vld1q_u8(b + i);
+            const uint8x16_t scaled = Scale8(vabdq_u8(va, vb), factor);
+            vst1q_u8(d + i, vbslq_u8(vcgtq_u8(vb, va), vaddq_u8(va, scaled), vsubq_u8(va, scaled)));
+        }
+#elif defined(__SSE2__)
+        const __m128i factor = _mm_set1_epi16((int16_t)amount + 1);
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m128i va     = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            const __m128i vb     = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+            const __m128i larger = _mm_max_epu8(va, vb);
+            const __m128i scaled = Scale8(_mm_sub_epi8(larger, _mm_min_epu8(va, vb)), factor);
+            const __m128i up     = _mm_cmpeq_epi8(larger, vb);
+            const __m128i result = _mm_or_si128(_mm_and_si128(up, _mm_add_epi8(va, scaled)), _mm_andnot_si128(up, _mm_sub_epi8(va, scaled)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), result);
+        }
+#endif
+
+        for (; i < n; i++)
+            d[i] = lerp8by8(a[i], b[i], amount);
+    }
+}
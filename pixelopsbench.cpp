@@ -0,0 +1,236 @@
+//+--------------------------------------------------------------------------
+//
+// File:        PixelOpsBench.cpp
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Times each bulk pixel operation against the per-pixel CRGB code it
+//    replaces, and checks that the two agree bit for bit on every frame
+//    size from one pixel to a little past a 16K-pixel chain.  Exits nonzero
+//    on any mismatch.  Built with "make bench".
+//
+//    Also times the banded blit against the OpenMP loop it replaced, both
+//    drawing a frame mirrored onto a simulated canvas, and checks that the
+//    two leave the same pixels behind.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+#include <vector>
+#include <functional>
+#include <thread>
+
+#include "apptime.h"
+#include "pixeltypes.h"
+#include "pixelops.h"
+#include "pixelmap.h"
+#include "blitter.h"
+
+using rgb_matrix::FrameCanvas;
+
+constexpr size_t kBenchPixels    = 32 * 64 * 8;          // The default chain
+constexpr int    kBenchRepeats   = 200;
+constexpr size_t kBenchWidth     = 64 * 8;            // The same chain as a canvas
+constexpr size_t kBenchHeight    = 32;
+constexpr size_t kBenchPanel     = 64;
+
+static std::vector<CRGB> RandomFrame(size_t count)
+{
+    std::vector<CRGB> frame(count);
+    for (auto & pixel : frame)
+        pixel = CRGB(rand() & 0xFF, rand() & 0xFF, rand() & 0xFF);
+    return frame;
+}
+
+static bool Same(const std::vector<CRGB> & a, const std::vector<CRGB> & b)
+{
+    return a.size() == b.size() && 0 == memcmp(a.data(), b.data(), a.size() * sizeof(CRGB));
+}
+
+// TimeMicros
+//
+// Average time of one run of work, in microseconds
+
+static double TimeMicros(const std::function<void()> & work)
+{
+    const int64_t start = CAppTime::MonotonicNanos();
+    for (int i = 0; i < kBenchRepeats; i++)
+        work();
+    return (CAppTime::MonotonicNanos() - start) / (double)NANOS_PER_MICRO / kBenchRepeats;
+}
+
+// Check
+//
+// Runs the bulk and per-pixel versions of an operation over the same input at every interesting size, which
+// covers each vector loop's tail, then times both at the full chain length
+
+static bool Check(const char * name,
+                  const std::function<void(std::vector<CRGB> &, const std::vector<CRGB> &, uint8_t)> & bulk,
+                  const std::function<void(std::vector<CRGB> &, const std::vector<CRGB> &, uint8_t)> & scalar)
+{
+    bool bMatch = true;
+    for (size_t count = 1; count <= 67 && bMatch; count++)
+        for (int amount : { 0, 1, 127, 128, 254, 255 })
+        {
+            const auto other = RandomFrame(count);
+            auto       a     = RandomFrame(other.size());
+            auto       b     = a;
+            bulk(a, other, amount);
+            scalar(b, other, amount);
+            bMatch = bMatch && Same(a, b);
+        }
+
+    const auto other = RandomFrame(kBenchPixels);
+    auto       a     = RandomFrame(kBenchPixels);
+    auto       b     = a;
+    bulk(a, other, 77);
+    scalar(b, other, 77);
+    bMatch = bMatch && Same(a, b);
+
+    const double bulkMicros   = TimeMicros([&] { bulk(a, other, 200); });
+    const double scalarMicros = TimeMicros([&] { scalar(b, other, 200); });
+
+    printf("%-14s %8.1f us bulk %8.1f us per-pixel %6.1fx  %s\n", name, bulkMicros, scalarMicros,
+           scalarMicros / (bulkMicros + DBL_EPSILON), bMatch ? "match" : "MISMATCH");
+    return bMatch;
+}
+
+// LoopBlit
+//
+// How MatrixDraw used to copy a frame to the matrix: one OpenMP loop over every pixel, working out x and y
+// from the index each time and mirroring x as it went
+
+static void LoopBlit(const std::vector<CRGB> & frame, Canvas & canvas, size_t width, size_t height)
+{
+    const size_t numpixels = width * height;
+
+    #pragma omp parallel for
+    for (size_t idx = 0; idx < numpixels; ++idx)
+    {
+        const int x = idx % width;
+        const int y = idx / width;
+
+        const CRGB color = frame[idx];
+        canvas.SetPixel(width - 1 - x, y, color.r, color.g, color.b);
+    }
+}
+
+static bool SameCanvas(const FrameCanvas & a, const FrameCanvas & b)
+{
+    for (int y = 0; y < a.height(); y++)
+        for (int x = 0; x < a.width(); x++)
+        {
+            uint8_t r1, g1, b1, r2, g2, b2;
+            a.GetPixel(x, y, &r1, &g1, &b1);
+            b.GetPixel(x, y, &r2, &g2, &b2);
+            if (r1 != r2 || g1 != g2 || b1 != b2)
+                return false;
+        }
+    return true;
+}
+
+// CheckBlit
+//
+// Draws the same frames through Blitter::Blit and the old loop, each with every core, and times both
+
+static bool CheckBlit()
+{
+    const size_t   cThreads = std::max(1u, std::thread::hardware_concurrency());
+    const PixelMap map      = PixelMap::FlipX(kBenchWidth, kBenchHeight);
+    Blitter        blitter(kBenchWidth, kBenchPanel, cThreads);
+    FrameCanvas    a(kBenchWidth, kBenchHeight);
+    FrameCanvas    b(kBenchWidth, kBenchHeight);
+
+    bool bMatch = true;
+    for (int i = 0; i < 4 && bMatch; i++)
+    {
+        const auto frame = RandomFrame(kBenchWidth * kBenchHeight);
+        blitter.Blit(frame.data(), frame.size(), map, a);
+        LoopBlit(frame, b, kBenchWidth, kBenchHeight);
+        bMatch = SameCanvas(a, b);
+    }
+
+    const auto   frame      = RandomFrame(kBenchWidth * kBenchHeight);
+    const double blitMicros = TimeMicros([&] { blitter.Blit(frame.data(), frame.size(), map, a); });
+    const double loopMicros = TimeMicros([&] { LoopBlit(frame, b, kBenchWidth, kBenchHeight); });
+
+    printf("%-14s %8.1f us banded %6.1f us OpenMP loop %4.1fx  %s (%zu bands)\n", "Blit", blitMicros, loopMicros,
+           loopMicros / (blitMicros + DBL_EPSILON), bMatch ? "match" : "MISMATCH", blitter.Bands());
+    return bMatch;
+}
+
+int main()
+{
+    srand(1);
+
+#if defined(__ARM_NEON)
+    printf("Bulk pixel operations using NEON, %zu pixels\n", kBenchPixels);
+#elif defined(__SSE2__)
+    printf("Bulk pixel operations using SSE2, %zu pixels\n", kBenchPixels);
+#else
+    printf("Bulk pixel operations using scalar code, %zu pixels\n", kBenchPixels);
+#endif
+
+    bool bAllMatch = true;
+
+    bAllMatch &= Check("ScaleAll",
+        [](auto & frame, auto &, uint8_t amount) { PixelOps::ScaleAll(frame, amount); },
+        [](auto & frame, auto &, uint8_t amount) { for (auto & pixel : frame) pixel.nscale8(amount); });
+
+    bAllMatch &= Check("FadeAll",
+        [](auto & frame, auto &, uint8_t amount) { PixelOps::FadeAll(frame, amount); },
+        [](auto & frame, auto &, uint8_t amount) { for (auto & pixel : frame) pixel.fadeToBlackBy(amount); });
+
+    bAllMatch &= Check("AddAll",
+        [](auto & frame, auto & other, uint8_t) { PixelOps::AddAll(frame, other); },
+        [](auto & frame, auto & other, uint8_t) { for (size_t i = 0; i < frame.size(); i++) frame[i] += other[i]; });
+
+    bAllMatch &= Check("BlendAll",
+        [](auto & frame, auto & other, uint8_t amount) { PixelOps::BlendAll(frame, frame, other, amount); },
+        [](auto & frame, auto & other, uint8_t amount) { for (size_t i = 0; i < frame.size(); i++) frame[i] = frame[i].lerp8(other[i], amount); });
+
+    bAllMatch &= Check("SumChannels",
+        [](auto & frame, auto &, uint8_t)
+        {
+            const auto sums = PixelOps::SumChannels(frame);
+            frame[0] = CRGB(sums.red & 0xFF, sums.green & 0xFF, sums.blue & 0xFF);
+        },
+        [](auto & frame, auto &, uint8_t)
+        {
+            uint64_t red = 0, green = 0, blue = 0;
+            for (const auto & pixel : frame)
+            {
+                red   += pixel.r;
+                green += pixel.g;
+                blue  += pixel.b;
+            }
+            frame[0] = CRGB(red & 0xFF, green & 0xFF, blue & 0xFF);
+        });
+
+    bAllMatch &= CheckBlit();
+
+    return bAllMatch ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+//+--------------------------------------------------------------------------
+//
+// File:        PowerLimiter.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Dims any frame that would draw more than the power supply can give,
+//    in the manner of FastLED's calculate_max_brightness_for_power_mW.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <algorithm>
+
+#include "pixeltypes.h"
+#include "pixelops.h"
+#include "telemetry.h"
+
+// PowerLimiter
+//
+// Each frame's draw is estimated from its channel sums, one vectorized pass, and only a frame over budget
+// pays for the second pass that scales it.  The whole frame is scaled by the same amount so its colors keep
+// their balance.  Draw thread only.
+
+class PowerLimiter
+{
+    const uint32_t _budgetMilliwatts;                       // 0 for no limit
+    fract8         _lastScale;
+
+  public:
+
+    explicit PowerLimiter(uint32_t budgetMilliwatts)
+        : _budgetMilliwatts(budgetMilliwatts), _lastScale(255)
+    {
+    }
+
+    fract8 LastScale() const
+    {
+        return _lastScale;
+    }
+
+    // Apply
+    //
+    // Scales the frame in place if it needs it and returns what it's estimated to draw afterwards.
+    // bScaleChanged says whether the scale differs from the previous frame's, in which case pixels that
+    // didn't change in the frame data still change on the panel.
+
+    uint32_t Apply(std::span<CRGB> pixels, uint8_t brightness, bool & bScaleChanged)
+    {
+        const uint32_t milliwatts = EstimateMilliwatts(PixelOps::SumChannels(pixels), brightness);
+
+        fract8 scale = 255;
+        if (_budgetMilliwatts != 0 && milliwatts > _budgetMilliwatts)
+            scale = (fract8)(std::clamp<uint64_t>((uint64_t)_budgetMilliwatts * 256 / milliwatts, 1, 255) - 1);
+
+        bScaleChanged = scale != _lastScale;
+        _lastScale    = scale;
+
+        if (scale == 255)
+            return milliwatts;
+
+        PixelOps::ScaleAll(pixels, scale);
+        return (uint32_t)((uint64_t)milliwatts * (scale + 1) / 256);
+    }
+};
@@ -0,0 +1,329 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Recording.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    The on-disk format for recordings of the incoming stream, and the
+//    recorder that writes them from the socket thread without ever
+//    waiting on the disk.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <bit>
+#include <span>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "globals.h"
+#include "apptime.h"
+#include "metrics.h"
+#include "ledbuffer.h"
+
+// Recording format
+//
+// A file header, then records one after another in the order they happened, then an index of the frames.
+// Every record is a RecordHeader and its data, padded to a multiple of 8 bytes.  A Wire record is a packet
+// exactly as it arrived, compressed or not.  A Frame record is what that packet went into the queue as: a
+// full WIFI_COMMAND_PIXELDATA64 packet, with deltas already applied, which is laid out just like a pooled
+// frame's wire image, so replay can point a buffer straight at it.  A Peaks record is a peaks packet.
+//
+// The index lists every Frame and Peaks record, so a player can seek by time without reading the rest.  It
+// is written when the recording is closed; if it never was, the header says so by having no index offset,
+// and a reader can rebuild the index by walking the records.  Everything is in the Pi's native little-endian
+// order and all times are server nanoseconds.
+
+constexpr uint32_t kRecordingMagic   = 0x4345524E;          // "NREC"
+constexpr uint32_t kRecordingVersion = 1;
+constexpr uint32_t kRecordTag        = 0x4452444E;          // "NDRD", at the start of every record
+
+static_assert(std::endian::native == std::endian::little, "Recordings are written in native order, which must be little-endian");
+
+enum class RecordType : uint16_t
+{
+    Wire  = 1,
+    Frame = 2,
+    Peaks = 3
+};
+
+enum class RecordTransport : uint16_t
+{
+    None = 0,                                       // For records made here rather than received
+    Tcp  = 1,
+    Udp  = 2
+};
+
+struct RecordingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t indexOffset;                           // Where the index starts, or 0 if it was never written
+    uint64_t cIndexEntries;
+    int64_t  startNanos;                            // When the recording began
+};
+
+struct RecordHeader
+{
+    uint32_t tag;
+    uint16_t type;                                  // A RecordType
+    uint16_t transport;                             // A RecordTransport
+    int64_t  receivedNanos;                         // When the packet arrived
+    uint32_t cbData;                                // Bytes that follow, not counting the padding
+    uint32_t reserved;
+};
+
+struct RecordIndexEntry
+{
+    uint64_t offset;                                // Of the record's header, from the start of the file
+    int64_t  receivedNanos;
+    int64_t  dueNanos;                              // The frame's timestamp, or the peaks' measurement time
+};
+
+static_assert(sizeof(RecordingHeader) == 32 && sizeof(RecordHeader) == 24 && sizeof(RecordIndexEntry) == 24);
+
+constexpr size_t RecordPadding(size_t cbData)
+{
+    return (8 - cbData % 8) % 8;
+}
+
+// FrameRecorder
+//
+// The socket thread hands each record over by appending it to a buffer, and a thread of our own writes the
+// buffer out, so a slow SD card never holds up the stream being recorded.  If the disk falls so far behind
+// that the buffer would pass kRecordingBufferBytes, records are dropped, and counted, instead of waiting.
+// Only the socket thread records.
+
+class FrameRecorder
+{
+    int                             _fd;
+    std::mutex                      _mutex;
+    std::condition_variable         _wake;
+    std::vector<uint8_t>            _pending;           // Records waiting for the writer, under _mutex
+    std::vector<uint8_t>            _writing;           // The writer's own, swapped with _pending
+    std::vector<RecordIndexEntry>   _index;             // Socket thread only
+    uint64_t                        _offset;            // File offset the next record will land at
+    int64_t                         _startNanos;
+    bool                            _bStopping;
+    bool                            _bFailed;           // The writer hit an error and gave up; under _mutex
+    std::thread                     _writer;
+
+    // WriteAll
+    //
+    // Writes the whole of a buffer, however many calls it takes
+
+    bool WriteAll(const uint8_t * pData, size_t cbData)
+    {
+        while (cbData > 0)
+        {
+            const ssize_t cbWritten = write(_fd, pData, cbData);
+            if (cbWritten < 0 && errno == EINTR)
+                continue;
+            if (cbWritten <= 0)
+            {
+                perror("Recording write failed");
+                return false;
+            }
+            pData  += cbWritten;
+            cbData -= cbWritten;
+        }
+        return true;
+    }
+
+    void WriterLoop()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _wake.wait(lock, [this] { return _bStopping || !_pending.empty(); });
+            if (_pending.empty())
+                return;
+
+            _writing.swap(_pending);
+            lock.unlock();
+            const bool bWritten = WriteAll(_writing.data(), _writing.size());
+            _writing.clear();
+            lock.lock();
+
+            if (!bWritten)
+            {
+                _bFailed = true;
+                return;
+            }
+        }
+    }
+
+    // Append
+    //
+    // Queues one record, made of a header and up to two pieces of data, for the writer.  Returns false if it
+    // was dropped.
+
+    bool Append(RecordType type, RecordTransport transport, int64_t receivedNanos,
+                std::span<const uint8_t> first, std::span<const uint8_t> second = {})
+    {
+        const size_t cbData   = first.size() + second.size();
+        const size_t cbRecord = sizeof(RecordHeader) + cbData + RecordPadding(cbData);
+
+        const RecordHeader header { kRecordTag, (uint16_t)type, (uint16_t)transport, receivedNanos, (uint32_t)cbData, 0 };
+        const uint8_t      padding[8] = {};
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_bFailed || _pending.size() + cbRecord > kRecordingBufferBytes)
+            {
+                Metrics().recordsDropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            const uint8_t * pHeader = reinterpret_cast<const uint8_t *>(&header);
+            _pending.insert(_pending.end(), pHeader, pHeader + sizeof(header));
+            _pending.insert(_pending.end(), first.begin(), first.end());
+            _pending.insert(_pending.end(), second.begin(), second.end());
+            _pending.insert(_pending.end(), padding, padding + RecordPadding(cbData));
+        }
+        _wake.notify_one();
+
+        _offset += cbRecord;
+        return true;
+    }
+
+  public:
+
+    FrameRecorder() : _fd(-1), _offset(0), _startNanos(0), _bStopping(false), _bFailed(false)
+    {
+    }
+
+    ~FrameRecorder()
+    {
+        Close();
+    }
+
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder & operator=(const FrameRecorder &) = delete;
+
+    // Open
+    //
+    // Creates the file, replacing any that's there, and starts the writer
+
+    bool Open(const char * pszPath)
+    {
+        _fd = open(pszPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (_fd < 0)
+        {
+            perror("Can't create recording");
+            return false;
+        }
+
+        _startNanos = CAppTime::ServerNanos();
+        const RecordingHeader header { kRecordingMagic, kRecordingVersion, 0, 0, _startNanos };
+        if (!WriteAll(reinterpret_cast<const uint8_t *>(&header), sizeof(header)))
+        {
+            close(_fd);
+            _fd = -1;
+            return false;
+        }
+
+        _offset = sizeof(header);
+        _pending.reserve(kRecordingBufferBytes);
+        _writing.reserve(kRecordingBufferBytes);
+        _writer = std::thread([this]() { WriterLoop(); });
+        printf("Recording the stream to %s\n", pszPath);
+        return true;
+    }
+
+    // Close
+    //
+    // Lets the writer finish, then adds the index and fills it in in the header
+
+    void Close()
+    {
+        if (_fd < 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _bStopping = true;
+        }
+        _wake.notify_one();
+        _writer.join();
+
+        if (!_bFailed && WriteAll(reinterpret_cast<const uint8_t *>(_index.data()), _index.size() * sizeof(RecordIndexEntry)))
+        {
+            const RecordingHeader header { kRecordingMagic, kRecordingVersion, _offset, _index.size(), _startNanos };
+            if (pwrite(_fd, &header, sizeof(header), 0) != sizeof(header))
+                perror("Can't finish the recording's header");
+        }
+        close(_fd);
+        _fd = -1;
+        printf("Recording closed with %zu frames indexed\n", _index.size());
+    }
+
+    // RecordWire
+    //
+    // A packet as it came off the network
+
+    void RecordWire(std::span<const uint8_t> packet, RecordTransport transport)
+    {
+        Append(RecordType::Wire, transport, CAppTime::ServerNanos(), packet);
+    }
+
+    // RecordFrame
+    //
+    // A frame as it's about to be queued, written out as the full pixel packet it amounts to
+
+    void RecordFrame(const LEDBuffer & frame, uint16_t channel16)
+    {
+        const WireFrameHeader header { WIFI_COMMAND_PIXELDATA64, channel16, (uint32_t)frame.ColorData().size(),
+                                       frame.Seconds(), frame.MicroSeconds() };
+        uint8_t abHeader[WireFrameHeader::kSize];
+        header.ToMemory(abHeader);
+
+        const int64_t  now    = CAppTime::ServerNanos();
+        const uint64_t offset = _offset;
+        auto           pixels = std::as_bytes(frame.ColorData());
+        if (Append(RecordType::Frame, RecordTransport::None, now, abHeader,
+                   std::span<const uint8_t>(reinterpret_cast<const uint8_t *>(pixels.data()), pixels.size())))
+            _index.push_back(RecordIndexEntry { offset, now, (int64_t)frame.TimestampNanos() });
+    }
+
+    // RecordPeaks
+    //
+    // A peaks packet, header and bands
+
+    void RecordPeaks(std::span<const uint8_t> packet, const WireFrameHeader & header)
+    {
+        const int64_t  now    = CAppTime::ServerNanos();
+        const uint64_t offset = _offset;
+        if (Append(RecordType::Peaks, RecordTransport::None, now, packet))
+            _index.push_back(RecordIndexEntry { offset, now, (int64_t)(header.seconds * NANOS_PER_SECOND + header.micros * NANOS_PER_MICRO) });
+    }
+};
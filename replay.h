@@ -0,0 +1,317 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Replay.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Plays a recording back into the LEDBufferManager with the same timing
+//    it was received with, straight out of the mapped file.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+#include <initializer_list>
+#include <algorithm>
+
+#include "globals.h"
+#include "apptime.h"
+#include "ledbuffer.h"
+#include "recording.h"
+#include "channelset.h"
+
+extern volatile bool interrupt_received;
+
+// MappedRecording
+//
+// A recording mapped into memory.  The mapping is private and writable, so the draw loop can dim or
+// otherwise touch a frame in place the way it does pooled frames, and any page it writes to is copied
+// rather than ever reaching the file.  Frames borrowed from it hold a reference to it, so it stays
+// mapped until the last of them has been drawn.
+
+class MappedRecording
+{
+    uint8_t *                     _pData;
+    size_t                        _cbData;
+    std::vector<RecordIndexEntry> _rebuilt;             // Only if the file was never closed properly
+    std::span<const RecordIndexEntry> _index;
+
+    MappedRecording(uint8_t * pData, size_t cbData) : _pData(pData), _cbData(cbData)
+    {
+    }
+
+  public:
+
+    ~MappedRecording()
+    {
+        munmap(_pData, _cbData);
+    }
+
+    MappedRecording(const MappedRecording &) = delete;
+    MappedRecording & operator=(const MappedRecording &) = delete;
+
+    // Open
+    //
+    // Maps and checks a recording, or returns nullptr with the reason printed
+
+    static std::shared_ptr<MappedRecording> Open(const char * pszPath)
+    {
+        const int fd = open(pszPath, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            perror("Can't open recording");
+            return nullptr;
+        }
+
+        struct stat info;
+        void * pMap = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(RecordingHeader))
+            pMap = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (pMap == MAP_FAILED)
+        {
+            fprintf(stderr, "Can't map recording %s\n", pszPath);
+            return nullptr;
+        }
+
+        std::shared_ptr<MappedRecording> pRecording(new MappedRecording(static_cast<uint8_t *>(pMap), info.st_size));
+
+        RecordingHeader header;
+        memcpy(&header, pRecording->_pData, sizeof(header));
+        if (header.magic != kRecordingMagic || header.version != kRecordingVersion)
+        {
+            fprintf(stderr, "%s isn't a recording we can play\n", pszPath);
+            return nullptr;
+        }
+
+        if (header.indexOffset != 0 && header.indexOffset + header.cIndexEntries * sizeof(RecordIndexEntry) <= pRecording->_cbData)
+            pRecording->_index = std::span<const RecordIndexEntry>(
+                reinterpret_cast<const RecordIndexEntry *>(pRecording->_pData + header.indexOffset), header.cIndexEntries);
+        else
+        {
+            printf("Recording %s was never closed, so its index is being rebuilt\n", pszPath);
+            pRecording->_rebuilt = pRecording->Scan({ RecordType::Frame, RecordType::Peaks });
+            pRecording->_index   = pRecording->_rebuilt;
+        }
+        return pRecording;
+    }
+
+    std::span<const RecordIndexEntry> Index() const
+    {
+        return _index;
+    }
+
+    // Scan
+    //
+    // Walks every record in the file, listing those of the given types, and stops at the first that's
+    // incomplete, as the last one of a recording that was cut short can be.  For a recording's full index,
+    // Index() is far cheaper.
+
+    std::vector<RecordIndexEntry> Scan(std::initializer_list<RecordType> types) const
+    {
+        std::vector<RecordIndexEntry> entries;
+        size_t offset = sizeof(RecordingHeader);
+        while (offset + sizeof(RecordHeader) <= _cbData)
+        {
+            RecordHeader header;
+            memcpy(&header, _pData + offset, sizeof(header));
+            if (header.tag != kRecordTag || offset + sizeof(header) + header.cbData > _cbData)
+                break;
+
+            const uint8_t * pPacket = _pData + offset + sizeof(header);
+            if (std::find(types.begin(), types.end(), (RecordType)header.type) != types.end())
+            {
+                int64_t due = 0;
+                if (header.type != (uint16_t)RecordType::Wire && header.cbData >= WireFrameHeader::kSize)
+                {
+                    const auto packet = WireFrameHeader::FromMemory(pPacket);
+                    due = (int64_t)(packet.seconds * NANOS_PER_SECOND + packet.micros * NANOS_PER_MICRO);
+                }
+                entries.push_back(RecordIndexEntry { offset, header.receivedNanos, due });
+            }
+            offset += sizeof(header) + header.cbData + RecordPadding(header.cbData);
+        }
+        return entries;
+    }
+
+    // Record
+    //
+    // The header and data of the record an index entry points to, or nullptr if it runs off the end
+
+    const RecordHeader * Record(const RecordIndexEntry & entry, uint8_t *& pPacket) const
+    {
+        if (entry.offset + sizeof(RecordHeader) > _cbData)
+            return nullptr;
+
+        const RecordHeader * pHeader = reinterpret_cast<const RecordHeader *>(_pData + entry.offset);
+        if (pHeader->tag != kRecordTag || entry.offset + sizeof(RecordHeader) + pHeader->cbData > _cbData)
+            return nullptr;
+
+        pPacket = _pData + entry.offset + sizeof(RecordHeader);
+        return pHeader;
+    }
+};
+
+// RecordingPlayer
+//
+// Queues each recorded frame at the moment it was originally received, relative to the start of playback,
+// with its timestamp moved by the same amount, so the queue fills and drains just as it did in the field.
+// A frame is a buffer pointed straight at its pixels in the mapping; nothing is copied.  Playback can start
+// partway in, found through the index, and can loop.
+
+class RecordingPlayer
+{
+    std::shared_ptr<MappedRecording> _pRecording;
+    const int64_t                    _startOffsetNanos;      // How far into the recording to begin
+    const bool                       _bLoop;
+
+    // Queue
+    //
+    // Hands one record to the managers it's addressed to, shifted in time by offsetNanos.  A single manager
+    // takes every record, whatever channel it was recorded on; with several, each takes those for its own.
+
+    void Queue(const RecordIndexEntry & entry, int64_t offsetNanos, std::span<LEDBufferManager * const> managers, int firstChannel)
+    {
+        uint8_t *            pPacket;
+        const RecordHeader * pRecord = _pRecording->Record(entry, pPacket);
+        if (!pRecord || pRecord->cbData < WireFrameHeader::kSize)
+            return;
+
+        const auto     header    = WireFrameHeader::FromMemory(pPacket);
+        const int64_t  due       = entry.dueNanos + offsetNanos;
+        const uint32_t addressed = managers.size() == 1 ? 1 : AddressedChannels(header.channel16, firstChannel, managers.size());
+
+        if (pRecord->type == (uint16_t)RecordType::Peaks)
+        {
+            if (header.length32 > kMaxPeakBands || WireFrameHeader::kSize + header.PayloadSize() > pRecord->cbData)
+                return;
+
+            PeakData peaks;
+            peaks.cBands         = header.length32;
+            peaks.timestampNanos = due;
+            peaks.receivedNanos  = CAppTime::MonotonicNanos();
+            memcpy(peaks.peaks.data(), pPacket + WireFrameHeader::kSize, header.PayloadSize());
+            for (size_t i = 0; i < managers.size(); i++)
+                if (addressed & (1u << i))
+                    managers[i]->Peaks().Publish(peaks);
+            return;
+        }
+
+        if (pRecord->type != (uint16_t)RecordType::Frame || WireFrameHeader::kSize + header.PayloadSize() > pRecord->cbData)
+            return;
+
+        // The first channel shows the pixels straight from the mapping.  Drawing may dim a frame in place, so
+        // any other channel it's for gets a copy of its own from the pool.
+
+        CRGB *     pPixels = reinterpret_cast<CRGB *>(pPacket + WireFrameHeader::kSize);
+        const auto seconds = due / NANOS_PER_SECOND;
+        const auto micros  = (due % NANOS_PER_SECOND) / NANOS_PER_MICRO;
+        bool       bMapped = false;
+        for (size_t i = 0; i < managers.size(); i++)
+        {
+            if (!(addressed & (1u << i)))
+                continue;
+            if (!bMapped)
+            {
+                managers[i]->PushNewBuffer(LEDBufferPtr(new LEDBuffer(pPixels, header.length32, seconds, micros, _pRecording)));
+                bMapped = true;
+                continue;
+            }
+
+            LEDBufferPtr pCopy = managers[i]->Pool().Acquire();
+            if (!pCopy || header.length32 > pCopy->Capacity())
+                continue;
+            pCopy->SetSize(header.length32);
+            pCopy->SetTimestamp(seconds, micros);
+            memcpy(pCopy->ColorData().data(), pPixels, header.length32 * sizeof(CRGB));
+            managers[i]->PushNewBuffer(std::move(pCopy));
+        }
+    }
+
+  public:
+
+    RecordingPlayer(std::shared_ptr<MappedRecording> pRecording, double startSeconds, bool bLoop)
+        : _pRecording(std::move(pRecording)),
+          _startOffsetNanos((int64_t)(startSeconds * NANOS_PER_SECOND)),
+          _bLoop(bLoop)
+    {
+    }
+
+    // RunLoop
+    //
+    // Plays the recording until it ends, or with looping until we're interrupted, into a manager for each
+    // channel from firstChannel up
+
+    void RunLoop(std::span<LEDBufferManager * const> managers, int firstChannel)
+    {
+        const auto index = _pRecording->Index();
+        if (index.empty())
+        {
+            printf("Recording holds no frames to play\n");
+            return;
+        }
+
+        // Seek to the first record received at or after the starting point
+
+        const int64_t begin = index.front().receivedNanos + _startOffsetNanos;
+        size_t        first = std::lower_bound(index.begin(), index.end(), begin,
+                                               [](const RecordIndexEntry & entry, int64_t nanos) { return entry.receivedNanos < nanos; }) - index.begin();
+        if (first == index.size())
+            first = 0;
+
+        printf("Playing %zu records from %.3f seconds in\n", index.size() - first, (index[first].receivedNanos - index.front().receivedNanos) / (double)NANOS_PER_SECOND);
+
+        do
+        {
+            const int64_t offset = CAppTime::ServerNanos() - index[first].receivedNanos;
+            for (size_t i = first; i < index.size() && !interrupt_received; i++)
+            {
+                // Sleep until the record's moment arrives, waking now and then to notice ctrl-c
+
+                while (!interrupt_received)
+                {
+                    const int64_t wait = index[i].receivedNanos + offset - CAppTime::ServerNanos();
+                    if (wait <= 0)
+                        break;
+                    CAppTime::SleepUntil(CAppTime::MonotonicNanos() + std::min<int64_t>(wait, kReplayPollIntervalMs * NANOS_PER_SECOND / 1000));
+                }
+                Queue(index[i], offset, managers, firstChannel);
+            }
+            first = 0;
+        } while (_bLoop && !interrupt_received);
+
+        if (!interrupt_received)
+            printf("Recording finished\n");
+    }
+};
@@ -0,0 +1,285 @@
+//+--------------------------------------------------------------------------
+//
+// File:        led-matrix.h (simulator)
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    An in-memory stand-in for the parts of rpi-rgb-led-matrix we use, so
+//    the whole pipeline can be built and measured on a machine with no
+//    panels.  Builds that put this directory on the include path get it
+//    in place of the real library's led-matrix.h.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace rgb_matrix
+{
+
+// Canvas
+//
+// The same interface as the library's
+
+class Canvas
+{
+  public:
+
+    virtual ~Canvas() {}
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+    virtual void SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue) = 0;
+    virtual void Clear() = 0;
+    virtual void Fill(uint8_t red, uint8_t green, uint8_t blue) = 0;
+};
+
+// FrameCanvas
+//
+// An offscreen canvas that is just a block of RGB bytes, which can be read back with GetPixel
+
+class FrameCanvas : public Canvas
+{
+    int                  _width;
+    int                  _height;
+    std::vector<uint8_t> _pixels;
+
+  public:
+
+    FrameCanvas(int width, int height) : _width(width), _height(height), _pixels(width * height * 3)
+    {
+    }
+
+    int width() const override  { return _width;  }
+    int height() const override { return _height; }
+
+    void SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue) override
+    {
+        if (x < 0 || y < 0 || x >= _width || y >= _height)
+            return;
+        uint8_t * p = &_pixels[(y * _width + x) * 3];
+        p[0] = red;
+        p[1] = green;
+        p[2] = blue;
+    }
+
+    void GetPixel(int x, int y, uint8_t * red, uint8_t * green, uint8_t * blue) const
+    {
+        const uint8_t * p = &_pixels[(y * _width + x) * 3];
+        *red   = p[0];
+        *green = p[1];
+        *blue  = p[2];
+    }
+
+    void Clear() override
+    {
+        Fill(0, 0, 0);
+    }
+
+    void Fill(uint8_t red, uint8_t green, uint8_t blue) override
+    {
+        for (int i = 0; i < _width * _height; i++)
+        {
+            _pixels[i * 3 + 0] = red;
+            _pixels[i * 3 + 1] = green;
+            _pixels[i * 3 + 2] = blue;
+        }
+    }
+};
+
+struct RuntimeOptions
+{
+    int  gpio_slowdown   = 1;
+    int  daemon          = 0;
+    int  drop_privileges = 1;
+    bool do_gpio_init    = true;
+};
+
+// RGBMatrix
+//
+// Drawing on the matrix itself draws on whichever canvas is "on the panel".  SwapOnVSync waits for the
+// next refresh at limit_refresh_rate_hz, or not at all if that's 0, and then tells the swap observer, if
+// there is one, which canvas just went on display.  The observer is the simulator's own addition.
+
+class RGBMatrix : public Canvas
+{
+  public:
+
+    struct Options
+    {
+        const char * hardware_mapping      = "regular";
+        int          rows                  = 32;
+        int          cols                  = 32;
+        int          chain_length          = 1;
+        int          parallel              = 1;
+        int          pwm_bits              = 11;
+        int          brightness            = 100;
+        const char * pixel_mapper_config   = nullptr;
+        int          limit_refresh_rate_hz = 0;
+        bool         disable_busy_waiting  = false;
+    };
+
+    using SwapObserver = std::function<void(const FrameCanvas &)>;
+
+  private:
+
+    int                                       _width;
+    int                                       _height;
+    int64_t                                   _refreshNanos;     // 0 to swap immediately
+    int64_t                                   _nextRefresh;
+    std::vector<std::unique_ptr<FrameCanvas>> _canvases;         // We own them all, as the library does
+    FrameCanvas *                             _pActive;
+    SwapObserver                              _observer;
+
+    static int64_t Now()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    RGBMatrix(const Options & options)
+        : _width(options.cols * options.chain_length),
+          _height(options.rows * options.parallel),
+          _refreshNanos(options.limit_refresh_rate_hz > 0 ? 1000000000LL / options.limit_refresh_rate_hz : 0),
+          _nextRefresh(0),
+          _pActive(nullptr)
+    {
+        _pActive = CreateFrameCanvas();
+    }
+
+  public:
+
+    static RGBMatrix * CreateFromOptions(const Options & options, const RuntimeOptions & runtime)
+    {
+        if (options.rows <= 0 || options.cols <= 0 || options.chain_length <= 0 || options.parallel <= 0)
+            return nullptr;
+        return new RGBMatrix(options);
+    }
+
+    FrameCanvas * CreateFrameCanvas()
+    {
+        _canvases.push_back(std::make_unique<FrameCanvas>(_width, _height));
+        return _canvases.back().get();
+    }
+
+    FrameCanvas * SwapOnVSync(FrameCanvas * pOther, unsigned framerate_fraction = 1)
+    {
+        if (_refreshNanos)
+        {
+            const int64_t now = Now();
+            _nextRefresh = std::max(_nextRefresh + _refreshNanos * framerate_fraction, now);
+            const timespec ts = { (time_t)(_nextRefresh / 1000000000LL), (long)(_nextRefresh % 1000000000LL) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        }
+
+        FrameCanvas * pPrevious = _pActive;
+        _pActive = pOther;
+        if (_observer)
+            _observer(*_pActive);
+        return pPrevious;
+    }
+
+    void SetSwapObserver(SwapObserver observer)
+    {
+        _observer = std::move(observer);
+    }
+
+    uint8_t brightness()        { return 100; }
+    int width() const override  { return _width;  }
+    int height() const override { return _height; }
+
+    void SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue) override
+    {
+        _pActive->SetPixel(x, y, red, green, blue);
+    }
+
+    void Clear() override
+    {
+        _pActive->Clear();
+    }
+
+    void Fill(uint8_t red, uint8_t green, uint8_t blue) override
+    {
+        _pActive->Fill(red, green, blue);
+    }
+};
+
+inline void PrintMatrixFlags(FILE * out, const RGBMatrix::Options & defaults = RGBMatrix::Options(), const RuntimeOptions & runtime = RuntimeOptions())
+{
+    fprintf(out, "Simulated matrix options:\n");
+    fprintf(out, "\t--led-rows=<n>           : Rows of each panel. Default: %d\n", defaults.rows);
+    fprintf(out, "\t--led-cols=<n>           : Columns of each panel. Default: %d\n", defaults.cols);
+    fprintf(out, "\t--led-chain=<n>          : Panels chained end to end. Default: %d\n", defaults.chain_length);
+    fprintf(out, "\t--led-parallel=<n>       : Chains side by side. Default: %d\n", defaults.parallel);
+    fprintf(out, "\t--led-limit-refresh=<hz> : Refresh rate the swaps are held to, or 0 for none. Default: %d\n", defaults.limit_refresh_rate_hz);
+}
+
+// ParseOptionsFromFlags
+//
+// Takes the --led- flags the simulator understands out of argv, like the library does, and leaves the rest
+
+inline bool ParseOptionsFromFlags(int * argc, char *** argv, RGBMatrix::Options * options, RuntimeOptions * runtime, bool remove_consumed_options = true)
+{
+    struct Flag
+    {
+        const char * name;
+        int *        value;
+    };
+    const Flag flags[] =
+    {
+        { "--led-rows=",          &options->rows                  },
+        { "--led-cols=",          &options->cols                  },
+        { "--led-chain=",         &options->chain_length          },
+        { "--led-parallel=",      &options->parallel              },
+        { "--led-limit-refresh=", &options->limit_refresh_rate_hz },
+    };
+
+    int kept = 1;
+    for (int i = 1; i < *argc; i++)
+    {
+        bool bConsumed = false;
+        for (const Flag & flag : flags)
+        {
+            if (0 == strncmp((*argv)[i], flag.name, strlen(flag.name)))
+            {
+                *flag.value = atoi((*argv)[i] + strlen(flag.name));
+                bConsumed = true;
+            }
+        }
+        if (!bConsumed || !remove_consumed_options)
+            (*argv)[kept++] = (*argv)[i];
+    }
+    *argc = kept;
+    return true;
+}
+
+}   // namespace rgb_matrix
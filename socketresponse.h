@@ -0,0 +1,100 @@
+//+--------------------------------------------------------------------------
+//
+// File:        SocketResponse.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    The response sent back to the master after every frame, on its own
+//    so that tools speaking the protocol can use it without the server.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+// SocketResponse
+//
+// Response data sent back to server every time we receive a packet
+
+struct SocketResponse
+{
+    uint32_t    size;              // 4
+    uint32_t    flashVersion;      // 4
+    double      currentClock;      // 8
+    double      oldestPacket;      // 8
+    double      newestPacket;      // 8
+    double      brightness;        // 8
+    double      wifiSignal;        // 8
+    uint32_t    bufferSize;        // 4
+    uint32_t    bufferPos;         // 4
+    uint32_t    fpsDrawing;        // 4
+    uint32_t    watts;             // 4
+};
+
+static_assert(sizeof(double) == 8);             // SocketResponse on wire uses 8 byte floats
+static_assert(sizeof(float)  == 4);             // PeakData on wire uses 4 byte floats
+
+// Two things must be true for this to work and interop with the C# side:  floats must be 8 bytes, not the default
+// of 4 for Arduino.  So that must be set in 'platformio.ini,' and you must ensure that you align things such that
+// floats land on byte multiples of 8; otherwise, you'll get packing bytes inserted.  Welcome to my world! Once upon
+// a time, I ported about a billion lines of x86 'pragma_pack(1)' code to the MIPS (davepl)!
+
+static_assert( sizeof(SocketResponse) == 64, "SocketResponse struct size is not what is expected - check alignment and float size" );
+
+// SocketResponseEx
+//
+// The extended response, sent instead of the plain one when the master is known to understand it (--extended-response).
+// The leading SocketResponse is unchanged except that its size covers the whole thing, and the version says which
+// fields follow it.  Version 3 adds the counts and trends the master needs to adapt its send rate and compression;
+// the counters are totals since startup, so the master takes the difference between responses.  Version 4 adds
+// flow control: the lead we want frames to arrive with, the lead they're getting, and a FlowHint saying what to
+// do about the difference.  bufferSize, the most frames we'll hold, is sized to the memory we have.
+
+constexpr uint32_t kSocketResponseVersion = 4;
+
+constexpr uint32_t kResponseFlagKeyframeNeeded = 0x01;  // A delta was dropped; send a full frame next
+
+struct SocketResponseEx
+{
+    SocketResponse  response;          // 64
+    uint32_t        version;           // 4   kSocketResponseVersion
+    uint32_t        supportedCodecs;   // 4   CODEC_xxx flags for the compressed envelopes we can decode
+    uint32_t        flags;             // 4   kResponseFlagXxx, since version 2
+    uint32_t        cpuPercent;        // 4   Of one core, since version 3; reserved before that
+    uint64_t        framesPresented;   // 8   Since version 3
+    uint64_t        framesDropped;     // 8   By the presentation policy
+    uint64_t        framesLate;        // 8   Shown more than kLateFrameMs after their timestamp
+    uint64_t        framesOverwritten; // 8   Lost to a full queue
+    uint64_t        decodeErrors;      // 8   Compressed packets that didn't expand
+    uint64_t        deltasDropped;     // 8   Deltas that didn't match our reference frame
+    double          fps;               // 8   The fpsDrawing average before truncation
+    float           queueAverage;      // 4   Smoothed bufferPos
+    float           queueTrend;        // 4   How fast it's changing, in frames per second
+    uint32_t        targetLeadMs;      // 4   Since version 4: how far ahead of its due time a frame should arrive
+    float           leadMs;            // 4   Smoothed lead of the newest frame queued
+    uint32_t        flowHint;          // 4   A FlowHint
+    uint32_t        reserved;          // 4
+};
+
+static_assert( sizeof(SocketResponseEx) == 160, "SocketResponseEx struct size is not what is expected - check alignment" );
@@ -23,7 +23,8 @@
 //
 // Description:
 //
-//    Hosts a socket server on port 49152 to receive LED data from the master
+//    Hosts a socket server on port 49152 to receive LED data from the master,
+//    over TCP and optionally as fragmented UDP datagrams (unicast or multicast)
 //
 // History:     Aug-14-2024     Davepl      Created from NightDriverStrip
 //---------------------------------------------------------------------------
@@ -35,87 +36,200 @@
 #include <stdlib.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <errno.h>
 #include <string.h>
-#include <zlib.h>
 #include <span>
 #include <memory>
 #include <iostream>
+#include <bit>
+#include <unordered_map>
+#include <vector>
 
 #include "ledbuffer.h"
 #include "matrixdraw.h"
+#include "decompressor.h"
+#include "options.h"
+#include "udpassembler.h"
+#include "deltadecoder.h"
+#include "metrics.h"
+#include "telemetry.h"
+#include "flowcontrol.h"
+#include "recording.h"
+#include "socketresponse.h"
+#include "decodestage.h"
+#include "channelset.h"
 
 #define STANDARD_DATA_HEADER_SIZE   24                                              // Size of the header for expanded data
 #define COMPRESSED_HEADER_SIZE      16                                              // Size of the header for compressed data
 #define LED_DATA_SIZE               sizeof(CRGB)                                    // Data size of an LED (24 bits or 3 bytes)
 
 // We allocate whatever the max packet is, and use it to validate incoming packets, so right now, it's set to the maximum
-// LED data packet you could have (header plus 3 RGBs per NUM_LED)
-
-#define COMPRESSED_HEADER_TAG (0x44415645)                                              // asci "DAVE" as header
+// LED data packet you could have (header plus 3 RGBs per NUM_LED).  The compressed header tags live in decompressor.h.
 
 extern volatile bool interrupt_received;
 
-// SocketResponse
+// SocketServer
+//
+// Handles incoming connections from the server and passes the data that comes in.  All sockets are non-blocking
+// and serviced from a single epoll loop, so a new master can connect while an old connection is still draining,
+// and reconnecting costs a round trip rather than seconds.  Because there's only the one thread, it remains the
+// single producer for the LEDBufferManager no matter how many connections are open.
 //
-// Response data sent back to server every time we receive a packet
+// With --udp, a datagram socket on the same port joins the loop.  One master can then feed many nodes with
+// a single multicast stream, and since a frame that loses a fragment is simply dropped, a bad moment on Wi-Fi
+// costs one frame instead of stalling everything queued behind it the way a TCP retransmit does.  UDP frames
+// get no SocketResponse, as there's no connection to send it on.
+//
+// With --decode-threads, compressed envelopes are handed to a DecodeStage rather than expanded here, and the
+// loop goes straight back to reading.  The expanded frames come back through an eventfd in the order they
+// arrived, and are committed here as before, so this thread stays the only one that queues frames, applies
+// deltas or writes the recording.
+//
+// With --channels, one server feeds several queues, one per channel, each answering a channel16 bit of its
+// own.  Frames are read into the pool those queues share before anyone knows which channel they're for, so
+// a frame for one channel is queued just as it arrived; only a frame for several of them is copied, once
+// for each extra channel.  Each channel keeps its own delta reference and flow control.
 
-struct SocketResponse
+class SocketServer
 {
-    uint32_t    size;              // 4
-    uint32_t    flashVersion;      // 4
-    double      currentClock;      // 8
-    double      oldestPacket;      // 8
-    double      newestPacket;      // 8
-    double      brightness;        // 8
-    double      wifiSignal;        // 8
-    uint32_t    bufferSize;        // 4
-    uint32_t    bufferPos;         // 4
-    uint32_t    fpsDrawing;        // 4
-    uint32_t    watts;             // 4
-};
+private:
 
-static_assert(sizeof(double) == 8);             // SocketResponse on wire uses 8 byte floats
-static_assert(sizeof(float)  == 4);             // PeakData on wire uses 4 byte floats
+    // Connection
+    //
+    // Each connection works through its packets incrementally as bytes arrive, reading the 24 byte header into
+    // its own buffer and then either the compressed payload into that same buffer or an uncompressed payload
+    // straight into a pooled frame.  When there are decode workers, a compressed payload goes into a frame
+    // from their pool instead, so the whole envelope can be handed over without copying it.
 
-// Two things must be true for this to work and interop with the C# side:  floats must be 8 bytes, not the default
-// of 4 for Arduino.  So that must be set in 'platformio.ini,' and you must ensure that you align things such that
-// floats land on byte multiples of 8; otherwise, you'll get packing bytes inserted.  Welcome to my world! Once upon
-// a time, I ported about a billion lines of x86 'pragma_pack(1)' code to the MIPS (davepl)!
+    enum class ReadState
+    {
+        Header,                     // Waiting for the first STANDARD_DATA_HEADER_SIZE bytes of a packet
+        CompressedBody,             // Reading a compressed envelope's payload into pBuffer, or pFrame for the decoder
+        RawBody                     // Reading an uncompressed payload directly into pFrame
+    };
 
-static_assert( sizeof(SocketResponse) == 64, "SocketResponse struct size is not what is expected - check alignment and float size" );
+    struct Connection
+    {
+        int                         fd;
+        ReadState                   state           = ReadState::Header;
+        std::unique_ptr<uint8_t []> pBuffer;                            // Header and compressed payload
+        size_t                      cbReceived      = 0;                // Bytes of the current stage received
+        size_t                      cbNeeded        = STANDARD_DATA_HEADER_SIZE;
+        LEDBufferPtr                pFrame;                             // Frame or envelope being read into, if any
+        uint8_t *                   pFrameBytes     = nullptr;
+        int64_t                     lastActivity    = 0;                // Monotonic nanos, for dropping stalled connections
+        uint8_t                     abPending[sizeof(SocketResponseEx)];    // Unsent tail of the last response
+        size_t                      cbPending       = 0;
+        bool                        bWatchingWrite  = false;
+        size_t                      iChannel        = 0;                // Channel whose queue the responses report on
+        uint64_t                    id              = 0;                // Tells connections apart when an fd is reused
+
+        Connection(int socket, size_t cbMaxPacket)
+            : fd(socket), pBuffer(std::make_unique<uint8_t []>(cbMaxPacket)), lastActivity(CAppTime::MonotonicNanos())
+        {
+        }
 
-// SocketServer
-//
-// Handles incoming connections from the server and passes the data that comes in
+        ~Connection()
+        {
+            close(fd);
+        }
 
-class SocketServer
-{
-private:
+        void ResetReadBuffer()
+        {
+            state       = ReadState::Header;
+            cbReceived  = 0;
+            cbNeeded    = STANDARD_DATA_HEADER_SIZE;
+            pFrame.reset();
+            pFrameBytes = nullptr;
+        }
+    };
+
+    // Channel
+    //
+    // What each channel we feed keeps to itself: its queue, the reference its deltas apply to, and how its
+    // queue is faring, for the responses
+
+    struct Channel
+    {
+        LEDBufferManager *          pManager = nullptr;             // Bound when the loop starts
+        DeltaDecoder                deltas;
+        QueueTrend                  queueTrend;
+        FlowController              flow;
+
+        Channel(size_t cLeds, int targetLeadMs)
+            : deltas(cLeds), flow(targetLeadMs)
+        {
+        }
+    };
 
     int                         _port;
     int                         _server_fd;
+    int                         _epoll_fd;
+    int                         _udp_fd;
     struct sockaddr_in          _address;
-    std::unique_ptr<uint8_t []> _pBuffer;
-    std::unique_ptr<uint8_t []> _abOutputBuffer;
     size_t                      _maximumPacketSize;
+    DecompressorSet             _decompressors;                 // Reused for every frame on every connection
+    bool                        _bExtendedResponse;             // Follow each SocketResponse with the extension
+    bool                        _bUdp;
+    std::string                 _multicastGroup;
+    int                         _firstChannel;                  // The channel16 bit of our first channel, from 1
+    uint16_t                    _channelMask;                   // Every channel16 bit that addresses us
+    std::vector<std::unique_ptr<Channel>> _channels;
+    size_t                      _iCommitted = 0;                // First channel the last frame committed went to
+    uint64_t                    _lastConnectionId = 0;
+    std::unique_ptr<uint8_t []> _pDatagram;                     // Receive buffer for one UDP datagram
+    NodeTelemetry               _telemetry;                     // RSSI and CPU use for the responses
+    std::string                 _recordPath;
+    std::unique_ptr<FrameRecorder> _pRecorder;                  // Only while recording
+    size_t                      _cDecodeThreads;
+    ThreadTuning                _decodeTuning;
+    std::unique_ptr<DecodeStage> _pDecoder;                     // Only with decode threads; outlives the connections
+    std::unordered_map<int, std::unique_ptr<Connection>> _connections;
 
 public:
 
-    size_t                      _cbReceived;
-
-    SocketServer(int port, size_t maxLEDs) :
+    SocketServer(int port, size_t maxLEDs, const NDPiOptions & options) :
         _port(port),
         _server_fd(-1),
+        _epoll_fd(-1),
+        _udp_fd(-1),
         _maximumPacketSize(STANDARD_DATA_HEADER_SIZE + LED_DATA_SIZE * maxLEDs),
-        _cbReceived(0)
+        _bExtendedResponse(options.extendedResponse),
+        _bUdp(options.udp),
+        _multicastGroup(options.udpMulticastGroup),
+        _firstChannel(options.channel),
+        _channelMask(ChannelMask(options.channel, options.channels)),
+        _recordPath(options.recordPath),
+        _cDecodeThreads(options.decodeThreads),
+        _decodeTuning(options.decodeTuning)
     {
-        _abOutputBuffer = std::make_unique<uint8_t []>(_maximumPacketSize);        // Must add +1 for LZ bug case in Arduino library if ever backported there
-        _pBuffer = std::make_unique<uint8_t []>(_maximumPacketSize);
         memset(&_address, 0, sizeof(_address));
+        for (size_t i = 0; i < options.channels; i++)
+            _channels.push_back(std::make_unique<Channel>(maxLEDs, options.targetLeadMs));
+    }
+
+    ~SocketServer()
+    {
+        release();
     }
 
     void release()
     {
+        _connections.clear();
+        _pDecoder.reset();
+        _pRecorder.reset();
+        if (_epoll_fd >= 0)
+        {
+            close(_epoll_fd);
+            _epoll_fd = -1;
+        }
+        if (_udp_fd >= 0)
+        {
+            close(_udp_fd);
+            _udp_fd = -1;
+        }
         if (_server_fd >= 0)
         {
             close(_server_fd);
@@ -125,10 +239,8 @@ public:
 
     bool begin()
     {
-        _cbReceived = 0;
-
         // Creating socket file descriptor
-        if ((_server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        if ((_server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
         {
             printf("socket error\n");
             release();
@@ -164,6 +276,29 @@ public:
             release();
             return false;
         }
+
+        if ((_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 || !Watch(_server_fd, EPOLLIN))
+        {
+            perror("epoll setup failed\n");
+            release();
+            return false;
+        }
+
+        if (_bUdp && !BeginUdp())
+        {
+            release();
+            return false;
+        }
+
+        if (!_recordPath.empty())
+        {
+            _pRecorder = std::make_unique<FrameRecorder>();
+            if (!_pRecorder->Open(_recordPath.c_str()))
+            {
+                release();
+                return false;
+            }
+        }
         return true;
     }
 
@@ -172,366 +307,865 @@ public:
         release();
         return;
     }
-    
-    // ProcessIncomingData
+
+    // ProcessIncomingConnectionsLoop
     //
-    // Takes the packet in raw form, decodes enough of it to inspect the command and channel, and then creates and pushes
-    // a new LEDBuffer for the data when appropriate.
+    // Socket server main ProcessIncomingConnectionsLoop - waits on every socket at once, accepting new connections
+    // and advancing each connection's packet parsing as data arrives, dispatching frames into our buffers and closing
+    // any connection where anything goes weird.  There's a manager for each channel, in order, all sharing a pool.
 
-    bool ProcessIncomingData(LEDBufferManager & bufferManager, std::span<const uint8_t> payload)
+    bool ProcessIncomingConnectionsLoop(std::span<LEDBufferManager * const> managers)
     {
-        const auto payloadData = payload.data();
-        uint16_t command16 = payloadData[1] << 8 | payloadData[0];
-        if (command16 == WIFI_COMMAND_PIXELDATA64)
+        if (managers.size() != _channels.size())
+        {
+            printf("The socket server feeds %zu channels but was given %zu queues\n", _channels.size(), managers.size());
+            return false;
+        }
+        for (size_t i = 0; i < managers.size(); i++)
+        {
+            if (&managers[i]->Pool() != &managers.front()->Pool())
+            {
+                printf("Every channel's queue must draw on the same pool\n");
+                return false;
+            }
+            _channels[i]->pManager = managers[i];
+        }
+
+        constexpr int kMaxEvents = 16;
+        epoll_event events[kMaxEvents];
+        UdpFrameAssembler assembler(FramePool());
+
+        // The decode workers expand into frames from the queues' pool, so they can only start once we know it
+
+        if (_cDecodeThreads > 0 && !_pDecoder)
+        {
+            _pDecoder = std::make_unique<DecodeStage>(FramePool(), _cDecodeThreads, _decodeTuning);
+            if (_pDecoder->EventFd() >= 0 && !Watch(_pDecoder->EventFd(), EPOLLIN))
+                perror("epoll setup for the decode stage failed");
+        }
+
+        while (!interrupt_received)
         {
-            uint16_t channel16 = WORDFromMemory(&payloadData[2]);
-            if (channel16 != 0 && (channel16 & 0x01) == 0)
+            if (0 > _epoll_fd)
             {
-                printf("Channel mismatch, not intended for us");
+                printf("No _epoll_fd, returning.");
                 return false;
             }
 
-            // Now we attempt to parse the data and add it to the buffer.  If the data can't be parsed properly, we'll
-            // catch the exception and return false.
-            
-            try
+            // Wake up periodically even when nothing arrives, so we notice ctrl-c, reap stalled connections
+            // and keep the server clock offset disciplined
+
+            int cEvents = epoll_wait(_epoll_fd, events, kMaxEvents, kSocketPollIntervalMs);
+            if (cEvents < 0)
             {
-                bufferManager.PushNewBuffer( LEDBuffer::CreateFromWire(payload) );
-                return true;
+                if (errno == EINTR)
+                    continue;
+                perror("epoll_wait");
+                return false;
             }
-            catch(const LEDBufferException & e)
+
+            for (int i = 0; i < cEvents; i++)
             {
-                std::cerr << e.what() << '\n';
+                const int fd = events[i].data.fd;
+                if (fd == _server_fd)
+                {
+                    AcceptConnections();
+                    continue;
+                }
+                if (fd == _udp_fd)
+                {
+                    ReadDatagrams(assembler);
+                    continue;
+                }
+                if (_pDecoder && fd == _pDecoder->EventFd())
+                {
+                    DrainDecoded();
+                    continue;
+                }
+
+                auto it = _connections.find(fd);
+                if (it == _connections.end())
+                    continue;
+
+                Connection & connection = *it->second;
+                bool bKeep = !(events[i].events & (EPOLLERR | EPOLLHUP)) || (events[i].events & EPOLLIN);
+                if (bKeep && (events[i].events & EPOLLOUT))
+                    bKeep = FlushPending(connection);
+                if (bKeep && (events[i].events & EPOLLIN))
+                    bKeep = ReadFromConnection(connection);
+
+                if (!bKeep)
+                    _connections.erase(it);
             }
+
+            if (_pDecoder)
+                DrainDecoded();
+            ReapStalledConnections();
+            CAppTime::Discipline();
         }
-        return false;
+        return true;
     }
 
-    void ResetReadBuffer()
+    bool ProcessIncomingConnectionsLoop(LEDBufferManager & bufferManager)
     {
-        _cbReceived = 0;
-        memset(_pBuffer.get(), 0, _maximumPacketSize);
+        LEDBufferManager * const pManager = &bufferManager;
+        return ProcessIncomingConnectionsLoop(std::span<LEDBufferManager * const>(&pManager, 1));
     }
 
-    // ReadUntilNBytesReceived
+private:
+
+    // FramePool
     //
-    // Read from the socket until the buffer contains at least cbNeeded bytes
+    // The pool every channel's frames come from
 
-    bool ReadUntilNBytesReceived(size_t socket, size_t cbNeeded)
+    LEDBufferPool & FramePool()
     {
-        if (cbNeeded <= _cbReceived)                            // If we already have that many bytes, we're already done
-            return true;
-
-        // This test caps maximum packet size as a full buffer read of LED data.  If other packets wind up being longer,
-        // the buffer itself and this test might need to change
+        return _channels.front()->pManager->Pool();
+    }
 
-        if (cbNeeded > _maximumPacketSize)
-            return false;
+    // BeginUdp
+    //
+    // Opens the datagram socket on our port and, if we were given a group, joins it on any interface
 
-        do
+    bool BeginUdp()
+    {
+        if ((_udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
         {
-            // If we're reading at a point in the buffer more than just the header, we're actually transferring data, so light up the LED
+            perror("udp socket error");
+            return false;
+        }
 
-            // Read data from the socket until we have _bcNeeded bytes in the buffer
+        // Several listeners on one box may want the same multicast stream, and a bigger receive buffer
+        // lets us take a whole frame's worth of fragments while the loop is busy elsewhere
 
-            int cbRead = 0;
-            do 
-            {
-                cbRead = read(socket, (uint8_t *) _pBuffer.get() + _cbReceived, cbNeeded - _cbReceived);
-            } while (cbRead < 0 && errno == EINTR);
+        int opt = 1;
+        setsockopt(_udp_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        int cbReceiveBuffer = kUdpReceiveBufferSize;
+        setsockopt(_udp_fd, SOL_SOCKET, SO_RCVBUF, &cbReceiveBuffer, sizeof(cbReceiveBuffer));
 
-            // Restore the old state
+        if (bind(_udp_fd, (struct sockaddr *)&_address, sizeof(_address)) < 0)
+        {
+            perror("udp bind failed");
+            return false;
+        }
 
-            if (cbRead > 0)
+        if (!_multicastGroup.empty())
+        {
+            struct ip_mreq membership = {};
+            if (inet_aton(_multicastGroup.c_str(), &membership.imr_multiaddr) == 0)
             {
-                _cbReceived += cbRead;
+                printf("Invalid multicast group: %s\n", _multicastGroup.c_str());
+                return false;
             }
-            else
+            membership.imr_interface.s_addr = htonl(INADDR_ANY);
+            if (setsockopt(_udp_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
             {
-                printf("ERROR: %d bytes read in ReadUntilNBytesReceived trying to read %ld\n", cbRead, cbNeeded-_cbReceived);
+                perror("joining multicast group failed");
                 return false;
             }
-        } while (_cbReceived < cbNeeded);
+            printf("Receiving UDP frames from multicast group %s\n", _multicastGroup.c_str());
+        }
+
+        _pDatagram = std::make_unique<uint8_t []>(kMaxUdpDatagramSize);
+        if (!Watch(_udp_fd, EPOLLIN))
+        {
+            perror("epoll setup for udp failed");
+            return false;
+        }
         return true;
     }
 
-    // ProcessIncomingConnectionsLoop
+    // ReadDatagrams
     //
-    // Socket server main ProcessIncomingConnectionsLoop - accepts new connections and reads from them, dispatching
-    // data packets into our buffer and closing the socket if anything goes weird.
+    // Drains the UDP socket, handing each fragment to the assembler and decoding any packet it completes.
+    // Nothing here ever closes the socket; a bad datagram or packet just gets dropped.
 
-    bool ProcessIncomingConnectionsLoop(LEDBufferManager & bufferManager)
+    void ReadDatagrams(UdpFrameAssembler & assembler)
     {
-        while (!interrupt_received)
+        while (true)
         {
-            if (0 >= _server_fd)
+            ssize_t cbRead;
+            {
+                ScopedLatency timer(Metrics().readTime);
+                cbRead = recv(_udp_fd, _pDatagram.get(), kMaxUdpDatagramSize, 0);
+            }
+            if (cbRead < 0)
             {
-                printf("No _server_fd, returning.");
-                continue;
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    printf("ERROR: udp receive failed: %s\n", strerror(errno));
+                return;
             }
 
-            int new_socket = 0;
+            size_t cbPacket;
+            LEDBufferPtr pPacket = assembler.AddFragment(_pDatagram.get(), cbRead, cbPacket);
+            if (pPacket)
+                ProcessDatagramPacket(std::move(pPacket), cbPacket);
+        }
+    }
+
+    // ProcessDatagramPacket
+    //
+    // A reassembled packet sits in its frame's wire image.  A raw one already is the frame, so it only needs
+    // checking and sizing; a compressed one expands into a second frame, and the first goes back to the pool.
+    // With decode workers that happens on one of them, and the packet's frame is the envelope they're given.
+
+    void ProcessDatagramPacket(LEDBufferPtr pPacket, size_t cbPacket)
+    {
+        const uint8_t * pWire = pPacket->WireImage().data();
+        const uint32_t  tag   = DWORDFromMemory(pWire);
+
+        if (_pRecorder)
+            _pRecorder->RecordWire(std::span<const uint8_t>(pWire, cbPacket), RecordTransport::Udp);
 
-            // Accept a new incoming connnection
-            int addrlen = sizeof(_address);
-            if ((new_socket = accept(_server_fd, (struct sockaddr *)&_address, (socklen_t*)&addrlen))<0)
+        if (DecompressorSet::IsCompressedTag(tag))
+        {
+            size_t cbTotal;
+            if (cbPacket < COMPRESSED_HEADER_SIZE || !CheckCompressedHeader(pWire, cbTotal) || cbTotal != cbPacket)
             {
-                printf("Error accepting data!");
-                continue;
+                printf("Dropping malformed compressed UDP packet\n");
+                return;
             }
+            if (_pDecoder)
+                SubmitEnvelope(std::move(pPacket));
+            else
+                ExpandCompressedFrame(pWire);
+            return;
+        }
 
-            // Report where this connection is coming from
+        if (cbPacket < STANDARD_DATA_HEADER_SIZE)
+        {
+            printf("Dropping UDP packet too small to hold a header\n");
+            return;
+        }
+
+        const auto frameHeader = WireFrameHeader::FromMemory(pWire);
+        if (STANDARD_DATA_HEADER_SIZE + frameHeader.PayloadSize() != cbPacket)
+        {
+            printf("UDP packet promises %zu bytes of payload but carries %zu\n", frameHeader.PayloadSize(), cbPacket - STANDARD_DATA_HEADER_SIZE);
+            return;
+        }
 
+        CommitInOrder(std::move(pPacket));
+    }
+
+    // Watch
+    //
+    // Adds a socket to the epoll set, or with bModify changes what we're waiting on it for
+
+    bool Watch(int fd, uint32_t events, bool bModify = false)
+    {
+        epoll_event ev = {};
+        ev.events  = events;
+        ev.data.fd = fd;
+        return 0 == epoll_ctl(_epoll_fd, bModify ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    // WatchForWrite
+    //
+    // We only ask epoll about writability while a response is stuck, since otherwise it would fire constantly
+
+    bool WatchForWrite(Connection & connection, bool bWrite)
+    {
+        if (connection.bWatchingWrite == bWrite)
+            return true;
+        connection.bWatchingWrite = bWrite;
+        return Watch(connection.fd, bWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN, true);
+    }
+
+    // AcceptConnections
+    //
+    // Accepts everything waiting on the listening socket.  Any number of masters may be connected at once.
+
+    void AcceptConnections()
+    {
+        while (true)
+        {
             struct sockaddr_in addr;
             socklen_t addr_size = sizeof(struct sockaddr_in);
-            if (0 != getpeername(new_socket, (struct sockaddr *)&addr, &addr_size))
+            int new_socket = accept4(_server_fd, (struct sockaddr *)&addr, &addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (new_socket < 0)
             {
-                close(new_socket);
-                ResetReadBuffer();
-                continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    printf("Error accepting data!");
+                return;
             }
 
-            printf("Incoming connection from: %s", inet_ntoa(addr.sin_addr));
+            // Report where this connection is coming from
+
+            printf("Incoming connection from: %s\n", inet_ntoa(addr.sin_addr));
+
+            // Responses are small and latency matters more than packing them
 
-            // Set a timeout of 3 seconds on the socket so we don't permanently hang on a corrupt or partial packet
+            int opt = 1;
+            setsockopt(new_socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
 
-            struct timeval to;
-            to.tv_sec = 3;
-            to.tv_usec = 0;
-            if (setsockopt(new_socket,SOL_SOCKET,SO_RCVTIMEO,&to,sizeof(to)) < 0)
+            auto pConnection = std::make_unique<Connection>(new_socket, _maximumPacketSize);
+            pConnection->id  = ++_lastConnectionId;
+            _connections.emplace(new_socket, std::move(pConnection));
+            if (!Watch(new_socket, EPOLLIN))
             {
-                printf("Unable to set read timeout on socket!");
-                close(new_socket);
-                ResetReadBuffer();
-                continue;
+                printf("Unable to watch new connection!");
+                _connections.erase(new_socket);
             }
+        }
+    }
 
-            if (_pBuffer == nullptr) 
+    // ReapStalledConnections
+    //
+    // Drops connections that have gone quiet for kConnectionTimeout, which is what the old blocking read timeout
+    // did, so we don't hang onto a corrupt or partial packet forever
+
+    void ReapStalledConnections()
+    {
+        const int64_t now = CAppTime::MonotonicNanos();
+        for (auto it = _connections.begin(); it != _connections.end(); )
+        {
+            if (now - it->second->lastActivity > (int64_t)(kConnectionTimeout * NANOS_PER_SECOND))
             {
-                printf("Buffer not allocated!");
-                close(new_socket);
-                ResetReadBuffer();
-                continue;
+                printf("Closing connection that has been idle for more than %.1f seconds\n", kConnectionTimeout);
+                it = _connections.erase(it);
             }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    // ReadFromConnection
+    //
+    // Reads whatever the socket has for us, advancing the connection's state machine as each stage completes.
+    // Returns false if the connection should be closed.
 
-            // Ensure the new_socket is valid
-            if (new_socket < 0) 
+    bool ReadFromConnection(Connection & connection)
+    {
+        while (true)
+        {
+            // Read data from the socket toward the end of the current stage, into either the connection's
+            // buffer or, for raw color data or an envelope for the decoder, the frame itself
+
+            uint8_t * pDest = connection.pFrame ? connection.pFrameBytes : connection.pBuffer.get();
+            ssize_t cbRead;
             {
-                printf("Invalid socket!");
-                ResetReadBuffer();
-                continue;
+                ScopedLatency timer(Metrics().readTime);
+                cbRead = read(connection.fd, pDest + connection.cbReceived, connection.cbNeeded - connection.cbReceived);
             }
 
-            do
+            if (cbRead < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return true;
+                printf("ERROR: read failed on connection: %s\n", strerror(errno));
+                return false;
+            }
+            if (cbRead == 0)
             {
-                bool bSendResponsePacket = false;
+                printf("Connection closed by master\n");
+                return false;
+            }
 
-                // Read until we have at least enough for the data header
-                if (false == ReadUntilNBytesReceived(new_socket, STANDARD_DATA_HEADER_SIZE))
-                {
-                    printf("Read error in getting header.\n");
-                    break;
-                }
+            connection.lastActivity = CAppTime::MonotonicNanos();
+            connection.cbReceived  += cbRead;
 
-                // Now that we have the header we can see how much more data is expected to follow
+            if (connection.cbReceived == connection.cbNeeded && !AdvanceState(connection))
+                return false;
+        }
+    }
 
-                const uint32_t header  = _pBuffer[3] << 24  | _pBuffer[2] << 16  | _pBuffer[1] << 8  | _pBuffer[0];
-                if (header == COMPRESSED_HEADER_TAG)
-                {
-                    uint32_t compressedSize = _pBuffer[7] << 24  | _pBuffer[6] << 16  | _pBuffer[5] << 8  | _pBuffer[4];
-                    uint32_t expandedSize   = _pBuffer[11] << 24 | _pBuffer[10] << 16 | _pBuffer[9] << 8  | _pBuffer[8];
-                    // Unused: uint32_t reserved       = _pBuffer[15] << 24 | _pBuffer[14] << 16 | _pBuffer[13] << 8 | _pBuffer[12];
-                    //printf("Compressed Header: compressedSize: %u, expandedSize: %u, reserved: %u", compressedSize, expandedSize, reserved);
-
-                    if (expandedSize > _maximumPacketSize)
-                    {
-                        printf("Expanded packet would be %u but buffer is only %lu !!!!\n", expandedSize, _maximumPacketSize);
-                        break;
-                    }
-
-                    if (false == ReadUntilNBytesReceived(new_socket, COMPRESSED_HEADER_SIZE + compressedSize))
-                    {
-                        printf("Could not read compressed data from stream\n");
-                        break;
-                    }
-                    //printf("Successfuly read %u bytes", COMPRESSED_HEADER_SIZE + compressedSize);
-
-                    auto pSourceBuffer = &_pBuffer[COMPRESSED_HEADER_SIZE];
-
-                    if (!DecompressBuffer(pSourceBuffer, compressedSize, _abOutputBuffer.get(), expandedSize))
-                    {
-                        printf("Error decompressing data\n");
-                        break;
-                    }
-
-                    auto payload = std::span<const uint8_t>(_abOutputBuffer.get(), expandedSize);
-                    if (false == ProcessIncomingData(bufferManager, payload))
-                    {
-                        printf("Error processing data\n");
-                        break;
-
-                    }
-                    ResetReadBuffer();
-                    bSendResponsePacket = true;
-                }
+    // AdvanceState
+    //
+    // Called when the current stage has all the bytes it asked for.  Works out what comes next, and when a frame
+    // is complete, pushes it and answers the master.
+
+    bool AdvanceState(Connection & connection)
+    {
+        switch (connection.state)
+        {
+            case ReadState::Header:
+                return ProcessHeader(connection);
+
+            case ReadState::CompressedBody:
+            {
+                const uint8_t * pEnvelope = connection.pFrame ? connection.pFrameBytes : connection.pBuffer.get();
+                if (_pRecorder)
+                    _pRecorder->RecordWire(std::span<const uint8_t>(pEnvelope, connection.cbNeeded), RecordTransport::Tcp);
+                if (connection.pFrame)
+                    SubmitEnvelope(std::move(connection.pFrame), connection.id);
+                else if (!ExpandCompressedFrame(pEnvelope))
+                    return false;
                 else
-                {     
-                    uint16_t command16   = WORDFromMemory(&_pBuffer.get()[0]);            
-                    if (command16 == WIFI_COMMAND_PIXELDATA64)
-                    {
-                        // We know it's pixel data, so we do some validation before calling Process.
-
-                        // Unused: uint16_t channel16 = WORDFromMemory(&_pBuffer.get()[2]);
-                        uint32_t length32  = DWORDFromMemory(&_pBuffer.get()[4]);
-                        // Unused: uint64_t seconds   = ULONGFromMemory(&_pBuffer.get()[8]);
-                        // Unused: uint64_t micros    = ULONGFromMemory(&_pBuffer.get()[16]);
-
-                        //printf("Uncompressed Header: channel16=%u, length=%u, seconds=%llu, micro=%llu", channel16, length32, seconds, micros);
-
-                        size_t totalExpected = STANDARD_DATA_HEADER_SIZE + length32 * LED_DATA_SIZE;
-                        if (totalExpected > _maximumPacketSize)
-                        {
-                            printf("Too many bytes promised (%zu) - more than we can use for our LEDs at max packet (%lu)\n", totalExpected, _maximumPacketSize);
-                            break;
-                        }
-
-                        //printf("Expecting %zu total bytes", totalExpected);
-                        if (false == ReadUntilNBytesReceived(new_socket, totalExpected))
-                        {
-                            printf("Error in getting pixel data from network\n");
-                            break;
-                        }
-
-                        // Add it to the buffer ring
-
-                        auto payload = std::span<const uint8_t>(_pBuffer.get(), totalExpected);
-                        if (false == ProcessIncomingData(bufferManager, payload))
-                        {
-                            printf("Error in processing pixel data from network\n");
-                            break;
-                        }
-
-                        // Consume the data by resetting the buffer
-                        //printf("Consuming the data as WIFI_COMMAND_PIXELDATA64 by setting _cbReceived to from %zu down 0.", _cbReceived);
-                        ResetReadBuffer();
-
-                        bSendResponsePacket = true;
-                    }
-                    else
-                    {
-                        printf("Unknown command in packet received: %u\n", command16);
-                        break;
-                    }
-                }
+                    connection.iChannel = _iCommitted;
+                break;
+            }
+
+            case ReadState::RawBody:
+                if (_pRecorder)
+                    _pRecorder->RecordWire(connection.pFrame->WireImage().first(STANDARD_DATA_HEADER_SIZE + connection.cbNeeded), RecordTransport::Tcp);
+                if (!CommitInOrder(std::move(connection.pFrame), connection.id))
+                    return false;
+                break;
+        }
+
+        // Consume the data by resetting the buffer, then let the master know where we stand
+        connection.ResetReadBuffer();
+        return SendResponse(connection);
+    }
+
+    // ProcessHeader
+    //
+    // Now that we have the header we can see how much more data is expected to follow
+
+    bool ProcessHeader(Connection & connection)
+    {
+        const uint8_t * pBuffer = connection.pBuffer.get();
+        const uint32_t header  = pBuffer[3] << 24  | pBuffer[2] << 16  | pBuffer[1] << 8  | pBuffer[0];
+
+        if (DecompressorSet::IsCompressedTag(header))
+        {
+            size_t cbTotal;
+            if (!CheckCompressedHeader(pBuffer, cbTotal))
+                return false;
+
+            // The header read already took the first few bytes of compressed data, so a payload smaller than
+            // that would mean we'd eaten into the next packet
 
-                // If we make it to this point, it should be success, so we consume
+            if (cbTotal < STANDARD_DATA_HEADER_SIZE)
+            {
+                printf("Compressed packet of %zu bytes is smaller than a header\n", cbTotal);
+                return false;
+            }
 
-                ResetReadBuffer();
+            // The decode workers need the envelope somewhere that can be handed to them, so it goes into one
+            // of their frames, starting with the part of it the header read already took
 
-                if (bSendResponsePacket)
+            if (_pDecoder)
+            {
+                connection.pFrame = _pDecoder->AcquireEnvelope();
+                if (!connection.pFrame)
                 {
-                    //printf("Sending Response Packet from Socket Server");
-
-                    SocketResponse response = {
-                                                .size = sizeof(SocketResponse),
-                                                .flashVersion = 0,
-                                                .currentClock = CAppTime::CurrentTime(),
-                                                .oldestPacket = bufferManager.AgeOfOldestBuffer(),
-                                                .newestPacket = bufferManager.AgeOfNewestBuffer(),
-                                                .brightness   = 100,
-                                                .wifiSignal   = 99,
-                                                .bufferSize   = (uint32_t)bufferManager.Capacity(),
-                                                .bufferPos    = (uint32_t)bufferManager.Size(),
-                                                .fpsDrawing   = (uint32_t)MatrixDraw::FPS(),
-                                                .watts        = 0
-                                            };
-
-                    // I dont think this is fatal, and doesn't affect the read buffer, so content to ignore for now if it happens
-                    try
-                    {
-                        if (sizeof(response) != write(new_socket, &response, sizeof(response)))
-                            printf("Unable to send response back to server.");
-                    }
-                    catch(const std::exception& e)
-                    {
-                        std::cerr << e.what() << '\n';
-                    }
-                    
+                    printf("No free envelopes for the decode stage\n");
+                    return false;
                 }
-            } while (true);
+                connection.pFrameBytes = connection.pFrame->WireImage().data();
+                memcpy(connection.pFrameBytes, pBuffer, STANDARD_DATA_HEADER_SIZE);
+            }
 
-            close(new_socket);
-            ResetReadBuffer();
-            sleep(1);
+            connection.state    = ReadState::CompressedBody;
+            connection.cbNeeded = cbTotal;
+            return connection.cbReceived < connection.cbNeeded || AdvanceState(connection);
         }
-        return true;
+
+        // We do some validation on the header before reading the payload straight into a pooled frame
+
+        const auto frameHeader = WireFrameHeader::FromMemory(pBuffer);
+
+        size_t totalExpected = STANDARD_DATA_HEADER_SIZE + frameHeader.PayloadSize();
+        if (totalExpected > _maximumPacketSize)
+        {
+            printf("Too many bytes promised (%zu) - more than we can use for our LEDs at max packet (%lu)\n", totalExpected, _maximumPacketSize);
+            return false;
+        }
+
+        if (false == CheckFrameHeader(frameHeader))
+        {
+            printf("Error in processing pixel data from network\n");
+            return false;
+        }
+
+        connection.pFrame = AcquireFrame();
+        if (!connection.pFrame)
+            return false;
+        connection.iChannel = std::countr_zero(AddressedChannels(frameHeader.channel16, _firstChannel, _channels.size()));
+
+        // The header goes into the frame's headroom so the frame holds the whole packet, just as if it had
+        // been expanded from an envelope
+
+        auto wireImage = connection.pFrame->WireImage();
+        memcpy(wireImage.data(), pBuffer, STANDARD_DATA_HEADER_SIZE);
+
+        connection.state       = ReadState::RawBody;
+        connection.pFrameBytes = wireImage.data() + STANDARD_DATA_HEADER_SIZE;
+        connection.cbReceived  = 0;
+        connection.cbNeeded    = frameHeader.PayloadSize();
+        return connection.cbNeeded > 0 || AdvanceState(connection);
     }
 
-    // DecompressBuffer
+    // CheckCompressedHeader
     //
-    // Use unzlib to decompress a memory buffer
+    // Validates a 16 byte compressed envelope header, from either transport, and works out the size of the whole
+    // envelope including its payload
 
-    bool DecompressBuffer(const uint8_t* pBuffer, size_t cBuffer, uint8_t* pOutput, size_t expectedOutputSize) 
+    bool CheckCompressedHeader(const uint8_t * pEnvelope, size_t & cbTotal)
     {
-        z_stream stream;
-        memset(&stream, 0, sizeof(stream));
+        const uint32_t header         = DWORDFromMemory(&pEnvelope[0]);
+        const uint32_t compressedSize = DWORDFromMemory(&pEnvelope[4]);
+        const uint32_t expandedSize   = DWORDFromMemory(&pEnvelope[8]);
+        // Unused: uint32_t reserved       = DWORDFromMemory(&pEnvelope[12]);
+
+        if (expandedSize > _maximumPacketSize || expandedSize < STANDARD_DATA_HEADER_SIZE)
+        {
+            printf("Expanded packet would be %u but buffer is only %lu !!!!\n", expandedSize, _maximumPacketSize);
+            return false;
+        }
+
+        cbTotal = COMPRESSED_HEADER_SIZE + (size_t)compressedSize;
+        if (cbTotal > _maximumPacketSize)
+        {
+            printf("Compressed packet of %u bytes is outside what we can accept\n", compressedSize);
+            return false;
+        }
+
+        if (!_decompressors.ForTag(header))
+        {
+            printf("Compressed packet uses a codec (tag %08X) this build doesn't support\n", header);
+            return false;
+        }
+        return true;
+    }
 
-        // Initialize the stream for decompression
-        stream.next_in   = const_cast<Bytef*>(pBuffer); // Input buffer
-        stream.avail_in  = cBuffer;                   // Input buffer size
-        stream.next_out  = pOutput;                   // Output buffer
-        stream.avail_out = expectedOutputSize;       // Output buffer size
+    // ExpandCompressedFrame
+    //
+    // Expand the whole frame here and now and commit it, for when there are no decode workers.  The envelope
+    // must already have passed CheckCompressedHeader.
 
-        // Choose appropriate initialization based on compression format
-        // Use -MAX_WBITS for raw deflate; for zlib/gzip header use different options
+    bool ExpandCompressedFrame(const uint8_t * pBuffer)
+    {
+        LEDBufferPtr pFrame = ExpandEnvelope(pBuffer, _decompressors, FramePool());
+        if (!pFrame)
+            return false;
 
-        int ret = inflateInit2(&stream, MAX_WBITS);  
-        if (ret != Z_OK) {
-            printf("ERROR: zlib inflateInit2 failed with code %d\n", ret);
+        if (false == CommitFrame(std::move(pFrame)))
+        {
+            printf("Error processing data\n");
             return false;
         }
+        return true;
+    }
+
+    // SubmitEnvelope
+    //
+    // Hands a checked envelope to the decode workers, once there's room for it.  Which channel the frame
+    // is for isn't known until it's expanded, so a connection's responses go on reporting on the channel
+    // its last frame went to until this one is taken back, and DrainDecoded catches them up.
+
+    void SubmitEnvelope(LEDBufferPtr pEnvelope, uint64_t connectionId = 0)
+    {
+        MakeRoom();
+        _pDecoder->Submit(std::move(pEnvelope), connectionId);
+    }
+
+    // CommitInOrder
+    //
+    // Commits a frame that arrived raw, unless envelopes that came before it are still being expanded, in
+    // which case it joins the decode stage's ring to wait its turn.  A frame that has to wait is committed
+    // when the ring gets to it, and if it turns out to be bad it is dropped, since by then the connection
+    // it came from has moved on.
 
-        // Perform the decompression
-        do 
+    bool CommitInOrder(LEDBufferPtr pFrame, uint64_t connectionId = 0)
+    {
+        if (_pDecoder)
         {
-            ret = inflate(&stream, Z_NO_FLUSH); // Use Z_NO_FLUSH for incremental decompression
-            if (ret == Z_STREAM_ERROR) 
+            DrainDecoded();
+            if (!_pDecoder->IsIdle())
+                MakeRoom();
+            if (!_pDecoder->IsIdle())
             {
-                printf("Stream error during decompression\n");
-                inflateEnd(&stream);
-                return false;
+                _pDecoder->SubmitReady(std::move(pFrame), connectionId);
+                return true;
             }
-            if (ret == Z_DATA_ERROR) 
+        }
+        if (!CommitFrame(std::move(pFrame)))
+            return false;
+        NoteChannel(connectionId);
+        return true;
+    }
+
+    // DrainDecoded
+    //
+    // Commits whatever the decode workers have finished, in the order it arrived, and points the connection
+    // each envelope came on, if it's still open, at the channel its frame went to.  CommitFrame says why it
+    // turns down a packet, and there's no connection left to close for it.
+
+    void DrainDecoded()
+    {
+        _pDecoder->Drain([this](LEDBufferPtr pFrame, uint64_t connectionId)
+        {
+            if (CommitFrame(std::move(pFrame)))
+                NoteChannel(connectionId);
+        });
+    }
+
+    // NoteChannel
+    //
+    // Points the responses of the connection a frame just committed came on, if it's still open, at the
+    // channel the frame went to.  Frames that came over UDP have no connection, and pass 0.
+
+    void NoteChannel(uint64_t connectionId)
+    {
+        if (connectionId == 0)
+            return;
+        for (auto & [fd, pConnection] : _connections)
+            if (pConnection->id == connectionId)
             {
-                printf("Data error during decompression (possibly corrupted data)\n");
-                inflateEnd(&stream);
-                return false;
+                pConnection->iChannel = _iCommitted;
+                return;
             }
-            if (ret == Z_MEM_ERROR) 
+    }
+
+    // MakeRoom
+    //
+    // Waits while the decode stage's ring is full, committing frames as the oldest of them finish
+
+    void MakeRoom()
+    {
+        while (!_pDecoder->HasRoom())
+        {
+            _pDecoder->WaitForOldest();
+            DrainDecoded();
+        }
+    }
+
+    // AcquireFrame
+    //
+    // Borrows a full-capacity frame from the pool for the color data to be read or inflated straight into
+
+    LEDBufferPtr AcquireFrame()
+    {
+        LEDBufferPtr pFrame = FramePool().Acquire();
+        if (!pFrame)
+            printf("No free frame buffers in the pool\n");
+        return pFrame;
+    }
+
+    // CheckFrameHeader
+    //
+    // Returns false unless the header is for pixel data, full or delta, or audio peaks, meant for one of our
+    // channels
+
+    bool CheckFrameHeader(const WireFrameHeader & header)
+    {
+        if (header.command16 != WIFI_COMMAND_PIXELDATA64 && header.command16 != WIFI_COMMAND_PIXELDELTA64 && header.command16 != WIFI_COMMAND_PEAKDATA)
+        {
+            printf("Unknown command in packet received: %u\n", header.command16);
+            return false;
+        }
+
+        if (header.channel16 != 0 && (header.channel16 & _channelMask) == 0)
+        {
+            printf("Channel mismatch, not intended for us\n");
+            return false;
+        }
+
+        if (header.command16 == WIFI_COMMAND_PEAKDATA && header.length32 > kMaxPeakBands)
+        {
+            printf("Peak packet has %u bands, more than the %d we handle\n", header.length32, kMaxPeakBands);
+            return false;
+        }
+        return true;
+    }
+
+    // PublishPeaks
+    //
+    // Audio peaks are a run of little-endian floats, one per band.  They go straight to the side channel, so
+    // whatever is drawing sees them as soon as they land, however deep the frame queue is.
+
+    void PublishPeaks(const WireFrameHeader & header, const uint8_t * pPayload, uint32_t addressed)
+    {
+        PeakData peaks;
+        peaks.cBands         = header.length32;
+        peaks.timestampNanos = (int64_t)(header.seconds * NANOS_PER_SECOND + header.micros * NANOS_PER_MICRO);
+        peaks.receivedNanos  = CAppTime::MonotonicNanos();
+        memcpy(peaks.peaks.data(), pPayload, header.length32 * sizeof(float));
+
+        for (size_t i = 0; i < _channels.size(); i++)
+            if (addressed & (1u << i))
+                _channels[i]->pManager->Peaks().Publish(peaks);
+        if (_pRecorder)
+            _pRecorder->RecordPeaks(std::span<const uint8_t>(pPayload - STANDARD_DATA_HEADER_SIZE, STANDARD_DATA_HEADER_SIZE + header.PayloadSize()), header);
+        Metrics().peakPackets.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // CommitFrame
+    //
+    // The frame's wire image now holds a complete packet, which goes to each channel it's addressed to.  Peaks
+    // borrow the frame only to be read into, and it goes straight back.  Only a bad packet returns false.
+    // A frame for several channels is copied for all but the last of them, each copy taken before anything
+    // is written to the frame, since every channel applies deltas to a reference of its own.  Each copy
+    // is recorded under its own channel's bit, so a replay gives every channel what it was shown.
+
+    bool CommitFrame(LEDBufferPtr pFrame)
+    {
+        const uint8_t * pWire  = pFrame->WireImage().data();
+        const auto      header = WireFrameHeader::FromMemory(pWire);
+
+        if (false == CheckFrameHeader(header))
+            return false;
+
+        uint32_t addressed = AddressedChannels(header.channel16, _firstChannel, _channels.size());
+        _iCommitted = std::countr_zero(addressed);
+        if (header.command16 == WIFI_COMMAND_PEAKDATA)
+        {
+            PublishPeaks(header, pWire + STANDARD_DATA_HEADER_SIZE, addressed);
+            return true;
+        }
+
+        const bool   bShared = std::popcount(addressed) > 1;
+        const size_t cbWire  = STANDARD_DATA_HEADER_SIZE + header.PayloadSize();
+        bool         bOK     = true;
+
+        while (addressed)
+        {
+            const size_t iChannel = std::countr_zero(addressed);
+            addressed &= addressed - 1;
+
+            LEDBufferPtr pTarget;
+            if (addressed)
             {
-                printf("Memory error during decompression\n");
-                inflateEnd(&stream);
-                return false;
+                if (!(pTarget = AcquireFrame()))
+                    continue;
+                memcpy(pTarget->WireImage().data(), pWire, cbWire);
             }
-            if (ret == Z_BUF_ERROR) 
+            else
             {
-                // Buffer error, not necessarily fatal, but output buffer may be too small
-                printf("Buffer error during decompression. Possibly insufficient output buffer size.\n");
+                pTarget = std::move(pFrame);
             }
-        } while (ret != Z_STREAM_END);
 
-        // Ensure the decompressed size matches the expected size
-        if (stream.total_out != expectedOutputSize) 
+            const uint16_t channel16 = bShared ? ChannelMask(_firstChannel + iChannel, 1) : header.channel16;
+            bOK = CommitToChannel(std::move(pTarget), header, *_channels[iChannel], channel16) && bOK;
+        }
+        return bOK;
+    }
+
+    // CommitToChannel
+    //
+    // A full frame is sized and timestamped in place and becomes the channel's new delta reference; a delta is
+    // applied to that reference.  Either way the result is queued.  A delta that doesn't apply is dropped
+    // without failing, since the stream itself is still in step.
+
+    bool CommitToChannel(LEDBufferPtr pFrame, const WireFrameHeader & header, Channel & channel, uint16_t channel16)
+    {
+        if (header.command16 == WIFI_COMMAND_PIXELDELTA64)
         {
-            printf("Expected %zu bytes, but decompressed to %lu bytes instead\n", expectedOutputSize, stream.total_out);
-            inflateEnd(&stream);
-            return false;
+            if (channel.deltas.ApplyDelta(header, pFrame->WireImage().data() + STANDARD_DATA_HEADER_SIZE, *pFrame))
+            {
+                if (_pRecorder)
+                    _pRecorder->RecordFrame(*pFrame, channel16);
+                channel.pManager->PushNewBuffer(std::move(pFrame));
+            }
+            else
+                Metrics().deltasDropped.fetch_add(1, std::memory_order_relaxed);
+            return true;
         }
 
-        // Clean up the stream
-        inflateEnd(&stream);
+        // If the frame can't be accommodated, we'll catch the exception and reject it
 
-        // Success
+        try
+        {
+            pFrame->SetSize(header.length32);
+            pFrame->SetTimestamp(header.seconds, header.micros);
+        }
+        catch(const LEDBufferException & e)
+        {
+            std::cerr << e.what() << '\n';
+            return false;
+        }
+
+        channel.deltas.OnKeyframe(*pFrame);
+        if (_pRecorder)
+            _pRecorder->RecordFrame(*pFrame, channel16);
+        channel.pManager->PushNewBuffer(std::move(pFrame));
         return true;
     }
+
+    // SendResponse
+    //
+    // Response data sent back to the master after every frame, about the queue of the channel its last frame
+    // went to.  The socket is non-blocking, so if it won't take the whole response right now we hold onto the
+    // rest and wait for it to become writable.
+
+    bool SendResponse(Connection & connection)
+    {
+        Channel &               channel       = *_channels[connection.iChannel];
+        LEDBufferManager &      bufferManager = *channel.pManager;
+        const LEDBufferSnapshot snapshot      = bufferManager.Snapshot();
+        const PipelineMetrics & metrics       = Metrics();
+        const double            fps           = MatrixDraw::FPS();
+
+        _telemetry.Sample();
+        channel.queueTrend.Update(snapshot.size, CAppTime::MonotonicNanos());
+        const FlowHint hint = channel.flow.Update(snapshot, bufferManager.Capacity(), bufferManager.FramesOverwritten());
+
+        SocketResponseEx responseEx = {
+                                        .response = {
+                                            .size = (uint32_t)(_bExtendedResponse ? sizeof(SocketResponseEx) : sizeof(SocketResponse)),
+                                            .flashVersion = 0,
+                                            .currentClock = CAppTime::CurrentTime(),
+                                            .oldestPacket = snapshot.oldestAge,
+                                            .newestPacket = snapshot.newestAge,
+                                            .brightness   = MatrixDraw::Brightness(),
+                                            .wifiSignal   = _telemetry.Rssi(),
+                                            .bufferSize   = (uint32_t)bufferManager.Capacity(),
+                                            .bufferPos    = (uint32_t)snapshot.size,
+                                            .fpsDrawing   = (uint32_t)(fps + 0.5),
+                                            .watts        = (MatrixDraw::Milliwatts() + 500) / 1000
+                                        },
+                                        .version           = kSocketResponseVersion,
+                                        .supportedCodecs   = DecompressorSet::SupportedCodecs(),
+                                        .flags             = channel.deltas.KeyframeNeeded() ? kResponseFlagKeyframeNeeded : 0,
+                                        .cpuPercent        = (uint32_t)(_telemetry.CpuPercent() + 0.5),
+                                        .framesPresented   = metrics.framesPresented.load(std::memory_order_relaxed),
+                                        .framesDropped     = metrics.framesDropped.load(std::memory_order_relaxed),
+                                        .framesLate        = metrics.framesLate.load(std::memory_order_relaxed),
+                                        .framesOverwritten = bufferManager.FramesOverwritten(),
+                                        .decodeErrors      = metrics.decodeErrors.load(std::memory_order_relaxed),
+                                        .deltasDropped     = metrics.deltasDropped.load(std::memory_order_relaxed),
+                                        .fps               = fps,
+                                        .queueAverage      = (float)channel.queueTrend.Average(),
+                                        .queueTrend        = (float)channel.queueTrend.Slope(),
+                                        .targetLeadMs      = (uint32_t)channel.flow.TargetLeadMs(),
+                                        .leadMs            = (float)(channel.flow.Lead() * 1000),
+                                        .flowHint          = (uint32_t)hint,
+                                        .reserved          = 0
+                                    };
+
+        // If part of the last response is still waiting to go out, we have to let it finish rather than splice
+        // a new one into the stream, so this one is skipped; the master will hear from us after the next frame
+
+        if (connection.cbPending > 0)
+            return true;
+
+        const size_t cbResponse = responseEx.response.size;
+        memcpy(connection.abPending, &responseEx, cbResponse);
+        connection.cbPending = cbResponse;
+        return FlushPending(connection);
+    }
+
+    // FlushPending
+    //
+    // Writes as much of the pending response as the socket will take.  Failing to send isn't fatal, as it
+    // doesn't affect the read side, so only a dead socket closes the connection.
+
+    bool FlushPending(Connection & connection)
+    {
+        while (connection.cbPending > 0)
+        {
+            ssize_t cbWritten = send(connection.fd, connection.abPending, connection.cbPending, MSG_NOSIGNAL);
+            if (cbWritten < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return WatchForWrite(connection, true);
+                printf("Unable to send response back to server.");
+                return false;
+            }
+            memmove(connection.abPending, connection.abPending + cbWritten, connection.cbPending - cbWritten);
+            connection.cbPending -= cbWritten;
+        }
+        return WatchForWrite(connection, false);
+    }
 };
@@ -0,0 +1,162 @@
+//+--------------------------------------------------------------------------
+//
+// File:        Telemetry.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    The measurements we report back to the server in each SocketResponse:
+//    signal strength, CPU use, queue trends and an estimate of the power
+//    the panels are drawing.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <time.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+
+#include "globals.h"
+#include "apptime.h"
+#include "pixeltypes.h"
+#include "pixelops.h"
+
+// EstimateMilliwatts
+//
+// What a frame costs to show, from the summed value of each channel.  Real panels vary, so this is a
+// guide for the server's power budgeting and our own limiter rather than a measurement.
+
+inline uint32_t EstimateMilliwatts(const PixelOps::ChannelSums & sums, uint8_t brightness)
+{
+    const double fullScale = sums.red * kRedMilliwattsPerLed + sums.green * kGreenMilliwattsPerLed + sums.blue * kBlueMilliwattsPerLed;
+    return (uint32_t)(fullScale / 255.0 * brightness / 100.0);
+}
+
+inline uint32_t EstimateMilliwatts(std::span<const CRGB> pixels, uint8_t brightness)
+{
+    return EstimateMilliwatts(PixelOps::SumChannels(pixels), brightness);
+}
+
+// QueueTrend
+//
+// Smoothed queue depth and how fast it's changing, in frames per second, so the server can tell a queue
+// that's filling from one that just happens to be deep
+
+class QueueTrend
+{
+    double  _average;
+    double  _slope;
+    int64_t _lastNanos;
+
+  public:
+
+    QueueTrend() : _average(0), _slope(0), _lastNanos(0)
+    {
+    }
+
+    double Average() const { return _average; }
+    double Slope()   const { return _slope;   }
+
+    void Update(size_t depth, int64_t nowNanos)
+    {
+        const double previous = _average;
+        _average += kQueueTrendSmoothing * ((double)depth - _average);
+
+        if (_lastNanos != 0 && nowNanos > _lastNanos)
+        {
+            const double rate = (_average - previous) * NANOS_PER_SECOND / (nowNanos - _lastNanos);
+            _slope += kQueueTrendSmoothing * (rate - _slope);
+        }
+        _lastNanos = nowNanos;
+    }
+};
+
+// NodeTelemetry
+//
+// Samples the slower-moving system numbers no more than once every kTelemetrySampleIntervalMs, since
+// responses go out after every frame and neither needs to be fresher than that.  Socket thread only.
+
+class NodeTelemetry
+{
+    int64_t _lastSampleNanos;
+    int64_t _lastCpuNanos;
+    double  _rssi;                                          // dBm, or 0 without a wireless interface
+    double  _cpuPercent;                                    // Of one core, so can exceed 100 on a Pi with several
+
+    static int64_t ProcessCpuNanos()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return (int64_t)ts.tv_sec * NANOS_PER_SECOND + ts.tv_nsec;
+    }
+
+    // ReadRssi
+    //
+    // Takes the signal level of the first interface in /proc/net/wireless, after its two header lines
+
+    static double ReadRssi()
+    {
+        FILE * file = fopen(kWirelessStatsPath, "r");
+        if (!file)
+            return 0;
+
+        char   line[256];
+        double level = 0;
+        for (int i = 0; fgets(line, sizeof(line), file); i++)
+        {
+            char name[32];
+            if (i >= 2 && sscanf(line, " %31[^:]: %*s %*f %lf", name, &level) == 2)
+                break;
+            level = 0;
+        }
+        fclose(file);
+        return level;
+    }
+
+  public:
+
+    NodeTelemetry()
+        : _lastSampleNanos(0), _lastCpuNanos(ProcessCpuNanos()), _rssi(0), _cpuPercent(0)
+    {
+    }
+
+    double Rssi()       const { return _rssi;       }
+    double CpuPercent() const { return _cpuPercent; }
+
+    void Sample()
+    {
+        const int64_t now = CAppTime::MonotonicNanos();
+        if (_lastSampleNanos != 0 && now - _lastSampleNanos < kTelemetrySampleIntervalMs * NANOS_PER_MICRO * 1000)
+            return;
+
+        const int64_t cpu = ProcessCpuNanos();
+        if (_lastSampleNanos != 0)
+            _cpuPercent = 100.0 * (cpu - _lastCpuNanos) / (now - _lastSampleNanos);
+
+        _rssi            = ReadRssi();
+        _lastCpuNanos    = cpu;
+        _lastSampleNanos = now;
+    }
+};
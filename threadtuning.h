@@ -0,0 +1,262 @@
+//+--------------------------------------------------------------------------
+//
+// File:        ThreadTuning.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Places each stage's threads on the CPUs it's been given, at the
+//    priority it's been given, so network reads, decoding and drawing can
+//    each keep a core to themselves and frame timing doesn't wander.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#include "globals.h"
+
+// CpuList
+//
+// The CPUs a stage's threads may run on.  An empty list leaves them wherever the kernel puts them.
+
+struct CpuList
+{
+    cpu_set_t set;
+
+    CpuList()
+    {
+        CPU_ZERO(&set);
+    }
+
+    bool IsEmpty() const
+    {
+        return CPU_COUNT(&set) == 0;
+    }
+
+    // ToString
+    //
+    // The list as it would be written on the command line, like 1-3,5
+
+    std::string ToString() const
+    {
+        std::string text;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (!CPU_ISSET(cpu, &set))
+                continue;
+            int last = cpu;
+            while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set))
+                last++;
+
+            if (!text.empty())
+                text += ',';
+            text += std::to_string(cpu);
+            if (last > cpu)
+                text += '-' + std::to_string(last);
+            cpu = last;
+        }
+        return text;
+    }
+};
+
+// ParseCpuList
+//
+// Reads a comma separated list of CPUs and ranges of them, like 2,3 or 1-3
+
+inline bool ParseCpuList(const char * text, CpuList & cpus)
+{
+    CpuList parsed;
+    const char * p = text;
+    while (*p)
+    {
+        char * pEnd;
+        const long first = strtol(p, &pEnd, 10);
+        if (pEnd == p)
+            return false;
+        long last = first;
+        p = pEnd;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &pEnd, 10);
+            if (pEnd == p + 1)
+                return false;
+            p = pEnd;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            return false;
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, &parsed.set);
+
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return false;
+    }
+    if (parsed.IsEmpty())
+        return false;
+    cpus = parsed;
+    return true;
+}
+
+// StartupCpus
+//
+// The CPUs the process was started with, taken the first time anything asks, which PinCurrentThread makes
+// sure is before any thread has been moved
+
+inline const CpuList & StartupCpus()
+{
+    static const CpuList cpus = []()
+    {
+        CpuList current;
+        if (sched_getaffinity(0, sizeof(current.set), &current.set) != 0)
+            CPU_ZERO(&current.set);
+        return current;
+    }();
+    return cpus;
+}
+
+// PinCurrentThread
+//
+// Confines the calling thread to the stage's CPUs, saying so if the kernel won't have it, as it won't for
+// CPUs that are offline or outside our cpuset.  Threads inherit their creator's CPUs, so a stage with none
+// of its own goes back to the ones we started with, rather than staying on those of whatever stage
+// started it.
+
+inline bool PinCurrentThread(const char * pszStage, const CpuList & cpus)
+{
+    const CpuList & startup = StartupCpus();
+    const CpuList & target  = cpus.IsEmpty() ? startup : cpus;
+    if (target.IsEmpty())
+        return true;
+
+    const int err = pthread_setaffinity_np(pthread_self(), sizeof(target.set), &target.set);
+    if (err != 0)
+    {
+        printf("Couldn't pin the %s thread to CPUs %s: %s\n", pszStage, target.ToString().c_str(), strerror(err));
+        return false;
+    }
+    return true;
+}
+
+// ThreadTuning
+//
+// Where a stage's threads run and how they're scheduled.  A priority of 0 is the normal time-shared
+// scheduler; 1 up to kMaxRealtimePriority is SCHED_FIFO, where a thread runs until it blocks or something
+// of a higher priority wants the CPU.
+
+struct ThreadTuning
+{
+    CpuList cpus;
+    int     priority = 0;
+};
+
+// ParsePriority
+//
+// Reads a SCHED_FIFO priority, or 0 for the normal scheduler
+
+inline bool ParsePriority(const char * text, int & priority)
+{
+    char * pEnd;
+    const long value = strtol(text, &pEnd, 10);
+    if (pEnd == text || *pEnd || value < 0 || value > kMaxRealtimePriority)
+        return false;
+    priority = (int)value;
+    return true;
+}
+
+// SetCurrentThreadPriority
+//
+// Puts the calling thread under SCHED_FIFO at the given priority, or back under the normal scheduler for 0,
+// since threads inherit their creator's scheduling too.  Says so if the kernel won't have it.
+
+inline bool SetCurrentThreadPriority(const char * pszStage, int priority)
+{
+    sched_param param = {};
+    param.sched_priority = priority;
+    const int err = pthread_setschedparam(pthread_self(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+    if (err != 0)
+    {
+        printf("Couldn't give the %s thread SCHED_FIFO priority %d: %s\n", pszStage, priority, strerror(err));
+        return false;
+    }
+    return true;
+}
+
+// TuneCurrentThread
+//
+// Applies a stage's CPUs and priority to the calling thread, which every stage's threads do first thing
+
+inline bool TuneCurrentThread(const char * pszStage, const ThreadTuning & tuning)
+{
+    const bool bPinned = PinCurrentThread(pszStage, tuning.cpus);
+    return SetCurrentThreadPriority(pszStage, tuning.priority) && bPinned;
+}
+
+// ReserveRealtimeLimits
+//
+// Called while we're still root, before the matrix library drops to an unprivileged user.  Raising the
+// RLIMIT_RTPRIO ceiling to the highest priority we'll ask for lets each thread set its own later on, and with
+// bLockMemory, every page we touch from now on stays resident, so the draw path never waits on a page fault.
+// MCL_ONFAULT keeps the thread stacks from being locked in whole, which a Pi Zero 2 can't spare.
+
+inline bool ReserveRealtimeLimits(int maxPriority, bool bLockMemory)
+{
+    // Raising the limits takes root, but a thread with CAP_SYS_NICE doesn't need them, so failing here isn't
+    // worth a word; any thread that then can't have its priority says so itself
+
+    rlimit current;
+    if (maxPriority > 0 && getrlimit(RLIMIT_RTPRIO, &current) == 0 && current.rlim_cur != RLIM_INFINITY && current.rlim_cur < (rlim_t)maxPriority)
+    {
+        const rlimit limit = { (rlim_t)maxPriority, std::max(current.rlim_max, (rlim_t)maxPriority) };
+        setrlimit(RLIMIT_RTPRIO, &limit);
+    }
+
+    // With MCL_FUTURE, every allocation past RLIMIT_MEMLOCK would fail outright, so we only lock if the limit
+    // can be lifted
+
+    if (bLockMemory)
+    {
+        const rlimit unlimited = { RLIM_INFINITY, RLIM_INFINITY };
+        if (setrlimit(RLIMIT_MEMLOCK, &unlimited) != 0 && (getrlimit(RLIMIT_MEMLOCK, &current) != 0 || current.rlim_cur != RLIM_INFINITY))
+        {
+            printf("Couldn't lock memory: the locked memory limit can't be lifted: %s\n", strerror(errno));
+            return false;
+        }
+        if (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) != 0)
+        {
+            printf("Couldn't lock memory: %s\n", strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,238 @@
+//+--------------------------------------------------------------------------
+//
+// File:        UdpAssembler.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Reassembles packets that arrive as UDP fragments.  Each datagram
+//    carries a UdpFragmentHeader followed by a slice of an ordinary
+//    NightDriver packet - exactly the bytes that would have been sent over
+//    TCP, raw or compressed - so once every slice is in, the packet is
+//    decoded the same way as one from a stream.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "globals.h"
+#include "ledbuffer.h"
+#include "metrics.h"
+
+#define UDP_FRAGMENT_TAG            (0x44554450)                                    // ascii "DUDP"
+
+// UdpFragmentHeader
+//
+// Little-endian on the wire, like everything else.  All fragments of one packet share a sequence number and
+// total size; offset says where this fragment's payload goes in the packet.
+
+struct UdpFragmentHeader
+{
+    uint32_t tag;                   // UDP_FRAGMENT_TAG
+    uint32_t sequence;              // Increments by one for every packet the master sends
+    uint32_t offset;                // Byte offset of this fragment's payload within the packet
+    uint32_t totalSize;             // Size of the whole reassembled packet
+    uint16_t fragmentIndex;         // 0 .. fragmentCount-1
+    uint16_t fragmentCount;
+
+    static constexpr size_t kSize = 20;
+
+    static constexpr UdpFragmentHeader FromMemory(const uint8_t * p)
+    {
+        return UdpFragmentHeader
+        {
+            .tag           = DWORDFromMemory(&p[0]),
+            .sequence      = DWORDFromMemory(&p[4]),
+            .offset        = DWORDFromMemory(&p[8]),
+            .totalSize     = DWORDFromMemory(&p[12]),
+            .fragmentIndex = WORDFromMemory(&p[16]),
+            .fragmentCount = WORDFromMemory(&p[18])
+        };
+    }
+};
+
+// UdpFrameAssembler
+//
+// Collects one packet at a time straight into a pooled frame's wire image, which for a raw packet is already
+// the frame, header and all.  A fragment from a newer packet abandons whatever was being assembled, so a lost
+// fragment costs exactly one frame and never holds up the ones behind it; fragments from older packets are
+// simply ignored.
+
+class UdpFrameAssembler
+{
+    LEDBufferPool &      _pool;
+    LEDBufferPtr         _pAssembly;                        // Frame the current packet is being assembled into
+    uint32_t             _sequence;                         // Sequence number of the packet being assembled
+    uint32_t             _totalSize;
+    uint16_t             _fragmentCount;
+    uint16_t             _fragmentsReceived;
+    std::vector<uint8_t> _received;                         // Which fragments of the current packet have arrived
+    std::vector<uint32_t> _fragmentStarts;                  // Where each fragment that's arrived starts in the packet
+    std::vector<uint32_t> _fragmentEnds;                    // And where it ends
+    bool                 _bAssembling;
+    bool                 _bAnySequence;                     // False until the first packet, so any sequence is new
+
+    void Abandon()
+    {
+        if (_bAssembling)
+            Metrics().udpPacketsDropped.fetch_add(1, std::memory_order_relaxed);
+        _bAssembling = false;
+        _pAssembly.reset();
+    }
+
+    // IsNewer
+    //
+    // Sequence comparison that tolerates wraparound
+
+    static constexpr bool IsNewer(uint32_t a, uint32_t b)
+    {
+        return (int32_t)(a - b) > 0;
+    }
+
+    // IsCovered
+    //
+    // Whether the fragments, taken in index order, each start where the one before ended and together fill the
+    // whole packet.  Having every index isn't enough: overlapping or short fragments would leave holes of
+    // whatever the pooled frame last held.
+
+    bool IsCovered() const
+    {
+        uint32_t next = 0;
+        for (size_t i = 0; i < _fragmentCount; i++)
+        {
+            if (_fragmentStarts[i] != next)
+                return false;
+            next = _fragmentEnds[i];
+        }
+        return next == _totalSize;
+    }
+
+  public:
+
+    explicit UdpFrameAssembler(LEDBufferPool & pool)
+        : _pool(pool),
+          _sequence(0),
+          _totalSize(0),
+          _fragmentCount(0),
+          _fragmentsReceived(0),
+          _received(kMaxUdpFragments),
+          _fragmentStarts(kMaxUdpFragments),
+          _fragmentEnds(kMaxUdpFragments),
+          _bAssembling(false),
+          _bAnySequence(true)
+    {
+    }
+
+    // AddFragment
+    //
+    // Takes one datagram.  When it completes a packet, returns the frame holding it and sets cbPacket to its
+    // size; the packet bytes start at the frame's WireImage().  Otherwise returns an empty pointer.
+
+    LEDBufferPtr AddFragment(const uint8_t * pDatagram, size_t cbDatagram, size_t & cbPacket)
+    {
+        cbPacket = 0;
+        if (cbDatagram < UdpFragmentHeader::kSize)
+            return LEDBufferPtr();
+
+        const auto header    = UdpFragmentHeader::FromMemory(pDatagram);
+        const auto cbPayload = cbDatagram - UdpFragmentHeader::kSize;
+
+        if (header.tag != UDP_FRAGMENT_TAG || header.fragmentCount == 0 || header.fragmentCount > kMaxUdpFragments ||
+            header.fragmentIndex >= header.fragmentCount || (size_t)header.offset + cbPayload > header.totalSize)
+        {
+            printf("Malformed UDP fragment ignored\n");
+            return LEDBufferPtr();
+        }
+
+        if (!_bAnySequence && _bAssembling && header.sequence == _sequence)
+        {
+            if (header.totalSize != _totalSize || header.fragmentCount != _fragmentCount)
+            {
+                printf("UDP fragment disagrees with the rest of its packet\n");
+                Abandon();
+                return LEDBufferPtr();
+            }
+        }
+        else if (_bAnySequence || IsNewer(header.sequence, _sequence))
+        {
+            // First fragment we've seen of a newer packet, so whatever we had is never going to be finished
+
+            Abandon();
+            _bAnySequence = false;
+            _sequence     = header.sequence;
+
+            _pAssembly = _pool.Acquire();
+            if (!_pAssembly)
+            {
+                printf("No free frame buffers in the pool for UDP packet\n");
+                Metrics().udpPacketsDropped.fetch_add(1, std::memory_order_relaxed);
+                return LEDBufferPtr();
+            }
+
+            if (header.totalSize > _pAssembly->WireImage().size())
+            {
+                printf("UDP packet of %u bytes is larger than a frame can hold\n", header.totalSize);
+                _pAssembly.reset();
+                Metrics().udpPacketsDropped.fetch_add(1, std::memory_order_relaxed);
+                return LEDBufferPtr();
+            }
+
+            _bAssembling       = true;
+            _totalSize         = header.totalSize;
+            _fragmentCount     = header.fragmentCount;
+            _fragmentsReceived = 0;
+            std::fill(_received.begin(), _received.begin() + _fragmentCount, 0);
+        }
+        else
+        {
+            return LEDBufferPtr();          // Straggler from a packet we've already finished or given up on
+        }
+
+        if (!_bAssembling || _received[header.fragmentIndex])
+            return LEDBufferPtr();
+
+        memcpy(_pAssembly->WireImage().data() + header.offset, pDatagram + UdpFragmentHeader::kSize, cbPayload);
+        _received[header.fragmentIndex]       = 1;
+        _fragmentStarts[header.fragmentIndex] = header.offset;
+        _fragmentEnds[header.fragmentIndex]   = header.offset + cbPayload;
+
+        if (++_fragmentsReceived < _fragmentCount)
+            return LEDBufferPtr();
+
+        if (!IsCovered())
+        {
+            printf("UDP packet's fragments leave gaps, so it was dropped\n");
+            Abandon();
+            return LEDBufferPtr();
+        }
+
+        _bAssembling = false;
+        Metrics().udpPacketsComplete.fetch_add(1, std::memory_order_relaxed);
+        cbPacket = _totalSize;
+        return std::move(_pAssembly);
+    }
+};
@@ -0,0 +1,109 @@
+//+--------------------------------------------------------------------------
+//
+// File:        WireEncoder.h
+//
+// NightDriverPi - (c) 2024 Plummer's Software LLC.  All Rights Reserved.
+//
+// This file is part of the NightDriver software project.
+//
+//    NightDriver is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    NightDriver is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Nightdriver.  It is normally found in copying.txt
+//    If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Description:
+//
+//    Builds packets the way a NightDriver master sends them, for the tools
+//    that stand in for one: a PIXELDATA64 header and the color data, and
+//    optionally the "DAVE" zlib envelope around the two.
+//
+// History:     Oct-14-2026                 Created
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <zlib.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "globals.h"
+#include "apptime.h"
+#include "pixeltypes.h"
+#include "ledbuffer.h"
+#include "decompressor.h"
+
+// WireEncoder
+//
+// Holds its own packet and envelope buffers, sized for the largest frame up front, so encoding a frame never
+// allocates.  A compression level of -1 sends frames raw; 0 to 9 are zlib's levels.  The span returned is
+// valid until the next call.
+
+class WireEncoder
+{
+    const int            _level;
+    std::vector<uint8_t> _packet;               // Header and color data
+    std::vector<uint8_t> _envelope;             // The compressed form, if compressing
+
+    static void PutDWORD(uint8_t * p, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            p[i] = (uint8_t)(value >> (8 * i));
+    }
+
+  public:
+
+    WireEncoder(size_t cMaxLeds, int compressionLevel = -1)
+        : _level(compressionLevel),
+          _packet(WireFrameHeader::kSize + cMaxLeds * sizeof(CRGB)),
+          _envelope(compressionLevel >= 0 ? 16 + compressBound(_packet.size()) : 0)
+    {
+    }
+
+    constexpr int CompressionLevel() const { return _level; }
+
+    // EncodeFrame
+    //
+    // One frame of pixels for the given channels, due at a time in server nanoseconds.  Returns an empty
+    // span if the frame is larger than we were built for or won't compress.
+
+    std::span<const uint8_t> EncodeFrame(std::span<const CRGB> pixels, uint16_t channel16, int64_t dueNanos)
+    {
+        const size_t cbPacket = WireFrameHeader::kSize + pixels.size_bytes();
+        if (cbPacket > _packet.size())
+            return {};
+
+        const WireFrameHeader header { WIFI_COMMAND_PIXELDATA64, channel16, (uint32_t)pixels.size(),
+                                       (uint64_t)(dueNanos / NANOS_PER_SECOND), (uint64_t)((dueNanos % NANOS_PER_SECOND) / NANOS_PER_MICRO) };
+        header.ToMemory(_packet.data());
+        memcpy(_packet.data() + WireFrameHeader::kSize, pixels.data(), pixels.size_bytes());
+
+        if (_level < 0)
+            return std::span<const uint8_t>(_packet.data(), cbPacket);
+
+        uLongf cbCompressed = _envelope.size() - 16;
+        if (Z_OK != compress2(_envelope.data() + 16, &cbCompressed, _packet.data(), cbPacket, _level))
+        {
+            printf("zlib couldn't compress a frame\n");
+            return {};
+        }
+
+        PutDWORD(&_envelope[0],  COMPRESSED_HEADER_TAG);
+        PutDWORD(&_envelope[4],  (uint32_t)cbCompressed);
+        PutDWORD(&_envelope[8],  (uint32_t)cbPacket);
+        PutDWORD(&_envelope[12], 0);
+        return std::span<const uint8_t>(_envelope.data(), 16 + cbCompressed);
+    }
+};